@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "resampler.hpp"
+#include "kernels.hpp"
+
+using namespace std;
+
+/**
+ * Compares the resampler engines at the rates STRM64 is mostly used with. For every engine, quality preset and rate pair this prints:
+ * - Throughput: input samples per second, resampling a minute of stereo white noise in blocks of the size the pipeline uses.
+ * - Stopband: the loudest output left over from full scale tones the filter has to remove, from 1.1 times the output Nyquist
+ *   frequency up to the input one, relative to the tone itself. Lower is better.
+ * Run it from a release build; libswresample only shows up in builds linked against it.
+ */
+
+#define BENCH_BLOCK_FRAMES 4096
+#define BENCH_SECONDS 60
+#define BENCH_CHANNELS 2
+#define BENCH_TONES 24
+#define BENCH_TONE_AMPLITUDE 29000.0
+
+struct RatePair {
+	int32_t inRate;
+	int32_t outRate;
+};
+
+static const RatePair RATE_PAIRS[] = {{44100, 32000}, {48000, 32000}, {44100, 22050}};
+
+static const char *const ENGINE_NAMES[] = {"builtin", "swr"};
+static const char *const QUALITY_NAMES[] = {"draft", "default", "high"};
+
+// Resamples interleaved input in blocks, appending each channel's output. Returns false if the resampler can't be set up.
+static bool resample(ResamplerEngine engine, ResamplerQuality quality, int32_t inRate, int32_t outRate, const vector<sample_t> &input,
+ int channels, vector<vector<sample_t>> *outputs) {
+	Resampler *resampler = resampler_create(engine, quality, channels, inRate, outRate);
+	if (resampler == NULL)
+		return false;
+
+	int frames = (int) (input.size() / channels);
+	vector<vector<sample_t>> block(channels);
+	outputs->assign(channels, vector<sample_t>());
+
+	for (int position = 0; position < frames; position += BENCH_BLOCK_FRAMES) {
+		int blockFrames = min(BENCH_BLOCK_FRAMES, frames - position);
+		int capacity = resampler_get_out_samples(resampler, blockFrames);
+
+		sample_t *blockPtrs[BENCH_CHANNELS];
+		for (int c = 0; c < channels; c++) {
+			block[c].resize((size_t) capacity);
+			blockPtrs[c] = block[c].data();
+		}
+
+		int produced = resampler_convert(resampler, blockPtrs, capacity, &input[(size_t) position * channels], blockFrames);
+		for (int c = 0; c < channels && produced > 0; c++)
+			(*outputs)[c].insert((*outputs)[c].end(), block[c].begin(), block[c].begin() + produced);
+	}
+
+	resampler_free(&resampler);
+	return true;
+}
+
+static double measure_throughput(ResamplerEngine engine, ResamplerQuality quality, const RatePair &rates) {
+	vector<sample_t> noise((size_t) rates.inRate * BENCH_SECONDS * BENCH_CHANNELS);
+	uint32_t state = 1;
+	for (size_t i = 0; i < noise.size(); i++) {
+		state = state * 1664525u + 1013904223u;
+		noise[i] = (sample_t) ((int32_t) (state >> 16) - 32768) / 2;
+	}
+
+	vector<vector<sample_t>> outputs;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	if (!resample(engine, quality, rates.inRate, rates.outRate, noise, BENCH_CHANNELS, &outputs))
+		return -1.0;
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	return (double) noise.size() / seconds;
+}
+
+static double measure_stopband(ResamplerEngine engine, ResamplerQuality quality, const RatePair &rates) {
+	double lowest = 0.55 * rates.outRate;
+	double highest = 0.49 * rates.inRate;
+	double worst = -200.0;
+
+	for (int t = 0; t < BENCH_TONES; t++) {
+		double frequency = lowest + (highest - lowest) * t / (BENCH_TONES - 1);
+		vector<sample_t> tone((size_t) rates.inRate);
+		for (size_t i = 0; i < tone.size(); i++)
+			tone[i] = (sample_t) lround(BENCH_TONE_AMPLITUDE * sin(2.0 * M_PI * frequency * i / rates.inRate));
+
+		vector<vector<sample_t>> outputs;
+		if (!resample(engine, quality, rates.inRate, rates.outRate, tone, 1, &outputs))
+			return 0.0;
+
+		// Leaves out the filter settling in at either end
+		const vector<sample_t> &output = outputs[0];
+		size_t edge = 2048;
+		double energy = 0.0;
+		for (size_t i = edge; i + edge < output.size(); i++)
+			energy += (double) output[i] * output[i];
+
+		double rms = sqrt(energy / (double) (output.size() - 2 * edge));
+		worst = max(worst, 20.0 * log10(max(rms, 1e-3) / (BENCH_TONE_AMPLITUDE / sqrt(2.0))));
+	}
+
+	return worst;
+}
+
+int main() {
+	printf("Kernels: %s\n", get_kernel_name());
+	printf("%-16s %-8s %-8s %14s %10s\n", "rates", "engine", "quality", "samples/s", "stopband");
+
+	for (const RatePair &rates : RATE_PAIRS) {
+		for (int engine = RESAMPLER_BUILTIN; engine <= RESAMPLER_SWR; engine++) {
+			if (!resampler_engine_available((ResamplerEngine) engine))
+				continue;
+
+			for (int quality = RESAMPLE_QUALITY_DRAFT; quality <= RESAMPLE_QUALITY_HIGH; quality++) {
+				double throughput = measure_throughput((ResamplerEngine) engine, (ResamplerQuality) quality, rates);
+				double stopband = measure_stopband((ResamplerEngine) engine, (ResamplerQuality) quality, rates);
+
+				char ratesName[32];
+				snprintf(ratesName, sizeof(ratesName), "%d -> %d", rates.inRate, rates.outRate);
+				printf("%-16s %-8s %-8s %12.1f M %7.1f dB\n", ratesName, ENGINE_NAMES[engine], QUALITY_NAMES[quality], throughput / 1e6, stopband);
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef BANDWIDTH_HPP
+#define BANDWIDTH_HPP
+
+#include <vector>
+#include <stdint.h>
+
+extern "C" {
+#include "vgmstream.h"
+}
+
+#include "stats.hpp"
+#include "mix.hpp"
+
+#define BANDWIDTH_FFT_SIZE 2048
+#define BANDWIDTH_LOSS_DEFAULT 60.0 // dB below the total energy of a channel that may be cut off by -R auto
+
+#define AUTO_RATE_MIN 8000
+#define AUTO_RATE_MAX 32000 // Highest rate the game plays back at full fidelity
+#define AUTO_RATE_STEP 1000
+#define AUTO_RATE_HEADROOM 0.8 // Part of the new Nyquist frequency the kept bandwidth may take up, leaving room for the resampler's transition band
+
+/**
+ * Decodes the first numSamples frames of the stream, mixed into the channels of mix, and measures how much of the spectrum each channel actually uses,
+ * as the lowest frequency above which less than lossDb below the channel's total energy remains.
+ * Bandwidths are relative to the Nyquist frequency (0 to 1). The stream is reset to its start afterwards.
+ */
+bool measure_channel_bandwidths(VGMSTREAM *vgmstream, const ChannelMix *mix, int32_t numSamples, double lossDb, std::vector<double> *bandwidths, ConversionStats *stats);
+
+// Lowest rate on the AUTO_RATE_STEP grid that keeps the given bandwidth of a stream played back at sampleRate, never above sampleRate
+int32_t choose_resample_rate(double bandwidth, int32_t sampleRate);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+struct BatchJob {
+	std::string inFilename;
+	std::vector<std::string> args;
+};
+
+bool is_batch_argument(std::string arg);
+bool batch_claim_output_name(std::string filename);
+std::vector<std::string> expand_input_glob(std::string pattern);
+int run_batch(std::vector<std::string> args);
+int run_subsongs(std::string inFilename, std::vector<std::string> args, std::string outFilename, bool isBatchJob, std::string *log = NULL);
+
+#endif
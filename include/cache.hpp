@@ -0,0 +1,18 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+
+struct ConversionJob;
+
+#define BUILD_CACHE_EXTENSION ".strm64cache"
+
+uint64_t hash_data(const void *data, size_t length, uint64_t seed);
+bool hash_file(std::string filename, uint64_t *hash, uint64_t *size);
+std::string build_cache_key(ConversionJob *job);
+bool build_cache_is_fresh(ConversionJob *job, std::string key);
+void build_cache_write_manifest(ConversionJob *job, std::string key);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef INPUT_HPP
+#define INPUT_HPP
+
+#include <string>
+
+extern "C" {
+#include "vgmstream.h"
+}
+
+#include "stats.hpp"
+
+#if !(defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__))
+#define INPUT_POSIX
+#endif
+
+#define INPUT_READ_AHEAD_SIZE (4 << 20) // Bytes per read-ahead window, two of which are in use per open file
+#define INPUT_PIPE_CHUNK_SIZE ((size_t) 1 << 20)
+#define INPUT_STDIN_NAME "-"
+
+/**
+ * Input files are read through STRM64's own STREAMFILE rather than vgmstream's stdio one, which reads in small pieces.
+ * Local files get memory mapped; anything that can't be mapped is read in large windows, with the next window
+ * already being read in the background while the current one is used.
+ * Reads are counted into stats, including those of every file vgmstream opens alongside the input.
+ *
+ * Standard input ("-") and anything else that can't be read at an offset, like pipes and FIFOs, is read into memory once
+ * and then shared by every STREAMFILE opened on it. If the name doesn't tell the format, the extension vgmstream needs
+ * is guessed from the first bytes (stdin is reported as "stdin.wav" and so on).
+ *
+ * subsong selects the stream of a multi-stream container (1 for the first one), 0 lets vgmstream pick the default.
+ * It's passed on to every file vgmstream opens from there.
+ */
+STREAMFILE *open_input_streamfile(const char *filename, ConversionStats *stats, int subsong);
+VGMSTREAM *open_input_vgmstream(std::string filename, ConversionStats *stats, int subsong);
+bool is_stdin_input(std::string filename);
+
+/**
+ * Joins parts into one VGMSTREAM that plays them back to back, through vgmstream's segmented layout. Parts are only decoded
+ * once playback reaches them, and any loop of their own is dropped. The result loops from the start of part loopStartPart
+ * to the end of the last one, or doesn't loop if that is negative.
+ * Every part needs the same sample rate and channel count. The parts belong to the result, and are closed if joining fails.
+ */
+VGMSTREAM *join_input_vgmstreams(VGMSTREAM **parts, int numParts, int loopStartPart);
+
+// Direct access to files opened by open_input_streamfile, for data that can be used without decoding. NULL / -1 for anything else.
+const uint8_t *get_input_mapping(STREAMFILE *sf, size_t *size);
+int get_input_fd(STREAMFILE *sf);
+
+#endif
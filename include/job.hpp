@@ -0,0 +1,94 @@
+#ifndef JOB_HPP
+#define JOB_HPP
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "stats.hpp"
+#include "resampler.hpp"
+#include "mix.hpp"
+
+#define LOOP_CACHE_LIMIT_DEFAULT (256LL << 20)
+
+struct SharedDecode;
+
+/**
+ * Holds every parameter and derived value of a single conversion. Nothing about a conversion is stored globally,
+ * so any number of jobs can be run at the same time within one process.
+ */
+struct ConversionJob {
+	// Files
+	std::string inFilename;
+	std::string outFilename; // Not including extension
+	std::string duplicateFilename;
+	int subsong; // Stream of a multi-stream container to convert (1 for the first one), 0 for the default one
+	std::vector<std::string> appendFilenames; // Played back to back after inFilename, as one stream looping over everything past it
+
+	bool convertSubsongs; // Convert every stream of a multi-stream container into its own set of files
+	bool isBatchJob; // Runs next to other jobs that already keep every core busy, so its own work isn't spread over threads
+
+	bool generateStreams;
+	bool generateSequence;
+	bool generateSoundbank;
+	bool useBuildCache;
+	bool encodeVadpcm; // Write VADPCM compressed AIFC streams instead of raw 16-bit AIFF
+
+	// Stream override parameters
+	int64_t ovrdSampleRate;
+	int64_t ovrdResampleRate;
+	std::vector<int64_t> resampleRates; // Every rate passed to -R, the first of which is also ovrdResampleRate
+	bool autoResampleRate; // -R auto, picks the rate of every channel from its measured bandwidth
+	double bandwidthLoss; // dB below a channel's total energy that -R auto may cut off
+	int64_t ovrdEnableLoop;
+	int64_t ovrdLoopStartSamples;
+	int64_t ovrdLoopEndSamples;
+	int64_t ovrdLoopStartMicro;
+	int64_t ovrdLoopEndMicro;
+	int64_t ovrdStartSamples; // First sample of the source kept in the output, everything before it is skipped
+	int64_t ovrdStartMicro;
+	ResamplerEngine resamplerEngine;
+	ResamplerQuality resampleQuality;
+	int64_t resampleGroupSize; // Channels per resampler thread, 0 for a single resampler
+	int64_t decodeThreads; // Parts of the input decoded at once by separate decoders, 1 to decode serially
+	int64_t loopCacheLimit; // Bytes of decoded loop audio that may be kept in memory, 0 to always seek instead
+	double autoMonoTolerance; // dB the difference of stereo channels has to stay below their sum to write them as one mono stream, 0 to keep stereo
+	ChannelMix channelMix; // Layout from --map / --mix, written instead of the decoded channels
+	int32_t silenceThreshold; // Peak amplitude at or below which a channel counts as silent and gets dropped, -1 to keep every channel
+	SharedDecode *sharedDecode; // Decode shared with the jobs converting the same input at other resample rates, if any
+	size_t sharedDecodeIndex;
+
+	// Sequence parameters
+	bool forcedMono;
+	uint8_t seqNumChannels;
+	int8_t muteScale;
+	uint8_t masterVolume;
+
+	// Derived values
+	uint16_t instFlags; // Channels that made it into the stream files
+	uint8_t streamChannels; // Channels written to stream files, after mixing but before dropping any
+	std::vector<int32_t> channelPeaks; // Loudest sample written to each channel so far, only tracked with a silence threshold set
+	long double sequenceTimestamp;
+	uint8_t tempo;
+	int16_t timestamp;
+	std::string warnings;
+	std::vector<std::string> outputFiles; // Every file written so far
+	ConversionStats stats;
+
+	// Output
+	bool bufferLog; // Collect everything printed in log instead, for jobs running next to others that print it in one piece once done
+	std::string log;
+
+	ConversionJob();
+};
+
+// printf to stdout, or appended to log if set. Either way, output from different threads never ends up in the middle of each other.
+void log_printf(std::string *log, const char *format, ...);
+// printf for anything a job prints, which ends up in its log if it's buffered
+void job_printf(ConversionJob *job, const char *format, ...);
+void print_param_warning(ConversionJob *job, std::string param);
+void set_filename_duplicate(ConversionJob *job, std::string duplicate);
+void add_appended_input(ConversionJob *job, std::string filename);
+int run_conversion_job(ConversionJob *job);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "streamtypes.h"
+
+#define MIX_KERNEL_WIDTH 16 // Gains per output in the tables of the vector mixing kernels, one for every possible input channel
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define KERNELS_X86
+#endif
+
+// Instruction set picked for the running CPU: "scalar", "sse2" or "avx2". The STRM64_KERNELS environment variable can lower it.
+const char *get_kernel_name();
+
+// Splits interleaved samples into one buffer per channel, converting each sample to big-endian along the way.
+// Picks the fastest implementation supported by the running CPU.
+void deinterleave_bswap_16(const sample_t *input, sample_t **outputs, int numChannels, uint32_t numFrames);
+
+// Same without the byteswap, for input that is already big-endian.
+void deinterleave_16(const sample_t *input, sample_t **outputs, int numChannels, uint32_t numFrames);
+
+// Converts samples to big-endian in place.
+void bswap_16_inplace(sample_t *samples, uint32_t count);
+
+// Raises peaks[c] to the largest magnitude found in channel c of interleaved samples, which are big-endian if bigEndian is set.
+void channel_peaks_16(const sample_t *input, int numChannels, uint32_t numFrames, bool bigEndian, int32_t *peaks);
+
+// Adds the energy of the sum of two channels to energy[0] and that of their difference to energy[1].
+// Samples of each channel are stride apart, so this works on interleaved frames as well as separate buffers.
+void stereo_energy_16(const sample_t *left, const sample_t *right, size_t stride, uint32_t numFrames, bool bigEndian, double *energy);
+
+// Mixes interleaved frames of inputChannels into interleaved frames of outputChannels, saturating to 16 bits. matrix holds the gains
+// of every input channel for each output, with MIX_GAIN_BITS fraction bits. Integer arithmetic throughout, like dot_products_16,
+// so the vector implementations (used whenever every gain fits 16 bits) give the same results as the scalar one.
+void mix_channels_16(const sample_t *input, int inputChannels, sample_t *output, int outputChannels, const int32_t *matrix, uint32_t numFrames);
+
+// Squared open-loop prediction error of one 16 sample VADPCM frame for each order 2 predictor.
+// samples holds the two preceding samples followed by the frame, coefs holds the (x[n-1], x[n-2]) coefficient pair of each predictor.
+// Results are identical on every implementation, so the encoder output doesn't depend on the running CPU.
+void vadpcm_predictor_errors(const float *samples, const float *coefs, int numPredictors, float *errors);
+
+// Sum of samples[k][offset + i] * coefs[i] over length terms for each of count sample buffers, for FIR filtering 16-bit audio
+// with fixed point coefficients. Integer arithmetic throughout, so results are identical on every implementation.
+// Sums wrap around at 32 bits; callers keep 32768 times the L1 norm of coefs within INT32_MAX so that a full scale input never does.
+void dot_products_16(sample_t *const *samples, size_t offset, int count, const int16_t *coefs, int length, int32_t *sums);
+
+// Instruction set specific implementations, only to be called through the dispatcher above.
+// Each returns how many leading frames it processed; the remainder is left for the scalar fallback.
+uint32_t deinterleave_bswap_16_sse2(const sample_t *input, sample_t **outputs, int numChannels, uint32_t numFrames);
+uint32_t deinterleave_bswap_16_avx2(const sample_t *input, sample_t **outputs, int numChannels, uint32_t numFrames);
+int vadpcm_predictor_errors_sse2(const float *samples, const float *coefs, int numPredictors, float *errors);
+int dot_products_16_sse2(sample_t *const *samples, size_t offset, int count, const int16_t *coefs, int length, int32_t *sums);
+int dot_products_16_avx2(sample_t *const *samples, size_t offset, int count, const int16_t *coefs, int length, int32_t *sums);
+// gains holds MIX_KERNEL_WIDTH gains for each output, with zeroes past inputChannels, and zeroed outputs up to a multiple of 4
+uint32_t mix_channels_16_sse2(const sample_t *input, int inputChannels, sample_t *output, int outputChannels, const int16_t *gains, uint32_t numFrames);
+uint32_t mix_channels_16_avx2(const sample_t *input, int inputChannels, sample_t *output, int outputChannels, const int16_t *gains, uint32_t numFrames);
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef KERNELS_SIMD_HPP
+#define KERNELS_SIMD_HPP
+
+#include <stdint.h>
+
+#include "streamtypes.h"
+
+/**
+ * Generic deinterleave + byteswap kernel, shared by every vector instruction set.
+ * Only include this from a translation unit compiled for the instruction set of the Ops structure being used.
+ *
+ * Ops must provide a vector type `vec` holding FRAMES samples, along with load, store, bswap and split.
+ * split(a, b) separates the even and odd 16-bit lanes of two consecutive vectors.
+ */
+namespace {
+
+// Recursively splits N vectors of N-channel interleaved audio into one vector per channel.
+// Separating even and odd samples of an N channel stream yields two N/2 channel streams (even and odd channels).
+template <class Ops, int N>
+struct SplitChannels {
+	static inline void run(const typename Ops::vec *in, typename Ops::vec *out) {
+		typename Ops::vec even[N / 2], odd[N / 2];
+		typename Ops::vec evenOut[N / 2], oddOut[N / 2];
+
+		for (int k = 0; k < N / 2; k++)
+			Ops::split(in[2 * k], in[2 * k + 1], &even[k], &odd[k]);
+
+		SplitChannels<Ops, N / 2>::run(even, evenOut);
+		SplitChannels<Ops, N / 2>::run(odd, oddOut);
+
+		for (int j = 0; j < N / 2; j++) {
+			out[2 * j] = evenOut[j];
+			out[2 * j + 1] = oddOut[j];
+		}
+	}
+};
+
+template <class Ops>
+struct SplitChannels<Ops, 1> {
+	static inline void run(const typename Ops::vec *in, typename Ops::vec *out) {
+		out[0] = in[0];
+	}
+};
+
+template <class Ops, int N>
+uint32_t deinterleave_bswap_simd(const sample_t *input, sample_t **outputs, uint32_t numFrames) {
+	typename Ops::vec in[N], out[N];
+	uint32_t frame = 0;
+
+	for (; frame + Ops::FRAMES <= numFrames; frame += Ops::FRAMES) {
+		for (int k = 0; k < N; k++)
+			in[k] = Ops::bswap(Ops::load(input + (size_t) frame * N + (size_t) k * Ops::FRAMES));
+
+		SplitChannels<Ops, N>::run(in, out);
+
+		for (int c = 0; c < N; c++)
+			Ops::store(outputs[c] + frame, out[c]);
+	}
+
+	return frame;
+}
+
+// Only power of two channel counts can be split in registers; anything else is left to the scalar kernels.
+template <class Ops>
+uint32_t deinterleave_bswap_simd_dispatch(const sample_t *input, sample_t **outputs, int numChannels, uint32_t numFrames) {
+	switch (numChannels) {
+	case 1:
+		return deinterleave_bswap_simd<Ops, 1>(input, outputs, numFrames);
+	case 2:
+		return deinterleave_bswap_simd<Ops, 2>(input, outputs, numFrames);
+	case 4:
+		return deinterleave_bswap_simd<Ops, 4>(input, outputs, numFrames);
+	case 8:
+		return deinterleave_bswap_simd<Ops, 8>(input, outputs, numFrames);
+	case 16:
+		return deinterleave_bswap_simd<Ops, 16>(input, outputs, numFrames);
+	}
+
+	return 0;
+}
+
+}
+
+#endif
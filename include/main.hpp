@@ -2,6 +2,7 @@
 #define MAIN_HPP
 
 #include <string>
+#include <vector>
 #include <stdint.h>
 
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
@@ -27,16 +28,23 @@ enum ReturnCodes {
     RETURN_SEQUENCE_CANNOT_CREATE_FILE,
 
     RETURN_SOUNDBANK_NO_CHANNELS,
-    RETURN_SOUNDBANK_CANNOT_CREATE_FILE
+    RETURN_SOUNDBANK_CANNOT_CREATE_FILE,
+
+    RETURN_BATCH_NO_JOBS,
+    RETURN_BATCH_CANNOT_OPEN_JOB_FILE,
+    RETURN_BATCH_JOB_FAILED,
+
+    RETURN_STREAM_OUT_OF_MEMORY,
+
+    RETURN_INVALID_CHANNEL_MAP,
+    RETURN_APPENDED_INPUT_MISMATCH
 };
 
-#define NUM_CHANNELS_MAX (sizeof(uint16_t) * 8)
+#define STRM64_VERSION "1.2.2" // Bump whenever generated files change, so build caches get invalidated
 
-bool is_mono();
-void set_filename_duplicate(std::string duplicate);
-std::string get_filename_duplicate();
+#define NUM_CHANNELS_MAX (sizeof(uint16_t) * 8)
 
-void print_param_warning(std::string param);
+int convert_file(std::string inFilename, std::vector<std::string> args, bool isBatchJob, int subsong = 0, std::string *log = NULL);
 void print_header_info(bool isStreamGeneration, uint32_t fileSize);
 
 #endif
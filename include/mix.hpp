@@ -0,0 +1,47 @@
+#ifndef MIX_HPP
+#define MIX_HPP
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+extern "C" {
+#include "vgmstream.h"
+}
+
+#define MIX_GAIN_BITS 14 // Fixed point fraction bits of the resolved gains
+#define MIX_GAIN_MAX 4.0
+#define MIX_CHUNK_FRAMES 512 // Frames rendered at once before mixing, which keeps the unmixed channels on the stack
+
+/**
+ * Channel layout written instead of the decoded one, from --map or --mix. Every output channel is a weighted sum of input channels.
+ * Specs are parsed before the input is known, and only get checked against its channel count by resolve_channel_mix.
+ */
+struct ChannelMix {
+	std::string spec; // As passed on the command line, empty if channels are written as decoded
+	int outputChannels; // 0 if channels are written as decoded
+	int foldChannels; // Outputs of the mono / stereo presets, which average every input channel, 0 for an explicit matrix
+	std::vector<std::vector<std::pair<int, double>>> terms; // Input channel and gain of every term of each output
+
+	int inputChannels; // Set by resolve_channel_mix
+	std::vector<int32_t> matrix; // outputChannels x inputChannels gains with MIX_GAIN_BITS fraction bits
+
+	ChannelMix();
+};
+
+// "0,1,4" writes input channels 0, 1 and 4 as channels 0 to 2. Channels may be repeated or reordered.
+bool parse_channel_map(std::string spec, ChannelMix *mix);
+
+// Either "mono" / "stereo", or a comma separated list of outputs that each sum up terms like "0.5*2+1" (channel 1 at full gain).
+bool parse_channel_mix(std::string spec, ChannelMix *mix);
+
+// Builds the gain matrix for a stream with inputChannels channels, or returns false if the mix refers to channels it doesn't have.
+bool resolve_channel_mix(ChannelMix *mix, int inputChannels);
+
+// Replaces a resolved mix with a single output averaging all of its outputs, or all decoded channels if no mix is set.
+void fold_channel_mix_to_mono(ChannelMix *mix, int inputChannels);
+
+// render_vgmstream, with the output mixed into the layout of mix if one is set. buffer holds sampleCount frames of mixed channels.
+int render_mixed_vgmstream(sample_t *buffer, int32_t sampleCount, VGMSTREAM *vgmstream, const ChannelMix *mix);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef OUTPUT_HPP
+#define OUTPUT_HPP
+
+#include <string>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#if !(defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__))
+#define OUTPUT_MMAP
+#endif
+
+/**
+ * Output file with a size known up front. Where possible, the file is preallocated and memory mapped so data can be
+ * written straight into it; otherwise (or if the filesystem can't preallocate) it falls back to buffered stdio.
+ * A disk without room for the whole file fails the open instead.
+ */
+struct OutputFile {
+	FILE *file; // Only used by the stdio fallback
+	uint8_t *mapping;
+	int fd;
+	size_t size;
+	size_t offset;
+	bool inMemory; // Kept in mapping instead of a file, for data that needs further processing before it gets written
+
+	OutputFile();
+};
+
+bool output_open(OutputFile *out, std::string filename, size_t size);
+bool output_open_memory(OutputFile *out, size_t size);
+void output_write(OutputFile *out, const void *data, size_t length);
+uint8_t *output_reserve(OutputFile *out, size_t length);
+void output_advance(OutputFile *out, size_t length);
+bool output_copy_from(OutputFile *out, int fd, int64_t offset, size_t length);
+bool output_is_mapped(OutputFile *out);
+void output_close(OutputFile *out);
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+extern "C" {
+#include "vgmstream.h"
+}
+
+#include "stats.hpp"
+
+#define PIPELINE_RING_BLOCKS 8 // Must be a power of 2
+#define PIPELINE_SPIN_COUNT 64 // Checks a waiting stage makes before it goes to sleep until woken up
+
+// Fixed-size block of interleaved audio passed between pipeline stages
+struct AudioBlock {
+	sample_t *samples;
+	uint32_t frames; // Frames in this block that still need to be written out
+};
+
+/**
+ * Bounded lock-free ring for exactly one producer thread and one or more consumer threads.
+ * Every consumer sees every block; a slot is only reused once all attached consumers have released it.
+ * Slots are preallocated and handed out in place, so blocks are filled and drained without any copying.
+ * Waiting functions return NULL if the pipeline gets cancelled (or, when reading, once the producer is done and the ring is drained).
+ * A stage that has to wait spins briefly, then sleeps until the other side moves on, so a stage held up by a slower one doesn't take up a core.
+ * Whoever sets a cancellation flag has to call wake() afterwards.
+ */
+template <class T>
+class BlockRing {
+	std::vector<T> slots;
+	size_t mask;
+	std::vector<std::atomic<size_t>> heads; // Next slot to read per consumer, each only advanced by its own consumer
+	std::vector<std::atomic<bool>> detached; // Consumers that stopped reading and no longer hold the producer back
+	std::atomic<size_t> tail; // Next slot to write, only advanced by the producer
+	std::atomic<bool> closed;
+	std::mutex waitLock; // Only taken by stages going to sleep and by the ones waking them up
+	std::condition_variable waitSignal;
+	std::atomic<int> sleepers; // Stages that are about to sleep or sleeping, so wake() can skip the lock while every stage keeps up
+
+	// A stage counts itself as sleeping before checking ready one last time, so wake() either sees it or it sees the change wake() follows
+	template <class Ready>
+	void wait_until(Ready ready) {
+		for (uint32_t spins = 0; spins < PIPELINE_SPIN_COUNT; spins++) {
+			if (ready())
+				return;
+		}
+
+		std::unique_lock<std::mutex> lock(waitLock);
+		sleepers.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		waitSignal.wait(lock, ready);
+		sleepers.fetch_sub(1);
+	}
+
+	bool is_full(size_t t) {
+		for (size_t i = 0; i < heads.size(); i++) {
+			if (!detached[i].load(std::memory_order_acquire) && t - heads[i].load(std::memory_order_acquire) >= slots.size())
+				return true;
+		}
+
+		return false;
+	}
+
+public:
+	BlockRing(size_t capacity, size_t numConsumers = 1) : slots(capacity), mask(capacity - 1), heads(numConsumers),
+	 detached(numConsumers), tail(0), closed(false), sleepers(0) {
+		for (size_t i = 0; i < numConsumers; i++) {
+			heads[i].store(0);
+			detached[i].store(false);
+		}
+	}
+
+	T &slot(size_t index) {
+		return slots[index];
+	}
+
+	size_t capacity() {
+		return slots.size();
+	}
+
+	T *wait_write(const std::atomic<bool> &cancelled) {
+		size_t t = tail.load(std::memory_order_relaxed);
+
+		wait_until([&]() {
+			return cancelled.load(std::memory_order_relaxed) || !is_full(t);
+		});
+
+		if (cancelled.load(std::memory_order_relaxed))
+			return NULL;
+
+		return &slots[t & mask];
+	}
+
+	void commit_write() {
+		tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		wake();
+	}
+
+	// Marks the end of the stream; consumers drain whatever is left and then stop.
+	void close_write() {
+		closed.store(true, std::memory_order_release);
+		wake();
+	}
+
+	T *wait_read(const std::atomic<bool> &cancelled, size_t consumer = 0) {
+		size_t h = heads[consumer].load(std::memory_order_relaxed);
+
+		wait_until([&]() {
+			return cancelled.load(std::memory_order_relaxed) || tail.load(std::memory_order_acquire) != h || closed.load(std::memory_order_acquire);
+		});
+
+		if (cancelled.load(std::memory_order_relaxed) || tail.load(std::memory_order_acquire) == h)
+			return NULL;
+
+		return &slots[h & mask];
+	}
+
+	void release_read(size_t consumer = 0) {
+		heads[consumer].store(heads[consumer].load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		wake();
+	}
+
+	// Called by a consumer that is done reading before the producer is done writing.
+	void detach(size_t consumer = 0) {
+		detached[consumer].store(true, std::memory_order_release);
+		wake();
+	}
+
+	// Wakes up every sleeping stage, so it sees whatever changed since it went to sleep
+	void wake() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleepers.load(std::memory_order_relaxed) == 0)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(waitLock);
+		}
+		waitSignal.notify_all();
+	}
+};
+
+typedef BlockRing<AudioBlock> AudioRing;
+
+bool allocate_audio_ring(AudioRing *ring, size_t samplesPerBlock, ConversionStats *stats);
+void free_audio_ring(AudioRing *ring);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef RESAMPLER_HPP
+#define RESAMPLER_HPP
+
+#include <string>
+#include <stdint.h>
+
+#include "streamtypes.h"
+
+#define RESAMPLER_MAX_PHASES 1024 // Ratios needing more exact phases interpolate between the phases of the quality preset instead
+
+enum ResamplerEngine {
+	RESAMPLER_BUILTIN, // Polyphase windowed sinc filter, always available
+	RESAMPLER_SWR      // libswresample, only available in builds linked against it
+};
+
+// Filter settings shared by both engines, see gPresets for what each one sets
+enum ResamplerQuality {
+	RESAMPLE_QUALITY_DRAFT,
+	RESAMPLE_QUALITY_DEFAULT,
+	RESAMPLE_QUALITY_HIGH
+};
+
+/**
+ * Converts interleaved 16-bit audio from one sample rate to another, block by block, into one output buffer per channel.
+ * Like swr_convert, input that can't be turned into output yet is buffered until the next call.
+ * Output sample n is centered on input sample n * inRate / outRate, with silence assumed before the start of the input.
+ *
+ * The built-in engine's filter only depends on the ratio and quality, so coefficient tables are built once per combination and
+ * then shared by every resampler using it, for as long as the process runs.
+ */
+struct Resampler;
+
+// Warnings go to log, or stdout if it's NULL
+Resampler *resampler_create(ResamplerEngine engine, ResamplerQuality quality, int channels, int32_t inRate, int32_t outRate,
+ std::string *log = NULL);
+void resampler_free(Resampler **resampler);
+int resampler_get_out_samples(Resampler *resampler, int inSamples);
+int resampler_convert(Resampler *resampler, sample_t **outputs, int outputSamples, const sample_t *input, int inputSamples);
+
+bool resampler_engine_available(ResamplerEngine engine);
+bool parse_resampler_engine(std::string name, ResamplerEngine *engine);
+bool parse_resampler_quality(std::string name, ResamplerQuality *quality);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef SEGMENT_HPP
+#define SEGMENT_HPP
+
+#include <stdint.h>
+
+extern "C" {
+#include "vgmstream.h"
+}
+
+#define SEGMENT_MIN_SAMPLES 0x10000 // Shorter ranges aren't worth opening another decoder for
+#define SEGMENT_WARMUP_SAMPLES 0x800
+#define SEGMENT_HISTORY_SAMPLES 2 // Output samples that fully determine the state of the ADPCM decoders that allow warming up
+
+// How a freshly opened VGMSTREAM can be made to start decoding in the middle of the stream
+enum SegmentSeekType {
+	SEGMENT_SEEK_NONE,   // Decoder state can't be recreated, so the stream has to be decoded serially
+	SEGMENT_SEEK_EXACT,  // Stateless codec, every sample decodes the same no matter where decoding started
+	SEGMENT_SEEK_WARMUP  // Decoder state is just the last output samples, so it can be recovered by decoding a bit ahead of time
+};
+
+SegmentSeekType get_segment_seek_type(VGMSTREAM *vgmstream);
+int32_t get_segment_warmup_start(VGMSTREAM *vgmstream, int32_t sample);
+bool position_vgmstream(VGMSTREAM *vgmstream, int32_t sample);
+
+#endif
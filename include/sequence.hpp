@@ -4,6 +4,11 @@
 #include <string>
 #include <stdint.h>
 
+struct ConversionJob;
+
+#define MUTE_SCALE_DEFAULT 0x3F
+#define MASTER_VOLUME_DEFAULT 0x7F
+
 enum SEQCommands {
 	SEQ_CHANNEL_POINTER = 0x90, // 0x90-0x9F
 	SEQ_MUTE_BEHAVIOR = 0xD3,
@@ -41,31 +46,34 @@ enum TrackCommands {
 };
 
 class SEQHeader {
+	ConversionJob *job;
 	uint16_t channelFlags;
 	uint8_t channelCount;
 	int8_t muteScale;
 	uint8_t volume;
 
 public:
-	SEQHeader(uint16_t instFlags, uint8_t numChannels);
+	SEQHeader(ConversionJob *conversionJob, uint16_t instFlags, uint8_t numChannels);
 	~SEQHeader();
 
 	void write_seq_header(FILE *seqFile, uint16_t seqHeaderSize);
 };
 
 class CHNHeader {
+	ConversionJob *job;
 	uint8_t channelId;
 	uint8_t instrument;
 	uint8_t pan;
 
 public:
-	CHNHeader(uint8_t channelIndex, uint8_t instId, uint8_t numChannels);
+	CHNHeader(ConversionJob *conversionJob, uint8_t channelIndex, uint8_t instId, uint8_t streamChannels);
 	~CHNHeader();
 
 	void write_chn_header(FILE *seqFile, uint8_t channelCount, uint16_t seqHeaderSize);
 };
 
 class SEQFile {
+	ConversionJob *job;
 	std::string filename;
 	uint8_t channelCount;
 	uint16_t channelFlags;
@@ -73,20 +81,19 @@ class SEQFile {
 	CHNHeader **chnHeader;
 
 public:
-	SEQFile(std::string fname, uint16_t instFlags, uint8_t numChannels);
+	SEQFile(ConversionJob *conversionJob, std::string fname, uint16_t instFlags, uint8_t numChannels);
 	~SEQFile();
 
 	int write_sequence();
 	void write_trk_header(FILE *seqFile);
 };
 
-std::string seq_get_duration_print();
-void seq_set_timestamp_duration(long double duration120BPM);
-uint8_t seq_get_num_channels();
-bool seq_set_num_channels(int64_t numChannels);
-void seq_set_mute_scale(int64_t muteScale);
-void seq_set_master_volume(int64_t volume);
+std::string seq_get_duration_print(ConversionJob *job);
+void seq_set_timestamp_duration(ConversionJob *job, long double duration120BPM);
+bool seq_set_num_channels(ConversionJob *job, int64_t numChannels);
+void seq_set_mute_scale(ConversionJob *job, int64_t muteScale);
+void seq_set_master_volume(ConversionJob *job, int64_t volume);
 
-int generate_new_sequence(std::string filename, uint16_t instFlags);
+int generate_new_sequence(ConversionJob *job, std::string filename, uint16_t instFlags);
 
 #endif
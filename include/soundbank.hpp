@@ -1,8 +1,11 @@
 #ifndef SOUNDBANK_HPP
 #define SOUNDBANK_HPP
 
+#include <string>
 #include <stdint.h>
 
-int generate_new_soundbank(std::string filename, uint16_t instFlags);
+struct ConversionJob;
+
+int generate_new_soundbank(ConversionJob *job, std::string filename, uint16_t instFlags);
 
 #endif
@@ -0,0 +1,82 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <stddef.h>
+
+enum StatsFormat {
+	STATS_DISABLED,
+	STATS_TEXT,
+	STATS_JSON
+};
+
+enum StatsStage {
+	STATS_STAGE_DECODE,   // render_vgmstream and --map / --mix, including replays from the loop cache
+	STATS_STAGE_RESAMPLE, // resampler_convert
+	STATS_STAGE_BYTESWAP, // Deinterleaving and byteswapping into the output buffers
+	STATS_STAGE_ENCODE,   // VADPCM codebook training and encoding
+	STATS_STAGE_WRITE,    // Handing headers and samples to the output files
+	STATS_STAGE_STREAMS,  // Everything within write_streams, as wall clock time
+	STATS_STAGE_ANALYZE,  // Spectra, peaks and stereo correlation measured for -R auto, --prune-silence and --auto-mono
+	NUM_STATS_STAGES
+};
+
+/**
+ * Counters gathered while converting a single file. Stages can be timed from several threads at once,
+ * so per-stage times are the sum over all threads working on that stage.
+ */
+struct ConversionStats {
+	StatsFormat format;
+	std::atomic<uint64_t> stageNanoseconds[NUM_STATS_STAGES];
+	std::atomic<uint64_t> samplesDecoded;   // Frames times channels
+	std::atomic<uint64_t> samplesResampled; // Frames times channels
+	std::atomic<uint64_t> samplesWritten;   // Frames times channels, excluding headers
+	std::atomic<uint64_t> bytesWritten;
+	std::atomic<uint64_t> inputRequests; // Reads vgmstream asked for
+	std::atomic<uint64_t> inputReads;    // Reads actually issued to the file system, zero for memory mapped inputs
+	std::atomic<uint64_t> inputBytes;
+	std::atomic<uint64_t> allocations;
+	std::atomic<uint64_t> allocatedBytes;
+
+	ConversionStats();
+};
+
+// Measures the time until it goes out of scope and adds it to the given stage. Does nothing if stats are disabled.
+class StatsTimer {
+	ConversionStats *stats;
+	StatsStage stage;
+	std::chrono::steady_clock::time_point start;
+
+public:
+	StatsTimer(ConversionStats *conversionStats, StatsStage timedStage) : stats(conversionStats), stage(timedStage) {
+		if (stats->format != STATS_DISABLED)
+			start = std::chrono::steady_clock::now();
+	}
+
+	~StatsTimer() {
+		if (stats->format == STATS_DISABLED)
+			return;
+
+		uint64_t elapsed = (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		stats->stageNanoseconds[stage].fetch_add(elapsed, std::memory_order_relaxed);
+	}
+};
+
+static inline void stats_add(ConversionStats *stats, std::atomic<uint64_t> *counter, uint64_t value) {
+	if (stats->format != STATS_DISABLED)
+		counter->fetch_add(value, std::memory_order_relaxed);
+}
+
+static inline void stats_count_allocation(ConversionStats *stats, size_t bytes) {
+	stats_add(stats, &stats->allocations, 1);
+	stats_add(stats, &stats->allocatedBytes, bytes);
+}
+
+uint64_t get_peak_rss();
+bool set_stats_format(ConversionStats *stats, std::string format);
+void print_stats(ConversionStats *stats, std::string inFilename, std::string *log);
+
+#endif
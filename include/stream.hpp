@@ -2,17 +2,55 @@
 #define STREAM_HPP
 
 #include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
 #include <stdint.h>
 
 extern "C" {
 #include "vgmstream.h"
-#include "libswresample/swresample.h"
 }
 
+#include "pipeline.hpp"
+#include "output.hpp"
+#include "resampler.hpp"
+
+struct ConversionJob;
+
 #define SAMPLE_COUNT_PADDING 0x10
 #define MIN_PRINT_BUFFER_SIZE 0x1000
+#define DECODE_THREADS_MAX 64
+
+/**
+ * Lets several jobs converting the same input at different resample rates share one decode.
+ * Whichever job reaches resampling first decodes into a single ring, which every job reads from as one consumer per resample group.
+ * The --auto-mono decision is shared as well, made by whichever job gets to it first.
+ * Decoding stops once every consumer is done, including those of jobs that fail or finish without ever reading.
+ */
+struct SharedDecode {
+	std::mutex lock;
+	size_t numJobs;
+	size_t consumersPerJob;
+	AudioRing *ring; // Created by the first job to attach
+	bool producerClaimed;
+	std::vector<bool> attached;
+	std::vector<bool> finished;
+	std::atomic<int> consumersRemaining;
+	std::atomic<bool> stopDecoding;
+	std::mutex monoFoldLock; // Held while the stereo channels are compared for --auto-mono, so only one job ever compares them
+	int monoFold; // -1 until compared, then 1 if every job folds its stereo channels into one
+
+	SharedDecode(size_t jobs);
+	~SharedDecode();
+};
+
+AudioRing *shared_decode_attach(SharedDecode *shared, size_t jobIndex, size_t consumersPerJob, size_t samplesPerBlock, ConversionStats *stats,
+ bool *isProducer);
+void shared_decode_release(SharedDecode *shared, size_t consumer);
+void shared_decode_finish(SharedDecode *shared, size_t jobIndex);
 
 class AudioOutData {
+    ConversionJob *job;
     bool resample;
     bool vgmstreamLoopPointMismatch;
     int32_t sampleRate;
@@ -20,43 +58,91 @@ class AudioOutData {
     int32_t loopStartSamples;
     int32_t loopEndSamples;
     int32_t numSamples;
+    int32_t startOffset; // Source sample that output sample 0 is decoded from; every other sample count here is relative to it
     int32_t resampledSampleRate;
     int32_t resampledLoopStartSamples;
     int32_t resampledLoopEndSamples;
     int32_t resampledNumSamples;
     int numChannels;
-    struct SwrContext *resampleContext;
+    int decodedChannels; // Channels per frame of the decoded blocks, more than numChannels when converting a single channel of them
+    std::vector<int32_t> channelRates; // Rate of every channel chosen by -R auto, empty if all channels share resampledSampleRate
+    uint32_t fileSize; // Size of each stream file, once calculated for the output format
+    uint32_t vadpcmLoopStartSamples; // Loop points moved onto a frame boundary for VADPCM encoding
+    uint32_t vadpcmLoopEndSamples;
+    uint32_t vadpcmNumSamples;
 
 public:
-	AudioOutData(VGMSTREAM *inFileProperties);
+	AudioOutData(ConversionJob *conversionJob, VGMSTREAM *inFileProperties);
 	~AudioOutData();
-    void print_header_info();
+    void print_header_info(const std::vector<AudioOutData> &channelData);
     void set_sequence_duration_120bpm();
     int check_properties(VGMSTREAM *inFileProperties, std::string newFilename);
+    int resolve_resampled_metadata(VGMSTREAM *inFileProperties);
+    int compare_stereo_channels(VGMSTREAM *inFileProperties, bool *fold);
+    int choose_mono_fold(VGMSTREAM *inFileProperties);
+    int choose_channel_rates(VGMSTREAM *inFileProperties);
+    void seek_to_start(VGMSTREAM *inFileProperties);
     void calculate_aiff_file_size();
-    void write_form_header(FILE *streamFile);
-    void write_comm_header(FILE *streamFile);
-    void write_mark_header(FILE *streamFile);
-    void write_inst_header(FILE *streamFile);
-    void write_ssnd_header(FILE *streamFile);
-    void write_stream_headers(FILE **streamFiles);
-    int init_audio_resampling(VGMSTREAM *inFileProperties, int inputBufferSize);
-    void cleanup_resample_context();
-    int resample_audio_data(const sample_t *inputAudioBuffer, sample_t *audioOutBuffer, sample_t *printBuffer,
-     FILE **streamFiles, int inputBufferSize, int outputBufferSamples, uint32_t samplesPadded, uint32_t *totalSamplesProcessed);
-    int write_resampled_audio_data(VGMSTREAM *inFileProperties, FILE **streamFiles);
-    void write_audio_data(VGMSTREAM *inFileProperties, FILE **streamFiles);
+    void calculate_aifc_file_size();
+    void write_form_header(uint8_t **header);
+    void write_comm_header(uint8_t **header);
+    void write_mark_header(uint8_t **header);
+    void write_inst_header(uint8_t **header);
+    void write_ssnd_header(uint8_t **header);
+    void write_stream_headers(OutputFile *streamFiles);
+    int init_audio_resampling(Resampler **context, int channels);
+    int resample_audio_data(Resampler *context, int channels, const sample_t *inputAudioBuffer, sample_t **audioOutBuffers,
+     int inputBufferSize, int outputBufferSamples, uint32_t samplesPadded, uint32_t *totalSamplesProcessed, uint32_t *samplesToWrite);
+    void decode_stage(VGMSTREAM *inFileProperties, AudioRing *decodedRing, uint32_t bufferSize, uint32_t samplesPadded,
+     std::atomic<bool> *cancelled);
+    void decode_looped_stage(VGMSTREAM *inFileProperties, AudioRing *decodedRing, uint32_t bufferSize, std::atomic<bool> *stopDecoding);
+    sample_t *allocate_samples(size_t count);
+    sample_t *allocate_loop_cache();
+    void render_cached_loop(VGMSTREAM *inFileProperties, sample_t *loopCache, sample_t *audioBuffer, uint32_t bufferSize,
+     uint32_t *position, bool *cacheFilled);
+    void track_channel_peaks(const sample_t *input, int firstChannel, int channels, uint32_t frames, bool bigEndian);
+    uint16_t find_silent_channels();
+    void write_stage(AudioRing *ring, sample_t **printBuffer, OutputFile *streamFiles, std::atomic<bool> *cancelled);
+    int resample_channel_group(SharedDecode *shared, size_t consumer, int firstChannel, int groupChannels, OutputFile *streamFiles,
+     uint32_t bufferSize, uint32_t resampledSamplesPadded, std::atomic<bool> *cancelled);
+    int write_resampled_channel_groups(VGMSTREAM *inFileProperties, OutputFile *streamFiles, uint32_t bufferSize,
+     uint32_t resampledSamplesPadded, int groupSize);
+    int write_resampled_audio_data(VGMSTREAM *inFileProperties, OutputFile *streamFiles);
+    int write_channel_rate_audio_data(VGMSTREAM *inFileProperties, OutputFile *streamFiles, std::vector<AudioOutData> &channelData);
+    void decode_segment(VGMSTREAM *vgmstream, int32_t start, int32_t end, sample_t **outputs, sample_t *audioBuffer, uint32_t bufferSize);
+    void warm_up_segment(VGMSTREAM *vgmstream, int32_t start, int32_t end, sample_t *history, sample_t *audioBuffer, uint32_t bufferSize);
+    int get_decode_segment_count(VGMSTREAM *inFileProperties, uint32_t samplesPadded);
+    bool write_segmented_audio_data(VGMSTREAM *inFileProperties, OutputFile *streamFiles, uint32_t samplesPadded, int numSegments);
+    const uint8_t *get_passthrough_data(VGMSTREAM *inFileProperties, off_t *dataOffset);
+    bool write_passthrough_audio_data(VGMSTREAM *inFileProperties, OutputFile *streamFiles, uint32_t samplesPadded, uint32_t bufferSize);
+    int write_audio_data(VGMSTREAM *inFileProperties, OutputFile *streamFiles);
+    void fill_vadpcm_samples(const uint8_t *pcmData, size_t pcmSamples, sample_t *samples);
+    size_t write_aifc_data(const sample_t *samples, int numThreads, uint8_t *aifcData);
+    int write_vadpcm_streams(OutputFile *pcmFiles, const std::vector<std::string> &filenames, uint16_t channelFlags);
     int write_streams(VGMSTREAM *inFileProperties, std::string newFilename, std::string oldFilename);
 };
 
-int generate_new_streams(VGMSTREAM *inFileProperties, std::string newFilename, std::string oldFilename, bool shouldGenerateFiles);
-void set_sample_rate(int64_t sampleRate);
-void set_resample_rate(int64_t resampleRate);
-void set_enable_loop(int64_t isLoopingEnabled);
-void set_loop_start_samples(int64_t samples);
-void set_loop_end_samples(int64_t samples);
-void set_loop_start_timestamp(std::string arg);
-void set_loop_end_timestamp(std::string arg);
+int generate_new_streams(ConversionJob *job, VGMSTREAM *inFileProperties, std::string newFilename, std::string oldFilename, bool shouldGenerateFiles);
+void set_sample_rate(ConversionJob *job, int64_t sampleRate);
+void set_resample_rates(ConversionJob *job, std::vector<int64_t> resampleRates);
+void set_auto_resample_rate(ConversionJob *job);
+void set_bandwidth_loss(ConversionJob *job, int64_t decibels);
+void set_channel_map(ConversionJob *job, std::string spec);
+void set_channel_mix(ConversionJob *job, std::string spec);
+void set_silence_threshold(ConversionJob *job, int64_t decibels);
+void set_auto_mono_tolerance(ConversionJob *job, int64_t decibels);
+void set_resampler(ConversionJob *job, std::string name);
+void set_resample_quality(ConversionJob *job, std::string name);
+void set_resample_group_size(ConversionJob *job, int64_t groupSize);
+void set_decode_threads(ConversionJob *job, int64_t threads);
+void set_loop_cache_limit(ConversionJob *job, int64_t megabytes);
+void set_enable_loop(ConversionJob *job, int64_t isLoopingEnabled);
+void set_loop_start_samples(ConversionJob *job, int64_t samples);
+void set_loop_end_samples(ConversionJob *job, int64_t samples);
+void set_loop_start_timestamp(ConversionJob *job, std::string arg);
+void set_loop_end_timestamp(ConversionJob *job, std::string arg);
+void set_start_samples(ConversionJob *job, int64_t samples);
+void set_start_timestamp(ConversionJob *job, std::string arg);
 std::string print_timestamp(uint64_t microseconds);
 int64_t samples_to_us(uint64_t sampleOffset, uint64_t sampleRate);
 int64_t timestamp_to_us(std::string dur);
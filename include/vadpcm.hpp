@@ -0,0 +1,35 @@
+#ifndef VADPCM_HPP
+#define VADPCM_HPP
+
+#include <stdint.h>
+
+#include "streamtypes.h"
+
+#define VADPCM_ORDER 2
+#define VADPCM_FRAME_SAMPLES 16
+#define VADPCM_FRAME_BYTES 9
+#define VADPCM_PREDICTORS_MAX 16
+#define VADPCM_PREDICTORS_DEFAULT 4
+#define VADPCM_SCALE_MAX 12
+#define VADPCM_LOOP_STATE_SIZE 16
+
+/**
+ * Predictor codebook of a VADPCM stream. book is what gets stored in the VADPCMCODES chunk;
+ * table is the same data expanded the way the decoder applies it to 8 samples at a time.
+ */
+struct VadpcmCodebook {
+	int numPredictors;
+	int16_t book[VADPCM_PREDICTORS_MAX][VADPCM_ORDER][8];
+	int32_t table[VADPCM_PREDICTORS_MAX][8][VADPCM_ORDER + 8];
+	float coefs[VADPCM_PREDICTORS_MAX * 2]; // (x[n-1], x[n-2]) pair of each predictor, used to pick a predictor per frame
+};
+
+// numSamples must be a multiple of VADPCM_FRAME_SAMPLES. Output only depends on the input, never on numThreads.
+void vadpcm_train_codebook(const sample_t *samples, uint32_t numSamples, int numPredictors, int numThreads, VadpcmCodebook *codebook);
+
+// Encodes numFrames frames into output (VADPCM_FRAME_BYTES each). If loopState is given, it receives the decoder state
+// right before frame loopStartFrame, which is what the decoder resumes from when jumping back to the loop start.
+void vadpcm_encode(const sample_t *samples, uint32_t numFrames, const VadpcmCodebook *codebook, uint8_t *output,
+ uint32_t loopStartFrame, int16_t *loopState);
+
+#endif
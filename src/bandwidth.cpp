@@ -0,0 +1,154 @@
+#include <math.h>
+#include <complex>
+#include <algorithm>
+
+#include "bandwidth.hpp"
+
+using namespace std;
+
+// 4-term Blackman-Harris window over length samples
+static double window_at(int i, int length) {
+	double x = 2.0 * M_PI * i / length;
+	return 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2.0 * x) - 0.01168 * cos(3.0 * x);
+}
+
+// In-place iterative radix-2 FFT. twiddles holds exp(-2 pi i k / size) for the first half of the circle.
+static void fft(complex<double> *data, const complex<double> *twiddles, int size) {
+	for (int i = 1, j = 0; i < size; i++) {
+		int bit = size >> 1;
+		for (; j & bit; bit >>= 1)
+			j ^= bit;
+		j ^= bit;
+
+		if (i < j)
+			swap(data[i], data[j]);
+	}
+
+	for (int length = 2; length <= size; length <<= 1) {
+		int half = length / 2;
+		int step = size / length;
+
+		for (int i = 0; i < size; i += length) {
+			for (int k = 0; k < half; k++) {
+				complex<double> t = data[i + k + half] * twiddles[k * step];
+				data[i + k + half] = data[i + k] - t;
+				data[i + k] += t;
+			}
+		}
+	}
+}
+
+/**
+ * Every block of BANDWIDTH_FFT_SIZE frames gets a Blackman-Harris window and a power spectrum, which is summed up per channel over the whole stream.
+ * That window leaks less than -90 dB into far away bins, so strong low tones don't smear into the bandwidth of a channel.
+ * Two channels are transformed at once as the real and imaginary part of one complex signal, and separated again afterwards.
+ */
+bool measure_channel_bandwidths(VGMSTREAM *vgmstream, const ChannelMix *mix, int32_t numSamples, double lossDb, vector<double> *bandwidths, ConversionStats *stats) {
+	const int size = BANDWIDTH_FFT_SIZE;
+	const int bins = size / 2 + 1;
+	int channels = (mix->outputChannels > 0 ? mix->outputChannels : vgmstream->channels);
+
+	sample_t *audioBuffer = new (nothrow) sample_t[(size_t) size * channels];
+	complex<double> *data = new (nothrow) complex<double>[size];
+	complex<double> *twiddles = new (nothrow) complex<double>[size / 2];
+	double *window = new (nothrow) double[size];
+	double *power = new (nothrow) double[(size_t) bins * channels];
+
+	if (audioBuffer == nullptr || data == nullptr || twiddles == nullptr || window == nullptr || power == nullptr) {
+		delete[] audioBuffer;
+		delete[] data;
+		delete[] twiddles;
+		delete[] window;
+		delete[] power;
+		return false;
+	}
+	stats_count_allocation(stats, (size_t) size * channels * sizeof(sample_t) + (size_t) bins * channels * sizeof(double));
+
+	for (int i = 0; i < size / 2; i++)
+		twiddles[i] = polar(1.0, -2.0 * M_PI * i / size);
+	for (int i = 0; i < size; i++)
+		window[i] = window_at(i, size);
+	fill(power, power + (size_t) bins * channels, 0.0);
+
+	for (int32_t position = 0; position < numSamples; position += size) {
+		int frames = (int) min((int32_t) size, numSamples - position);
+
+		{
+			StatsTimer timer(stats, STATS_STAGE_DECODE);
+			render_mixed_vgmstream(audioBuffer, frames, vgmstream, mix);
+			stats_add(stats, &stats->samplesDecoded, (uint64_t) frames * channels);
+		}
+
+		StatsTimer timer(stats, STATS_STAGE_ANALYZE);
+
+		// The last block is windowed over what's left of the stream, rather than cut off in the middle of the window
+		if (frames < size) {
+			for (int i = 0; i < frames; i++)
+				window[i] = window_at(i, frames);
+		}
+
+		for (int c = 0; c < channels; c += 2) {
+			bool paired = (c + 1 < channels);
+
+			for (int i = 0; i < size; i++) {
+				double re = (i < frames ? audioBuffer[(size_t) i * channels + c] * window[i] : 0.0);
+				double im = (i < frames && paired ? audioBuffer[(size_t) i * channels + c + 1] * window[i] : 0.0);
+				data[i] = complex<double>(re, im);
+			}
+
+			fft(data, twiddles, size);
+
+			// X[k] = (Z[k] + conj(Z[N - k])) / 2 and Y[k] = (Z[k] - conj(Z[N - k])) / 2i, of which only the magnitude is needed
+			for (int k = 0; k < bins; k++) {
+				complex<double> a = data[k];
+				complex<double> b = conj(data[(size - k) % size]);
+
+				power[(size_t) c * bins + k] += norm(a + b) / 4.0;
+				if (paired)
+					power[(size_t) (c + 1) * bins + k] += norm(a - b) / 4.0;
+			}
+		}
+	}
+
+	reset_vgmstream(vgmstream);
+
+	bandwidths->assign((size_t) channels, 0.0);
+	for (int c = 0; c < channels; c++) {
+		const double *spectrum = &power[(size_t) c * bins];
+		double total = 0.0;
+		for (int k = 0; k < bins; k++)
+			total += spectrum[k];
+
+		if (total <= 0.0)
+			continue; // Silent, any rate will do
+
+		// Cut off as many of the highest bins as the allowed loss covers
+		double allowed = total * pow(10.0, -lossDb / 10.0);
+		double removed = 0.0;
+		int k = bins - 1;
+		while (k > 0 && removed + spectrum[k] <= allowed) {
+			removed += spectrum[k];
+			k--;
+		}
+
+		(*bandwidths)[c] = min(1.0, (double) (k + 1) / (size / 2));
+	}
+
+	delete[] audioBuffer;
+	delete[] data;
+	delete[] twiddles;
+	delete[] window;
+	delete[] power;
+
+	return true;
+}
+
+int32_t choose_resample_rate(double bandwidth, int32_t sampleRate) {
+	// A bandwidth relative to Nyquist needs bandwidth * sampleRate Hz of sample rate to be kept, plus headroom for the filter
+	double needed = bandwidth * (double) sampleRate / AUTO_RATE_HEADROOM;
+	int64_t rate = (int64_t) ceil(needed / AUTO_RATE_STEP) * AUTO_RATE_STEP;
+
+	rate = max(rate, (int64_t) AUTO_RATE_MIN);
+	rate = min(rate, (int64_t) AUTO_RATE_MAX);
+	return (int32_t) min(rate, (int64_t) sampleRate);
+}
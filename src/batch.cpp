@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "main.hpp"
+#include "job.hpp"
+#include "batch.hpp"
+#include "input.hpp"
+
+using namespace std;
+
+static mutex gOutputNameLock;
+static set<string> gOutputNames;
+
+bool is_batch_argument(string arg) {
+	return arg.compare("-b") == 0 || arg.compare("-B") == 0;
+}
+
+// Output names are claimed by jobs as they start, so two jobs in the same batch can never overwrite each other's files.
+bool batch_claim_output_name(string filename) {
+	lock_guard<mutex> lock(gOutputNameLock);
+	return gOutputNames.insert(filename).second;
+}
+
+// Simple wildcard matching supporting '*' and '?'
+static bool match_wildcard(const char *pattern, const char *str) {
+	if (*pattern == '\0')
+		return *str == '\0';
+
+	if (*pattern == '*') {
+		for (; *str != '\0'; str++)
+			if (match_wildcard(pattern + 1, str))
+				return true;
+		return match_wildcard(pattern + 1, str);
+	}
+
+	if (*str == '\0')
+		return false;
+	if (*pattern != '?' && *pattern != *str)
+		return false;
+
+	return match_wildcard(pattern + 1, str + 1);
+}
+
+// Expands wildcards in the filename portion of a path. Directories are matched literally.
+vector<string> expand_input_glob(string pattern) {
+	vector<string> matches;
+
+	size_t slash = pattern.find_last_of("/\\");
+	string dir = (slash == string::npos) ? "" : pattern.substr(0, slash + 1);
+	string filePattern = (slash == string::npos) ? pattern : pattern.substr(slash + 1);
+
+	if (filePattern.find_first_of("*?") == string::npos) {
+		matches.push_back(pattern);
+		return matches;
+	}
+
+	error_code ec;
+	for (const auto &entry : filesystem::directory_iterator(dir.empty() ? "." : dir, ec)) {
+		if (!entry.is_regular_file(ec))
+			continue;
+
+		string name = entry.path().filename().string();
+		if (match_wildcard(filePattern.c_str(), name.c_str()))
+			matches.push_back(dir + name);
+	}
+
+	sort(matches.begin(), matches.end());
+
+	return matches;
+}
+
+// Splits a job file line into arguments, honoring double quotes
+static vector<string> tokenize_job_line(string line) {
+	vector<string> tokens;
+	string token = "";
+	bool inQuotes = false;
+	bool hasToken = false;
+
+	for (size_t i = 0; i < line.length(); i++) {
+		char c = line[i];
+
+		if (c == '"') {
+			inQuotes = !inQuotes;
+			hasToken = true;
+		} else if (!inQuotes && (c == ' ' || c == '\t' || c == '\r' || c == '\n')) {
+			if (hasToken)
+				tokens.push_back(token);
+			token = "";
+			hasToken = false;
+		} else {
+			token += c;
+			hasToken = true;
+		}
+	}
+
+	if (hasToken)
+		tokens.push_back(token);
+
+	return tokens;
+}
+
+/**
+ * Job files list one conversion per line: an input file (or glob) followed by its own optional arguments.
+ * Blank lines and lines starting with '#' are ignored. Per-job arguments are applied after the shared command line arguments.
+ */
+static int parse_job_file(string jobFilename, vector<BatchJob> &jobs) {
+	FILE *jobFile = fopen(jobFilename.c_str(), "rb");
+	if (jobFile == NULL) {
+		printf("ERROR: Could not open job file %s for reading!\n", jobFilename.c_str());
+		return RETURN_BATCH_CANNOT_OPEN_JOB_FILE;
+	}
+
+	string line = "";
+	int c;
+	while (true) {
+		c = fgetc(jobFile);
+		if (c != '\n' && c != EOF) {
+			line += (char) c;
+			continue;
+		}
+
+		vector<string> tokens = tokenize_job_line(line);
+		line = "";
+
+		if (!tokens.empty() && tokens[0][0] != '#') {
+			vector<string> inputs = expand_input_glob(tokens[0]);
+			if (inputs.empty())
+				printf("WARNING: No files match \"%s\" in job file, skipping...\n", tokens[0].c_str());
+
+			for (size_t i = 0; i < inputs.size(); i++) {
+				BatchJob job;
+				job.inFilename = inputs[i];
+				job.args.assign(tokens.begin() + 1, tokens.end());
+				jobs.push_back(job);
+			}
+		}
+
+		if (c == EOF)
+			break;
+	}
+
+	fclose(jobFile);
+
+	return RETURN_SUCCESS;
+}
+
+int run_batch(vector<string> args) {
+	vector<BatchJob> jobs;
+	vector<string> sharedArgs;
+	int64_t threadCount = (int64_t) thread::hardware_concurrency();
+
+	for (size_t i = 0; i < args.size(); i++) {
+		string arg = args.at(i);
+
+		if (!is_batch_argument(arg) && arg.compare("-j") != 0) {
+			sharedArgs.push_back(arg); // Forwarded to every job
+			continue;
+		}
+
+		i++;
+		if (i == args.size())
+			return RETURN_INVALID_ARGS;
+
+		if (arg.compare("-b") == 0) {
+			vector<string> inputs = expand_input_glob(args.at(i));
+			if (inputs.empty())
+				printf("WARNING: No files match \"%s\", skipping...\n", args.at(i).c_str());
+
+			for (size_t j = 0; j < inputs.size(); j++) {
+				BatchJob job;
+				job.inFilename = inputs[j];
+				jobs.push_back(job);
+			}
+		} else if (arg.compare("-B") == 0) {
+			int ret = parse_job_file(args.at(i), jobs);
+			if (ret)
+				return ret;
+		} else {
+			threadCount = strtoll(args.at(i).c_str(), NULL, 10);
+			if (threadCount <= 0) {
+				print_param_warning(NULL, "worker thread count");
+				threadCount = (int64_t) thread::hardware_concurrency();
+			}
+		}
+	}
+
+	if (jobs.empty()) {
+		printf("ERROR: No input files to convert!\n");
+		return RETURN_BATCH_NO_JOBS;
+	}
+
+	if (threadCount <= 0)
+		threadCount = 1;
+	if ((size_t) threadCount > jobs.size())
+		threadCount = (int64_t) jobs.size();
+
+	printf("Converting %d file(s) using %d worker thread(s)...\n\n", (int) jobs.size(), (int) threadCount);
+
+	gOutputNames.clear();
+
+	vector<int> results(jobs.size(), RETURN_SUCCESS);
+	atomic<size_t> nextJob(0);
+
+	// Each worker pulls the next pending job until none are left. Each job carries its own ConversionJob, so jobs never share parameters.
+	auto worker = [&]() {
+		while (true) {
+			size_t index = nextJob++;
+			if (index >= jobs.size())
+				break;
+
+			vector<string> jobArgs = sharedArgs;
+			jobArgs.insert(jobArgs.end(), jobs[index].args.begin(), jobs[index].args.end());
+
+			// Printed in one piece once done, rather than mixed up with the other workers' output
+			string log;
+			results[index] = convert_file(jobs[index].inFilename, jobArgs, true, 0, &log);
+			log_printf(NULL, "%s", log.c_str());
+		}
+	};
+
+	vector<thread> workers;
+	for (int64_t i = 0; i < threadCount; i++)
+		workers.emplace_back(worker);
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+
+	int failedJobs = 0;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		if (results[i] == RETURN_SUCCESS)
+			continue;
+
+		if (failedJobs == 0)
+			printf("\n");
+		printf("FAILED: %s (error code %d)\n", jobs[i].inFilename.c_str(), results[i]);
+		failedJobs++;
+	}
+
+	printf("\nBatch complete: %d succeeded, %d failed\n", (int) jobs.size() - failedJobs, failedJobs);
+
+	if (failedJobs > 0)
+		return RETURN_BATCH_JOB_FAILED;
+
+	return RETURN_SUCCESS;
+}
+
+/**
+ * Converts every subsong of a multi-stream container as its own job, named after the output filename with the subsong number appended.
+ * The container stays open until all subsongs are done, so they all read from the same mapping of it.
+ * Within a batch, subsongs are converted one after another since the batch already keeps every worker busy.
+ * Each subsong's output is printed in one piece once it's done, or appended to log if set.
+ */
+int run_subsongs(string inFilename, vector<string> args, string outFilename, bool isBatchJob, string *log) {
+	ConversionStats containerStats;
+	VGMSTREAM *container = open_input_vgmstream(inFilename, &containerStats, 1);
+	int numSubsongs = (container != NULL ? container->num_streams : 0);
+
+	// Also reports the error if the file couldn't be opened
+	if (numSubsongs <= 1) {
+		if (container != NULL)
+			close_vgmstream(container);
+		return convert_file(inFilename, args, isBatchJob, 1, log);
+	}
+
+	int digits = (int) to_string(numSubsongs).length();
+	int64_t threadCount = (isBatchJob ? 1 : (int64_t) thread::hardware_concurrency());
+	if (threadCount <= 0)
+		threadCount = 1;
+	if (threadCount > numSubsongs)
+		threadCount = numSubsongs;
+
+	log_printf(log, "Converting %d subsongs of %s using %d worker thread(s)...\n\n", numSubsongs, inFilename.c_str(), (int) threadCount);
+
+	vector<int> results(numSubsongs, RETURN_SUCCESS);
+	atomic<int> nextSubsong(0);
+
+	auto worker = [&]() {
+		while (true) {
+			int index = nextSubsong++;
+			if (index >= numSubsongs)
+				break;
+
+			char suffix[16];
+			snprintf(suffix, sizeof(suffix), "_%0*d", digits, index + 1);
+
+			vector<string> subsongArgs = args;
+			subsongArgs.push_back("-o");
+			subsongArgs.push_back(outFilename + suffix);
+
+			string subsongLog;
+			results[index] = convert_file(inFilename, subsongArgs, true, index + 1, &subsongLog);
+			log_printf(log, "%s", subsongLog.c_str());
+		}
+	};
+
+	vector<thread> workers;
+	for (int64_t i = 0; i < threadCount; i++)
+		workers.emplace_back(worker);
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+
+	close_vgmstream(container);
+
+	int failedSubsongs = 0;
+	for (int i = 0; i < numSubsongs; i++) {
+		if (results[i] == RETURN_SUCCESS)
+			continue;
+
+		if (failedSubsongs == 0)
+			log_printf(log, "\n");
+		log_printf(log, "FAILED: %s#%d (error code %d)\n", inFilename.c_str(), i + 1, results[i]);
+		failedSubsongs++;
+	}
+
+	log_printf(log, "\nSubsongs complete: %d succeeded, %d failed\n", numSubsongs - failedSubsongs, failedSubsongs);
+
+	if (failedSubsongs > 0)
+		return RETURN_BATCH_JOB_FAILED;
+
+	return RETURN_SUCCESS;
+}
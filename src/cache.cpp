@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "main.hpp"
+#include "job.hpp"
+#include "cache.hpp"
+#include "input.hpp"
+
+using namespace std;
+
+#define HASH_PRIME_1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME_2 0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME_3 0x165667B19E3779F9ULL
+#define HASH_PRIME_4 0x85EBCA77C2B2AE63ULL
+#define HASH_PRIME_5 0x27D4EB2F165667C5ULL
+
+#define HASH_FILE_BUFFER_SIZE 0x100000
+
+#define MANIFEST_HEADER "STRM64 build cache"
+
+static inline uint64_t rotl64(uint64_t value, int bits) {
+	return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t read64(const uint8_t *data) {
+	uint64_t value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t input) {
+	acc += input * HASH_PRIME_2;
+	acc = rotl64(acc, 31);
+	return acc * HASH_PRIME_1;
+}
+
+static inline uint64_t hash_merge(uint64_t acc, uint64_t lane) {
+	acc ^= hash_round(0, lane);
+	return acc * HASH_PRIME_1 + HASH_PRIME_4;
+}
+
+/**
+ * 64-bit non-cryptographic hash following the XXH64 algorithm. Only used to detect changed inputs and outputs,
+ * so it only has to be fast and well distributed. Byte order is assumed little-endian, like every supported platform.
+ */
+uint64_t hash_data(const void *data, size_t length, uint64_t seed) {
+	const uint8_t *p = (const uint8_t*) data;
+	const uint8_t *end = p + length;
+	uint64_t hash;
+
+	if (length >= 32) {
+		uint64_t v1 = seed + HASH_PRIME_1 + HASH_PRIME_2;
+		uint64_t v2 = seed + HASH_PRIME_2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - HASH_PRIME_1;
+
+		for (; p + 32 <= end; p += 32) {
+			v1 = hash_round(v1, read64(p));
+			v2 = hash_round(v2, read64(p + 8));
+			v3 = hash_round(v3, read64(p + 16));
+			v4 = hash_round(v4, read64(p + 24));
+		}
+
+		hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		hash = hash_merge(hash, v1);
+		hash = hash_merge(hash, v2);
+		hash = hash_merge(hash, v3);
+		hash = hash_merge(hash, v4);
+	} else {
+		hash = seed + HASH_PRIME_5;
+	}
+
+	hash += (uint64_t) length;
+
+	for (; p + 8 <= end; p += 8) {
+		hash ^= hash_round(0, read64(p));
+		hash = rotl64(hash, 27) * HASH_PRIME_1 + HASH_PRIME_4;
+	}
+
+	if (p + 4 <= end) {
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		hash ^= (uint64_t) value * HASH_PRIME_1;
+		hash = rotl64(hash, 23) * HASH_PRIME_2 + HASH_PRIME_3;
+		p += 4;
+	}
+
+	for (; p < end; p++) {
+		hash ^= (*p) * HASH_PRIME_5;
+		hash = rotl64(hash, 11) * HASH_PRIME_1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= HASH_PRIME_2;
+	hash ^= hash >> 29;
+	hash *= HASH_PRIME_3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
+
+// Hashes a whole file in large chunks, chaining each chunk's hash into the next
+bool hash_file(string filename, uint64_t *hash, uint64_t *size) {
+	FILE *file = fopen(filename.c_str(), "rb");
+	if (file == NULL)
+		return false;
+
+	uint8_t *buffer = new (nothrow) uint8_t[HASH_FILE_BUFFER_SIZE];
+	if (buffer == nullptr) {
+		fclose(file);
+		return false;
+	}
+
+	*hash = 0;
+	*size = 0;
+
+	size_t bytesRead;
+	while ((bytesRead = fread(buffer, 1, HASH_FILE_BUFFER_SIZE, file)) > 0) {
+		*hash = hash_data(buffer, bytesRead, *hash);
+		*size += bytesRead;
+	}
+
+	bool success = (ferror(file) == 0);
+
+	delete[] buffer;
+	fclose(file);
+
+	return success;
+}
+
+static string hash_to_string(uint64_t hash) {
+	char buffer[17];
+	snprintf(buffer, sizeof(buffer), "%016" PRIx64, hash);
+	return string(buffer);
+}
+
+static string get_manifest_filename(ConversionJob *job) {
+	return job->outFilename + BUILD_CACHE_EXTENSION;
+}
+
+/**
+ * Builds the cache key for a job, or returns an empty string if the input can't be read.
+ * Every resolved stream property (loop points, rates, channel count, length) is derived only from the input file and
+ * the override parameters, so hashing those along with the STRM64 version covers everything that affects the output.
+ * Appended inputs are part of the source audio, so their contents go into the key as well.
+ */
+string build_cache_key(ConversionJob *job) {
+	uint64_t inputHash, inputSize;
+	// Standard input can only be read once, and has nothing to compare against next time anyway
+	if (is_stdin_input(job->inFilename) || !hash_file(job->inFilename, &inputHash, &inputSize))
+		return "";
+
+	char params[1024];
+	snprintf(params, sizeof(params),
+	 "version=%s;size=%" PRIu64 ";rate=%" PRId64 ";resample=%" PRId64 ";loop=%" PRId64 ";loopstart=%" PRId64 ";loopend=%" PRId64
+	 ";loopstartus=%" PRId64 ";loopendus=%" PRId64 ";mono=%d;channels=%d;mutescale=%d;volume=%d;streams=%d;sequence=%d;soundbank=%d;vadpcm=%d;subsong=%d;resampler=%d;quality=%d;autorate=%d;bandwidthloss=%.3f;silence=%d;automono=%.3f;start=%" PRId64 ";startus=%" PRId64 ";",
+	 STRM64_VERSION, inputSize, job->ovrdSampleRate, job->ovrdResampleRate, job->ovrdEnableLoop, job->ovrdLoopStartSamples,
+	 job->ovrdLoopEndSamples, job->ovrdLoopStartMicro, job->ovrdLoopEndMicro, (int) job->forcedMono, (int) job->seqNumChannels,
+	 (int) job->muteScale, (int) job->masterVolume, (int) job->generateStreams, (int) job->generateSequence, (int) job->generateSoundbank,
+	 (int) job->encodeVadpcm, job->subsong, (int) job->resamplerEngine, (int) job->resampleQuality,
+	 (int) job->autoResampleRate, job->bandwidthLoss, (int) job->silenceThreshold, job->autoMonoTolerance, job->ovrdStartSamples, job->ovrdStartMicro);
+
+	string keyData = string(params) + "mix=" + job->channelMix.spec + ";out=" + job->outFilename;
+	for (size_t i = 0; i < job->appendFilenames.size(); i++) {
+		uint64_t partHash, partSize;
+		if (!hash_file(job->appendFilenames[i], &partHash, &partSize))
+			return "";
+
+		keyData += ";append=" + hash_to_string(partHash) + ":" + to_string(partSize);
+	}
+	uint64_t paramsHash = hash_data(keyData.c_str(), keyData.length(), 0);
+
+	return hash_to_string(inputHash) + hash_to_string(paramsHash);
+}
+
+// Checks whether the manifest next to the outputs matches the key, with every recorded output still present and unmodified.
+bool build_cache_is_fresh(ConversionJob *job, string key) {
+	FILE *manifest = fopen(get_manifest_filename(job).c_str(), "rb");
+	if (manifest == NULL)
+		return false;
+
+	char line[4096];
+	bool fresh = false;
+
+	if (fgets(line, sizeof(line), manifest) == NULL || strncmp(line, MANIFEST_HEADER, strlen(MANIFEST_HEADER)) != 0) {
+		fclose(manifest);
+		return false;
+	}
+
+	if (fgets(line, sizeof(line), manifest) != NULL && string(line) == "key " + key + "\n") {
+		fresh = true;
+
+		while (fresh && fgets(line, sizeof(line), manifest) != NULL) {
+			uint64_t expectedSize, expectedHash;
+			int filenameOffset = 0;
+
+			if (sscanf(line, "file %" SCNu64 " %" SCNx64 " %n", &expectedSize, &expectedHash, &filenameOffset) != 2 || filenameOffset == 0) {
+				fresh = false;
+				break;
+			}
+
+			string filename = string(line + filenameOffset);
+			if (!filename.empty() && filename[filename.length() - 1] == '\n')
+				filename.erase(filename.length() - 1);
+
+			uint64_t hash, size;
+			if (!hash_file(filename, &hash, &size) || size != expectedSize || hash != expectedHash)
+				fresh = false;
+		}
+	}
+
+	fclose(manifest);
+	return fresh;
+}
+
+void build_cache_write_manifest(ConversionJob *job, string key) {
+	string manifestFilename = get_manifest_filename(job);
+	FILE *manifest = fopen(manifestFilename.c_str(), "wb");
+	if (manifest == NULL) {
+		job_printf(job, "WARNING: Could not write build cache manifest %s!\n", manifestFilename.c_str());
+		return;
+	}
+
+	fprintf(manifest, "%s\n", MANIFEST_HEADER);
+	fprintf(manifest, "key %s\n", key.c_str());
+
+	for (size_t i = 0; i < job->outputFiles.size(); i++) {
+		uint64_t hash, size;
+		if (!hash_file(job->outputFiles[i], &hash, &size)) {
+			fclose(manifest);
+			remove(manifestFilename.c_str()); // A partial manifest would make missing outputs look fresh
+			return;
+		}
+
+		fprintf(manifest, "file %" PRIu64 " %016" PRIx64 " %s\n", size, hash, job->outputFiles[i].c_str());
+	}
+
+	fclose(manifest);
+}
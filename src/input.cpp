@@ -0,0 +1,649 @@
+#include <stdio.h>
+#include <string.h>
+#include <new>
+#include <future>
+#include <mutex>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "input.hpp"
+
+extern "C" {
+#include "layout/layout.h"
+}
+
+#ifdef INPUT_POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+using namespace std;
+
+// Everything read from a pipe so far. Shared by every STREAMFILE opened on it, since a pipe can only be read once.
+struct PipeBuffer {
+	vector<uint8_t*> chunks; // INPUT_PIPE_CHUNK_SIZE bytes each, except for the last one
+	size_t size;
+	string path; // As given on the command line
+	string name; // As reported to vgmstream, which needs an extension to detect the format
+	int refs;
+};
+
+struct PipeStreamFile {
+	STREAMFILE sf;
+	PipeBuffer *pipe;
+	ConversionStats *stats;
+	off_t lastOffset;
+	uint64_t requests;
+	uint64_t bytesRead;
+};
+
+static mutex gPipeLock;
+static vector<PipeBuffer*> gPipes;
+
+bool is_stdin_input(string filename) {
+	return filename.compare(INPUT_STDIN_NAME) == 0;
+}
+
+static const char *get_pipe_extension(const uint8_t *data, size_t size) {
+	if (size >= 4 && (memcmp(data, "RIFF", 4) == 0 || memcmp(data, "RIFX", 4) == 0))
+		return ".wav";
+	if (size >= 12 && memcmp(data, "FORM", 4) == 0 && memcmp(data + 8, "AIFC", 4) == 0)
+		return ".aifc";
+	if (size >= 12 && memcmp(data, "FORM", 4) == 0 && memcmp(data + 8, "AIFF", 4) == 0)
+		return ".aiff";
+	if (size >= 4 && memcmp(data, "OggS", 4) == 0)
+		return ".ogg";
+	if (size >= 4 && memcmp(data, "fLaC", 4) == 0)
+		return ".flac";
+	if (size >= 4 && memcmp(data, "caff", 4) == 0)
+		return ".caf";
+	if (size >= 4 && memcmp(data, "RSTM", 4) == 0)
+		return ".brstm";
+	if ((size >= 3 && memcmp(data, "ID3", 3) == 0) || (size >= 2 && data[0] == 0xFF && (data[1] & 0xE0) == 0xE0))
+		return ".mp3";
+	return "";
+}
+
+// Reads the whole pipe into memory. vgmstream needs the size of the input before it can parse the header of most formats.
+static PipeBuffer *load_pipe(FILE *file, string path, ConversionStats *stats) {
+	PipeBuffer *pipe = new (nothrow) PipeBuffer();
+	if (pipe == nullptr)
+		return NULL;
+
+	uint64_t reads = 0;
+	bool failed = false;
+
+	while (!failed) {
+		uint8_t *chunk = new (nothrow) uint8_t[INPUT_PIPE_CHUNK_SIZE];
+		if (chunk == nullptr) {
+			failed = true;
+			break;
+		}
+		pipe->chunks.push_back(chunk);
+
+		size_t length = 0;
+		while (length < INPUT_PIPE_CHUNK_SIZE) {
+			size_t ret = fread(chunk + length, 1, INPUT_PIPE_CHUNK_SIZE - length, file);
+			reads++;
+			if (ret == 0)
+				break;
+			length += ret;
+		}
+
+		pipe->size += length;
+		if (length < INPUT_PIPE_CHUNK_SIZE) {
+			failed = (ferror(file) != 0);
+			break;
+		}
+	}
+
+	stats_add(stats, &stats->inputReads, reads);
+
+	if (failed || pipe->size == 0) {
+		for (size_t i = 0; i < pipe->chunks.size(); i++)
+			delete[] pipe->chunks[i];
+		delete pipe;
+		return NULL;
+	}
+
+	uint8_t header[12];
+	size_t headerSize = min(pipe->size, sizeof(header));
+	memcpy(header, pipe->chunks[0], headerSize);
+
+	pipe->path = path;
+	pipe->name = (is_stdin_input(path) ? string("stdin") : path);
+
+	size_t dot = pipe->name.find_last_of('.');
+	size_t slash = pipe->name.find_last_of("/\\");
+	if (dot == string::npos || (slash != string::npos && dot < slash))
+		pipe->name += get_pipe_extension(header, headerSize);
+
+	return pipe;
+}
+
+// Must be called with gPipeLock held
+static PipeBuffer *find_pipe(const char *filename) {
+	for (size_t i = 0; i < gPipes.size(); i++) {
+		if (gPipes[i]->path.compare(filename) == 0 || gPipes[i]->name.compare(filename) == 0)
+			return gPipes[i];
+	}
+
+	return NULL;
+}
+
+static size_t pipe_read(STREAMFILE *sf, uint8_t *dst, off_t offset, size_t length) {
+	PipeStreamFile *input = (PipeStreamFile*) sf;
+	PipeBuffer *pipe = input->pipe;
+	input->requests++;
+
+	if (offset < 0 || (size_t) offset >= pipe->size)
+		return 0;
+	if (length > pipe->size - (size_t) offset)
+		length = pipe->size - (size_t) offset;
+
+	size_t done = 0;
+	while (done < length) {
+		size_t position = (size_t) offset + done;
+		size_t chunkOffset = position % INPUT_PIPE_CHUNK_SIZE;
+		size_t count = min(INPUT_PIPE_CHUNK_SIZE - chunkOffset, length - done);
+		memcpy(dst + done, pipe->chunks[position / INPUT_PIPE_CHUNK_SIZE] + chunkOffset, count);
+		done += count;
+	}
+
+	input->lastOffset = offset + (off_t) length;
+	input->bytesRead += length;
+	return length;
+}
+
+static size_t pipe_get_size(STREAMFILE *sf) {
+	return ((PipeStreamFile*) sf)->pipe->size;
+}
+
+static off_t pipe_get_offset(STREAMFILE *sf) {
+	return ((PipeStreamFile*) sf)->lastOffset;
+}
+
+static void pipe_get_name(STREAMFILE *sf, char *name, size_t length) {
+	if (length == 0)
+		return;
+
+	strncpy(name, ((PipeStreamFile*) sf)->pipe->name.c_str(), length - 1);
+	name[length - 1] = '\0';
+}
+
+static STREAMFILE *pipe_open(STREAMFILE *sf, const char *const filename, size_t bufferSize) {
+	(void) bufferSize;
+	return open_input_streamfile(filename, ((PipeStreamFile*) sf)->stats, sf->stream_index);
+}
+
+static void pipe_close(STREAMFILE *sf) {
+	PipeStreamFile *input = (PipeStreamFile*) sf;
+	PipeBuffer *pipe = input->pipe;
+
+	stats_add(input->stats, &input->stats->inputRequests, input->requests);
+	stats_add(input->stats, &input->stats->inputBytes, input->bytesRead);
+	delete input;
+
+	lock_guard<mutex> lock(gPipeLock);
+	if (--pipe->refs > 0)
+		return;
+
+	for (size_t i = 0; i < gPipes.size(); i++) {
+		if (gPipes[i] == pipe) {
+			gPipes.erase(gPipes.begin() + i);
+			break;
+		}
+	}
+
+	for (size_t i = 0; i < pipe->chunks.size(); i++)
+		delete[] pipe->chunks[i];
+	delete pipe;
+}
+
+// Must be called with gPipeLock held
+static STREAMFILE *open_pipe_view(PipeBuffer *pipe, ConversionStats *stats) {
+	PipeStreamFile *input = new (nothrow) PipeStreamFile();
+	if (input == nullptr)
+		return NULL;
+
+	input->pipe = pipe;
+	input->stats = stats;
+	pipe->refs++;
+
+	input->sf.read = pipe_read;
+	input->sf.get_size = pipe_get_size;
+	input->sf.get_offset = pipe_get_offset;
+	input->sf.get_name = pipe_get_name;
+	input->sf.open = pipe_open;
+	input->sf.close = pipe_close;
+
+	return &input->sf;
+}
+
+// Takes ownership of file
+static STREAMFILE *open_pipe_streamfile(FILE *file, const char *filename, ConversionStats *stats) {
+	PipeBuffer *pipe = load_pipe(file, filename, stats);
+	if (file != stdin)
+		fclose(file);
+	if (pipe == NULL)
+		return NULL;
+
+	lock_guard<mutex> lock(gPipeLock);
+	gPipes.push_back(pipe);
+
+	STREAMFILE *sf = open_pipe_view(pipe, stats);
+	if (sf == NULL) {
+		gPipes.pop_back();
+		for (size_t i = 0; i < pipe->chunks.size(); i++)
+			delete[] pipe->chunks[i];
+		delete pipe;
+	}
+
+	return sf;
+}
+
+#ifdef INPUT_POSIX
+// One mapping per file, no matter how many times it's opened. Subsongs of a bank converted at once all read from the same one.
+struct SharedMapping {
+	dev_t device;
+	ino_t inode;
+	size_t size;
+	const uint8_t *data;
+	int refs;
+};
+
+static mutex gMappingLock;
+static vector<SharedMapping*> gMappings;
+
+struct ReadAheadWindow {
+	uint8_t *data;
+	off_t offset;
+	size_t length;
+};
+
+// vgmstream only ever sees the STREAMFILE at the start, and hands it back to the callbacks below
+struct InputStreamFile {
+	STREAMFILE sf;
+	char *name;
+	ConversionStats *stats;
+	int fd;
+	size_t size;
+	off_t lastOffset;
+
+	SharedMapping *mapping; // NULL if reading through the windows instead
+
+	ReadAheadWindow windows[2];
+	int currentWindow;
+	future<pair<size_t, uint64_t>> *pendingRead; // Background read into the other window (bytes and reads), if any
+	off_t pendingOffset;
+
+	// Counted locally since vgmstream reads a few bytes at a time, and only added to stats once the file is closed
+	uint64_t requests;
+	uint64_t reads;
+	uint64_t bytesRead;
+};
+
+static size_t read_fully(int fd, uint8_t *dst, off_t offset, size_t length, uint64_t *reads) {
+	size_t done = 0;
+
+	while (done < length) {
+		ssize_t ret = pread(fd, dst + done, length - done, offset + (off_t) done);
+		(*reads)++;
+		if (ret <= 0)
+			break;
+		done += (size_t) ret;
+	}
+
+	return done;
+}
+
+static size_t read_window(int fd, ReadAheadWindow *window, off_t offset, uint64_t *reads) {
+	window->offset = offset;
+	window->length = read_fully(fd, window->data, offset, INPUT_READ_AHEAD_SIZE, reads);
+	return window->length;
+}
+
+// Reads the window after the current one in the background. Nothing else touches that window until finish_read_ahead.
+static void start_read_ahead(InputStreamFile *input) {
+	ReadAheadWindow *current = &input->windows[input->currentWindow];
+	off_t nextOffset = current->offset + (off_t) current->length;
+	if (current->length == 0 || (size_t) nextOffset >= input->size)
+		return;
+
+	ReadAheadWindow *next = &input->windows[input->currentWindow ^ 1];
+	int fd = input->fd;
+
+	input->pendingOffset = nextOffset;
+	input->pendingRead = new (nothrow) future<pair<size_t, uint64_t>>(async(launch::async, [fd, next, nextOffset]() {
+		uint64_t reads = 0;
+		size_t length = read_window(fd, next, nextOffset, &reads);
+		return make_pair(length, reads);
+	}));
+}
+
+static void finish_read_ahead(InputStreamFile *input) {
+	if (input->pendingRead == NULL)
+		return;
+
+	pair<size_t, uint64_t> result = input->pendingRead->get();
+	input->bytesRead += result.first;
+	input->reads += result.second;
+	delete input->pendingRead;
+	input->pendingRead = NULL;
+}
+
+// Makes the window holding offset the current one, reading it if neither window has it
+static bool load_window(InputStreamFile *input, off_t offset) {
+	if (input->pendingRead != NULL) {
+		off_t pendingOffset = input->pendingOffset;
+		finish_read_ahead(input);
+
+		ReadAheadWindow *next = &input->windows[input->currentWindow ^ 1];
+		if (offset >= pendingOffset && offset < pendingOffset + (off_t) next->length) {
+			input->currentWindow ^= 1;
+			start_read_ahead(input);
+			return true;
+		}
+	}
+
+	ReadAheadWindow *current = &input->windows[input->currentWindow];
+	input->bytesRead += read_window(input->fd, current, offset, &input->reads);
+	if (current->length == 0)
+		return false;
+
+	start_read_ahead(input);
+	return true;
+}
+
+static size_t input_read(STREAMFILE *sf, uint8_t *dst, off_t offset, size_t length) {
+	InputStreamFile *input = (InputStreamFile*) sf;
+	input->requests++;
+
+	if (offset < 0 || (size_t) offset >= input->size)
+		return 0;
+	if (length > input->size - (size_t) offset)
+		length = input->size - (size_t) offset;
+
+	input->lastOffset = offset + (off_t) length;
+
+	if (input->mapping != NULL) {
+		memcpy(dst, input->mapping->data + offset, length);
+		input->bytesRead += length;
+		return length;
+	}
+
+	size_t done = 0;
+	while (done < length) {
+		ReadAheadWindow *window = &input->windows[input->currentWindow];
+		off_t position = offset + (off_t) done;
+
+		if (position < window->offset || position >= window->offset + (off_t) window->length) {
+			if (!load_window(input, position))
+				break;
+			continue;
+		}
+
+		size_t available = (size_t) (window->offset + (off_t) window->length - position);
+		size_t count = min(available, length - done);
+		memcpy(dst + done, window->data + (position - window->offset), count);
+		done += count;
+	}
+
+	return done;
+}
+
+static size_t input_get_size(STREAMFILE *sf) {
+	return ((InputStreamFile*) sf)->size;
+}
+
+static off_t input_get_offset(STREAMFILE *sf) {
+	return ((InputStreamFile*) sf)->lastOffset;
+}
+
+static void input_get_name(STREAMFILE *sf, char *name, size_t length) {
+	if (length == 0)
+		return;
+
+	strncpy(name, ((InputStreamFile*) sf)->name, length - 1);
+	name[length - 1] = '\0';
+}
+
+static STREAMFILE *input_open(STREAMFILE *sf, const char *const filename, size_t bufferSize) {
+	(void) bufferSize;
+	return open_input_streamfile(filename, ((InputStreamFile*) sf)->stats, sf->stream_index);
+}
+
+static void release_mapping(SharedMapping *mapping) {
+	lock_guard<mutex> lock(gMappingLock);
+	if (--mapping->refs > 0)
+		return;
+
+	for (size_t i = 0; i < gMappings.size(); i++) {
+		if (gMappings[i] == mapping) {
+			gMappings.erase(gMappings.begin() + i);
+			break;
+		}
+	}
+
+	munmap((void*) mapping->data, mapping->size);
+	delete mapping;
+}
+
+static void input_close(STREAMFILE *sf) {
+	InputStreamFile *input = (InputStreamFile*) sf;
+
+	finish_read_ahead(input);
+
+	stats_add(input->stats, &input->stats->inputRequests, input->requests);
+	stats_add(input->stats, &input->stats->inputReads, input->reads);
+	stats_add(input->stats, &input->stats->inputBytes, input->bytesRead);
+
+	if (input->mapping != NULL)
+		release_mapping(input->mapping);
+	close(input->fd);
+
+	delete[] input->windows[0].data;
+	delete[] input->windows[1].data;
+	delete[] input->name;
+	delete input;
+}
+
+static bool map_input(InputStreamFile *input) {
+	struct stat info;
+	if (fstat(input->fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size <= 0)
+		return false;
+
+	input->size = (size_t) info.st_size;
+
+	lock_guard<mutex> lock(gMappingLock);
+	for (size_t i = 0; i < gMappings.size(); i++) {
+		SharedMapping *mapping = gMappings[i];
+		if (mapping->device == info.st_dev && mapping->inode == info.st_ino && mapping->size == input->size) {
+			mapping->refs++;
+			input->mapping = mapping;
+			return true;
+		}
+	}
+
+	SharedMapping *mapping = new (nothrow) SharedMapping();
+	if (mapping == nullptr)
+		return false;
+
+	void *data = mmap(NULL, input->size, PROT_READ, MAP_PRIVATE, input->fd, 0);
+	if (data == MAP_FAILED) {
+		delete mapping;
+		return false;
+	}
+
+	madvise(data, input->size, MADV_SEQUENTIAL);
+
+	mapping->device = info.st_dev;
+	mapping->inode = info.st_ino;
+	mapping->size = input->size;
+	mapping->data = (const uint8_t*) data;
+	mapping->refs = 1;
+	gMappings.push_back(mapping);
+
+	input->mapping = mapping;
+	return true;
+}
+#endif
+
+static STREAMFILE *open_streamfile(const char *filename, ConversionStats *stats) {
+	if (filename == NULL)
+		return NULL;
+
+	// Pipes that were already read are shared, for vgmstream reopening the input as well as the decoders opened by -d
+	{
+		lock_guard<mutex> lock(gPipeLock);
+		PipeBuffer *pipe = find_pipe(filename);
+		if (pipe != NULL)
+			return open_pipe_view(pipe, stats);
+	}
+
+	if (is_stdin_input(filename)) {
+#ifndef INPUT_POSIX
+		_setmode(_fileno(stdin), _O_BINARY);
+#endif
+		return open_pipe_streamfile(stdin, filename, stats);
+	}
+
+#ifdef INPUT_POSIX
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	// Pipes, FIFOs and the like can't be read at an offset
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		return NULL;
+	}
+
+	if (!S_ISREG(info.st_mode) && !S_ISBLK(info.st_mode)) {
+		FILE *file = fdopen(fd, "rb");
+		if (file == NULL) {
+			close(fd);
+			return NULL;
+		}
+		return open_pipe_streamfile(file, filename, stats);
+	}
+
+	InputStreamFile *input = new (nothrow) InputStreamFile();
+	char *name = new (nothrow) char[strlen(filename) + 1];
+	if (input == nullptr || name == nullptr) {
+		close(fd);
+		delete input;
+		delete[] name;
+		return NULL;
+	}
+
+	strcpy(name, filename);
+	input->name = name;
+	input->stats = stats;
+	input->fd = fd;
+
+	input->sf.read = input_read;
+	input->sf.get_size = input_get_size;
+	input->sf.get_offset = input_get_offset;
+	input->sf.get_name = input_get_name;
+	input->sf.open = input_open;
+	input->sf.close = input_close;
+
+	if (!map_input(input)) {
+		input->size = (info.st_size > 0 ? (size_t) info.st_size : 0);
+		input->windows[0].data = new (nothrow) uint8_t[INPUT_READ_AHEAD_SIZE];
+		input->windows[1].data = new (nothrow) uint8_t[INPUT_READ_AHEAD_SIZE];
+
+		if (input->windows[0].data == nullptr || input->windows[1].data == nullptr) {
+			input_close(&input->sf);
+			return NULL;
+		}
+	}
+
+	return &input->sf;
+#else
+	(void) stats;
+	return open_stdio_streamfile(filename);
+#endif
+}
+
+const uint8_t *get_input_mapping(STREAMFILE *sf, size_t *size) {
+#ifdef INPUT_POSIX
+	if (sf == NULL || sf->read != input_read)
+		return NULL;
+
+	InputStreamFile *input = (InputStreamFile*) sf;
+	if (input->mapping == NULL)
+		return NULL;
+
+	*size = input->size;
+	return input->mapping->data;
+#else
+	(void) sf;
+	(void) size;
+	return NULL;
+#endif
+}
+
+int get_input_fd(STREAMFILE *sf) {
+#ifdef INPUT_POSIX
+	if (sf == NULL || sf->read != input_read)
+		return -1;
+
+	return ((InputStreamFile*) sf)->fd;
+#else
+	(void) sf;
+	return -1;
+#endif
+}
+
+STREAMFILE *open_input_streamfile(const char *filename, ConversionStats *stats, int subsong) {
+	STREAMFILE *sf = open_streamfile(filename, stats);
+	if (sf != NULL)
+		sf->stream_index = subsong;
+
+	return sf;
+}
+
+// Same as init_vgmstream, just reading through open_input_streamfile
+VGMSTREAM *open_input_vgmstream(string filename, ConversionStats *stats, int subsong) {
+	STREAMFILE *sf = open_input_streamfile(filename.c_str(), stats, subsong);
+	if (sf == NULL)
+		return NULL;
+
+	VGMSTREAM *vgmstream = init_vgmstream_from_STREAMFILE(sf);
+	sf->close(sf);
+
+	return vgmstream;
+}
+
+VGMSTREAM *join_input_vgmstreams(VGMSTREAM **parts, int numParts, int loopStartPart) {
+	segmented_layout_data *data = init_layout_segmented(numParts);
+	if (data == NULL) {
+		for (int i = 0; i < numParts; i++)
+			close_vgmstream(parts[i]);
+		return NULL;
+	}
+
+	for (int i = 0; i < numParts; i++) {
+		vgmstream_force_loop(parts[i], 0, 0, 0);
+		data->segments[i] = parts[i];
+	}
+
+	VGMSTREAM *joined = NULL;
+	if (setup_layout_segmented(data))
+		joined = allocate_segmented_vgmstream(data, loopStartPart >= 0, max(loopStartPart, 0), numParts - 1);
+
+	// Closes the parts along with it
+	if (joined == NULL)
+		free_layout_segmented(data);
+
+	return joined;
+}
@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <mutex>
+
+extern "C" {
+#include "vgmstream.h"
+}
+
+#include "main.hpp"
+#include "job.hpp"
+#include "stream.hpp"
+#include "sequence.hpp"
+#include "soundbank.hpp"
+#include "cache.hpp"
+#include "input.hpp"
+#include "bandwidth.hpp"
+
+using namespace std;
+
+ConversionJob::ConversionJob() {
+	inFilename = "";
+	outFilename = "";
+	duplicateFilename = "";
+	subsong = 0;
+
+	convertSubsongs = false;
+	isBatchJob = false;
+	generateStreams = true;
+	generateSequence = true;
+	generateSoundbank = true;
+	useBuildCache = false;
+	encodeVadpcm = false;
+
+	ovrdSampleRate = -1;
+	ovrdResampleRate = -1;
+	autoResampleRate = false;
+	bandwidthLoss = BANDWIDTH_LOSS_DEFAULT;
+	ovrdEnableLoop = -1;
+	ovrdLoopStartSamples = INT64_MAX;
+	ovrdLoopEndSamples = INT64_MAX;
+	ovrdLoopStartMicro = INT64_MAX;
+	ovrdLoopEndMicro = INT64_MAX;
+	ovrdStartSamples = INT64_MAX;
+	ovrdStartMicro = INT64_MAX;
+	resamplerEngine = RESAMPLER_BUILTIN;
+	resampleQuality = RESAMPLE_QUALITY_DEFAULT;
+	resampleGroupSize = 0;
+	decodeThreads = 1;
+	loopCacheLimit = LOOP_CACHE_LIMIT_DEFAULT;
+	autoMonoTolerance = 0.0;
+	silenceThreshold = -1;
+	sharedDecode = NULL;
+	sharedDecodeIndex = 0;
+
+	forcedMono = false;
+	seqNumChannels = 0;
+	muteScale = MUTE_SCALE_DEFAULT;
+	masterVolume = MASTER_VOLUME_DEFAULT;
+
+	instFlags = 0x0000;
+	streamChannels = 0;
+	sequenceTimestamp = -1.0;
+	tempo = 0;
+	timestamp = -1;
+	warnings = "";
+	bufferLog = false;
+	log = "";
+}
+
+static mutex gOutputLock;
+
+static void log_vprintf(string *log, const char *format, va_list args) {
+	char buffer[1024];
+	va_list retry;
+	va_copy(retry, args);
+
+	int length = vsnprintf(buffer, sizeof(buffer), format, args);
+	string text;
+	if (length >= (int) sizeof(buffer)) {
+		text.resize((size_t) length);
+		vsnprintf(&text[0], (size_t) length + 1, format, retry);
+	} else if (length > 0) {
+		text.assign(buffer, (size_t) length);
+	}
+	va_end(retry);
+
+	lock_guard<mutex> guard(gOutputLock);
+	if (log != NULL)
+		log->append(text);
+	else
+		fputs(text.c_str(), stdout);
+}
+
+void log_printf(string *log, const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	log_vprintf(log, format, args);
+	va_end(args);
+}
+
+void job_printf(ConversionJob *job, const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	log_vprintf((job != NULL && job->bufferLog ? &job->log : NULL), format, args);
+	va_end(args);
+}
+
+void print_param_warning(ConversionJob *job, string param) {
+	job_printf(job, "WARNING: Invalid value used for %s parameter, skipping...\n", param.c_str());
+}
+
+void set_filename_duplicate(ConversionJob *job, string duplicate) {
+	job->duplicateFilename = duplicate;
+	size_t slash = duplicate.find_last_of("/\\");
+	if (slash != string::npos) {
+		job->duplicateFilename = duplicate.substr(slash+1);
+	}
+}
+
+void add_appended_input(ConversionJob *job, string filename) {
+	// Parts get reopened by name, which a pipe can't be
+	if (filename.empty() || is_stdin_input(filename)) {
+		print_param_warning(job, "appended input");
+		return;
+	}
+
+	job->appendFilenames.push_back(filename);
+}
+
+// Replaces the opened input with itself followed by every appended part, looping from the first appended part to the end
+static int append_input_parts(ConversionJob *job, VGMSTREAM **inFileProperties) {
+	vector<VGMSTREAM*> parts(1, *inFileProperties);
+	*inFileProperties = NULL;
+
+	for (size_t i = 0; i < job->appendFilenames.size(); i++) {
+		const char *partFilename = job->appendFilenames[i].c_str();
+		VGMSTREAM *part = open_input_vgmstream(job->appendFilenames[i], &job->stats, 0);
+		int ret = RETURN_SUCCESS;
+
+		if (part == NULL) {
+			FILE *partFile = fopen(partFilename, "r");
+			if (partFile == NULL) {
+				job_printf(job, "...FAILED!\nERROR: Appended file %s cannot be found or opened!\n", partFilename);
+				ret = RETURN_CANNOT_FIND_INPUT_FILE;
+			}
+			else {
+				fclose(partFile);
+				job_printf(job, "...FAILED!\nERROR: Appended file %s is not a valid audio file!\n", partFilename);
+				ret = RETURN_INVALID_INPUT_FILE;
+			}
+		}
+		else if (part->channels != parts[0]->channels || part->sample_rate != parts[0]->sample_rate) {
+			job_printf(job, "...FAILED!\nERROR: Appended file %s doesn't match the input file!\nCONTAINS: %d channels at %d Hz, EXPECTED: %d channels at %d Hz\n",
+			 partFilename, part->channels, part->sample_rate, parts[0]->channels, parts[0]->sample_rate);
+			close_vgmstream(part);
+			ret = RETURN_APPENDED_INPUT_MISMATCH;
+		}
+
+		if (ret != RETURN_SUCCESS) {
+			for (size_t j = 0; j < parts.size(); j++)
+				close_vgmstream(parts[j]);
+			return ret;
+		}
+
+		parts.push_back(part);
+	}
+
+	*inFileProperties = join_input_vgmstreams(parts.data(), (int) parts.size(), 1);
+	if (*inFileProperties == NULL) {
+		job_printf(job, "...FAILED!\nERROR: Appended files cannot be joined to the input file!\n");
+		return RETURN_INVALID_INPUT_FILE;
+	}
+
+	return RETURN_SUCCESS;
+}
+
+int get_vgmstream_properties(ConversionJob *job, VGMSTREAM **inFileProperties) {
+	const char *inFilename = job->inFilename.c_str();
+
+	*inFileProperties = open_input_vgmstream(job->inFilename, &job->stats, job->subsong);
+	if (job->subsong > 0 && *inFileProperties != NULL && (*inFileProperties)->num_streams > 1)
+		job_printf(job, "Opening %s (subsong %d) for reading...", inFilename, job->subsong);
+	else
+		job_printf(job, "Opening %s for reading...", inFilename);
+	fflush(stdout);
+
+	if (!*inFileProperties) {
+		if (!is_stdin_input(job->inFilename)) {
+			FILE *invalidFile = fopen(inFilename, "r");
+			if (invalidFile == NULL) {
+				job_printf(job, "...FAILED!\nERROR: Input file cannot be found or opened!\n");
+				return RETURN_CANNOT_FIND_INPUT_FILE;
+			}
+			fclose(invalidFile);
+		}
+
+		job_printf(job, "...FAILED!\nERROR: Input file is not a valid audio file!\nIf you believe this is a fluke, please make sure you have the proper audio libraries installed.\n");
+		job_printf(job, "Alternatively, you can convert the input file to WAV (16-bit) separately and try again.\n");
+		return RETURN_INVALID_INPUT_FILE;
+	}
+
+	if ((*inFileProperties)->channels <= 0) {
+		job_printf(job, "...FAILED!\nERROR: Audio must have at least 1 channel!\nCONTAINS: %d channels\n", (*inFileProperties)->channels);
+		close_vgmstream(*inFileProperties);
+		*inFileProperties = NULL;
+		return RETURN_NOT_ENOUGH_CHANNELS;
+	}
+
+	if ((*inFileProperties)->channels > (int) NUM_CHANNELS_MAX) {
+		job_printf(job, "...FAILED!\nERROR: Audio file exceeds maximum of %d channels!\nCONTAINS: %d channels\n", (int) NUM_CHANNELS_MAX, (*inFileProperties)->channels);
+		close_vgmstream(*inFileProperties);
+		*inFileProperties = NULL;
+		return RETURN_TOO_MANY_CHANNELS;
+	}
+
+	if (!job->appendFilenames.empty()) {
+		int ret = append_input_parts(job, inFileProperties);
+		if (ret != RETURN_SUCCESS)
+			return ret;
+	}
+
+	if (!resolve_channel_mix(&job->channelMix, (*inFileProperties)->channels)) {
+		job_printf(job, "...FAILED!\nERROR: Channel map uses channels the audio file doesn't have!\nCONTAINS: %d channels\n", (*inFileProperties)->channels);
+		close_vgmstream(*inFileProperties);
+		*inFileProperties = NULL;
+		return RETURN_INVALID_CHANNEL_MAP;
+	}
+
+	int streamChannels = (job->channelMix.outputChannels > 0 ? job->channelMix.outputChannels : (*inFileProperties)->channels);
+
+	// Every channel starts out used; silent ones get cleared once the streams are written, if a silence threshold is set
+	job->instFlags = (1ULL << streamChannels) - 1ULL;
+	job->streamChannels = (uint8_t) streamChannels;
+
+	job_printf(job, "...SUCCESS!\n");
+
+	return RETURN_SUCCESS;
+}
+
+void print_seq_channels(ConversionJob *job, uint16_t instFlags) {
+	uint8_t numChannels = 0;
+
+	for (uint8_t i = 0; i < (uint8_t) NUM_CHANNELS_MAX; i++)
+		if (instFlags & (1 << i))
+			numChannels++;
+
+	if (job->seqNumChannels != 0 && (job->generateSequence && !(job->generateSoundbank && job->generateStreams))) {
+		numChannels = job->seqNumChannels;
+	}
+
+	job_printf(job, "\n");
+
+	job_printf(job, "    Number of Channels: %d", numChannels);
+	if (job->seqNumChannels != 0 && job->seqNumChannels != numChannels) {
+		job_printf(job, " (Sequence: %d)", job->seqNumChannels);
+	} else if (!job->forcedMono) {
+		if (numChannels == 1)
+			job_printf(job, " (mono)");
+		else if (numChannels == 2)
+			job_printf(job, " (stereo)");
+
+	}
+	job_printf(job, "\n");
+
+	string timestamp = seq_get_duration_print(job);
+	if (timestamp.size() > 0) {
+		job_printf(job, "    Sequence Duration: %s\n", timestamp.c_str());
+	}
+
+	job_printf(job, "\n");
+}
+
+// Runs a fully configured conversion job from start to finish. Safe to call from multiple threads with separate jobs.
+int run_conversion_job(ConversionJob *job) {
+	VGMSTREAM *inFileProperties = NULL;
+	string cacheKey = "";
+
+	if (job->useBuildCache) {
+		cacheKey = build_cache_key(job);
+		if (!cacheKey.empty() && build_cache_is_fresh(job, cacheKey)) {
+			job_printf(job, "%s is up to date, skipping...\n", job->inFilename.c_str());
+			return RETURN_SUCCESS;
+		}
+	}
+
+	int ret = get_vgmstream_properties(job, &inFileProperties);
+	if (ret)
+		return ret;
+
+	ret = generate_new_streams(job, inFileProperties, job->outFilename, job->inFilename, job->generateStreams);
+	if (!ret && !job->generateStreams)
+		print_seq_channels(job, job->instFlags);
+
+	if (job->generateSequence) {
+		if (!ret)
+			ret = generate_new_sequence(job, job->outFilename, job->instFlags);
+		else
+			generate_new_sequence(job, job->outFilename, job->instFlags);
+	}
+
+	if (job->generateSoundbank) {
+		if (!ret)
+			ret = generate_new_soundbank(job, job->outFilename, job->instFlags);
+		else
+			generate_new_soundbank(job, job->outFilename, job->instFlags);
+	}
+
+	close_vgmstream(inFileProperties);
+
+	print_stats(&job->stats, (job->subsong > 0 ? job->inFilename + "#" + to_string(job->subsong) : job->inFilename), (job->bufferLog ? &job->log : NULL));
+
+	if (!ret && !cacheKey.empty())
+		build_cache_write_manifest(job, cacheKey);
+
+	if (!(job->generateStreams || job->generateSequence || job->generateSoundbank))
+		job_printf(job, "No files to generate!\n");
+
+	return ret;
+}
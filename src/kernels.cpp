@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "kernels.hpp"
+#include "mix.hpp"
+#include "bswp.hpp"
+
+enum KernelLevel {
+	KERNEL_SCALAR,
+	KERNEL_SSE2,
+	KERNEL_AVX2
+};
+
+static KernelLevel detect_kernel_level() {
+	KernelLevel level = KERNEL_SCALAR;
+
+#if defined(KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		level = KERNEL_AVX2;
+	else if (__builtin_cpu_supports("sse2"))
+		level = KERNEL_SSE2;
+#endif
+
+	// STRM64_KERNELS caps the instruction set, so every implementation can be tested and compared on one machine
+	const char *limit = getenv("STRM64_KERNELS");
+	if (limit != NULL && strcmp(limit, "scalar") == 0)
+		level = KERNEL_SCALAR;
+	else if (limit != NULL && strcmp(limit, "sse2") == 0)
+		level = std::min(level, KERNEL_SSE2);
+
+	return level;
+}
+
+static KernelLevel get_kernel_level() {
+	static const KernelLevel level = detect_kernel_level();
+	return level;
+}
+
+const char *get_kernel_name() {
+	static const char *const names[] = {"scalar", "sse2", "avx2"};
+	return names[get_kernel_level()];
+}
+
+// Channel count known at compile time, which gets rid of the divide/modulo and lets the compiler unroll the inner loop
+template <int N, bool Swap>
+static void deinterleave_fixed(const sample_t *input, sample_t **outputs, uint32_t startFrame, uint32_t numFrames) {
+	for (uint32_t i = startFrame; i < numFrames; i++)
+		for (int c = 0; c < N; c++)
+			outputs[c][i] = (Swap ? (sample_t) bswap_16((uint16_t) input[(size_t) i * N + c]) : input[(size_t) i * N + c]);
+}
+
+template <bool Swap>
+static void deinterleave_scalar(const sample_t *input, sample_t **outputs, int numChannels, uint32_t startFrame, uint32_t numFrames) {
+	switch (numChannels) {
+	case 1:
+		deinterleave_fixed<1, Swap>(input, outputs, startFrame, numFrames);
+		return;
+	case 2:
+		deinterleave_fixed<2, Swap>(input, outputs, startFrame, numFrames);
+		return;
+	case 4:
+		deinterleave_fixed<4, Swap>(input, outputs, startFrame, numFrames);
+		return;
+	case 6:
+		deinterleave_fixed<6, Swap>(input, outputs, startFrame, numFrames);
+		return;
+	case 8:
+		deinterleave_fixed<8, Swap>(input, outputs, startFrame, numFrames);
+		return;
+	case 16:
+		deinterleave_fixed<16, Swap>(input, outputs, startFrame, numFrames);
+		return;
+	}
+
+	for (uint32_t i = startFrame; i < numFrames; i++)
+		for (int c = 0; c < numChannels; c++)
+			outputs[c][i] = (Swap ? (sample_t) bswap_16((uint16_t) input[(size_t) i * numChannels + c]) : input[(size_t) i * numChannels + c]);
+}
+
+void deinterleave_bswap_16(const sample_t *input, sample_t **outputs, int numChannels, uint32_t numFrames) {
+	uint32_t framesDone = 0;
+
+	switch (get_kernel_level()) {
+	case KERNEL_AVX2:
+		framesDone = deinterleave_bswap_16_avx2(input, outputs, numChannels, numFrames);
+		break;
+	case KERNEL_SSE2:
+		framesDone = deinterleave_bswap_16_sse2(input, outputs, numChannels, numFrames);
+		break;
+	default:
+		break;
+	}
+
+	deinterleave_scalar<true>(input, outputs, numChannels, framesDone, numFrames);
+}
+
+void deinterleave_16(const sample_t *input, sample_t **outputs, int numChannels, uint32_t numFrames) {
+	deinterleave_scalar<false>(input, outputs, numChannels, 0, numFrames);
+}
+
+// A single channel deinterleave is a plain byteswap, which every implementation can do in place
+void bswap_16_inplace(sample_t *samples, uint32_t count) {
+	deinterleave_bswap_16(samples, &samples, 1, count);
+}
+
+template <bool Swap>
+static void channel_peaks_scalar(const sample_t *input, int numChannels, uint32_t numFrames, int32_t *peaks) {
+	for (int c = 0; c < numChannels; c++) {
+		int32_t peak = peaks[c];
+		for (uint32_t i = 0; i < numFrames; i++) {
+			int32_t sample = (Swap ? (sample_t) bswap_16((uint16_t) input[(size_t) i * numChannels + c]) : input[(size_t) i * numChannels + c]);
+			peak = std::max(peak, (sample < 0 ? -sample : sample));
+		}
+		peaks[c] = peak;
+	}
+}
+
+void channel_peaks_16(const sample_t *input, int numChannels, uint32_t numFrames, bool bigEndian, int32_t *peaks) {
+	if (bigEndian)
+		channel_peaks_scalar<true>(input, numChannels, numFrames, peaks);
+	else
+		channel_peaks_scalar<false>(input, numChannels, numFrames, peaks);
+}
+
+template <bool Swap>
+static void stereo_energy_scalar(const sample_t *left, const sample_t *right, size_t stride, uint32_t numFrames, double *energy) {
+	double sum = 0.0, difference = 0.0;
+	for (uint32_t i = 0; i < numFrames; i++) {
+		int32_t l = (Swap ? (sample_t) bswap_16((uint16_t) left[(size_t) i * stride]) : left[(size_t) i * stride]);
+		int32_t r = (Swap ? (sample_t) bswap_16((uint16_t) right[(size_t) i * stride]) : right[(size_t) i * stride]);
+		sum += (double) (l + r) * (l + r);
+		difference += (double) (l - r) * (l - r);
+	}
+	energy[0] += sum;
+	energy[1] += difference;
+}
+
+void stereo_energy_16(const sample_t *left, const sample_t *right, size_t stride, uint32_t numFrames, bool bigEndian, double *energy) {
+	if (bigEndian)
+		stereo_energy_scalar<true>(left, right, stride, numFrames, energy);
+	else
+		stereo_energy_scalar<false>(left, right, stride, numFrames, energy);
+}
+
+/**
+ * The vector kernels multiply with pmaddwd, which takes 16-bit gains and adds up 32-bit sums. Both stay exact as long as every gain
+ * is below 2 and a full scale input (rounding included) can't push any output's sum past 32 bits, which covers the presets and any
+ * sensible matrix. Returns false for anything else, which is left to the scalar kernel.
+ */
+static bool pack_mix_gains(const int32_t *matrix, int inputChannels, int outputChannels, int16_t *gains) {
+	if (inputChannels > MIX_KERNEL_WIDTH || outputChannels > MIX_KERNEL_WIDTH)
+		return false;
+
+	memset(gains, 0, sizeof(int16_t) * MIX_KERNEL_WIDTH * MIX_KERNEL_WIDTH);
+
+	for (int o = 0; o < outputChannels; o++) {
+		int64_t norm = 0;
+		for (int c = 0; c < inputChannels; c++) {
+			int32_t gain = matrix[(size_t) o * inputChannels + c];
+			if (gain < -INT16_MAX || gain > INT16_MAX)
+				return false;
+
+			gains[o * MIX_KERNEL_WIDTH + c] = (int16_t) gain;
+			norm += (gain < 0 ? -gain : gain);
+		}
+
+		if (norm * 32768 + (1 << (MIX_GAIN_BITS - 1)) > INT32_MAX)
+			return false;
+	}
+
+	return true;
+}
+
+void mix_channels_16(const sample_t *input, int inputChannels, sample_t *output, int outputChannels, const int32_t *matrix, uint32_t numFrames) {
+	const int64_t rounding = (int64_t) 1 << (MIX_GAIN_BITS - 1);
+	uint32_t framesDone = 0;
+
+	// Matrices of up to 4 gains go through each frame faster in scalar code than by padding them out to vectors
+	KernelLevel level = get_kernel_level();
+	if (level >= KERNEL_SSE2 && inputChannels * outputChannels > 4) {
+		alignas(16) int16_t gains[MIX_KERNEL_WIDTH * MIX_KERNEL_WIDTH];
+		if (pack_mix_gains(matrix, inputChannels, outputChannels, gains)) {
+			if (level == KERNEL_AVX2)
+				framesDone = mix_channels_16_avx2(input, inputChannels, output, outputChannels, gains, numFrames);
+			else
+				framesDone = mix_channels_16_sse2(input, inputChannels, output, outputChannels, gains, numFrames);
+		}
+	}
+
+	for (uint32_t i = framesDone; i < numFrames; i++) {
+		const sample_t *frame = &input[(size_t) i * inputChannels];
+
+		for (int o = 0; o < outputChannels; o++) {
+			const int32_t *gains = &matrix[(size_t) o * inputChannels];
+			int64_t sum = rounding;
+			for (int c = 0; c < inputChannels; c++)
+				sum += (int64_t) gains[c] * frame[c];
+
+			sum >>= MIX_GAIN_BITS;
+			output[(size_t) i * outputChannels + o] = (sample_t) std::min(std::max(sum, (int64_t) INT16_MIN), (int64_t) INT16_MAX);
+		}
+	}
+}
+
+void vadpcm_predictor_errors(const float *samples, const float *coefs, int numPredictors, float *errors) {
+	int done = 0;
+
+	if (get_kernel_level() >= KERNEL_SSE2)
+		done = vadpcm_predictor_errors_sse2(samples, coefs, numPredictors, errors);
+
+	for (int p = done; p < numPredictors; p++) {
+		float a1 = coefs[p * 2];
+		float a2 = coefs[p * 2 + 1];
+		float lanes[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+		for (int i = 0; i < 16; i++) {
+			float e = (samples[i + 2] - a1 * samples[i + 1]) - a2 * samples[i];
+			lanes[i & 3] = lanes[i & 3] + e * e;
+		}
+
+		errors[p] = (lanes[0] + lanes[2]) + (lanes[1] + lanes[3]);
+	}
+}
+
+void dot_products_16(sample_t *const *samples, size_t offset, int count, const int16_t *coefs, int length, int32_t *sums) {
+	int done = 0;
+
+	switch (get_kernel_level()) {
+	case KERNEL_AVX2:
+		done = dot_products_16_avx2(samples, offset, count, coefs, length, sums);
+		break;
+	case KERNEL_SSE2:
+		done = dot_products_16_sse2(samples, offset, count, coefs, length, sums);
+		break;
+	default:
+		for (int k = 0; k < count; k++)
+			sums[k] = 0;
+		break;
+	}
+
+	// Wraps around like the vector lanes do, if the caller lets the coefficients add up to too much
+	for (int k = 0; k < count; k++) {
+		const sample_t *src = samples[k] + offset;
+		uint32_t sum = (uint32_t) sums[k];
+
+		for (int i = done; i < length; i++)
+			sum += (uint32_t) ((int32_t) src[i] * coefs[i]);
+		sums[k] = (int32_t) sum;
+	}
+}
@@ -0,0 +1,137 @@
+#include "kernels.hpp"
+#include "mix.hpp"
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+#include "kernels_simd.hpp"
+
+struct AVX2Ops {
+	typedef __m256i vec;
+	static const uint32_t FRAMES = 16;
+
+	static inline vec load(const sample_t *src) {
+		return _mm256_loadu_si256((const __m256i *) src);
+	}
+
+	static inline void store(sample_t *dst, vec v) {
+		_mm256_storeu_si256((__m256i *) dst, v);
+	}
+
+	static inline vec bswap(vec v) {
+		return _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+	}
+
+	// Same as SSE2, but packing works within 128-bit lanes, so the 64-bit quarters need to be put back in order afterwards
+	static inline void split(vec a, vec b, vec *even, vec *odd) {
+		vec packedEven = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16), _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16));
+		vec packedOdd = _mm256_packs_epi32(_mm256_srai_epi32(a, 16), _mm256_srai_epi32(b, 16));
+
+		*even = _mm256_permute4x64_epi64(packedEven, 0xD8);
+		*odd = _mm256_permute4x64_epi64(packedOdd, 0xD8);
+	}
+};
+
+uint32_t deinterleave_bswap_16_avx2(const sample_t *input, sample_t **outputs, int numChannels, uint32_t numFrames) {
+	return deinterleave_bswap_simd_dispatch<AVX2Ops>(input, outputs, numChannels, numFrames);
+}
+
+int dot_products_16_avx2(sample_t *const *samples, size_t offset, int count, const int16_t *coefs, int length, int32_t *sums) {
+	int done = length & ~15;
+
+	for (int k = 0; k < count; k++) {
+		const sample_t *src = samples[k] + offset;
+		__m256i acc = _mm256_setzero_si256();
+
+		for (int i = 0; i < done; i += 16)
+			acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *) (src + i)), _mm256_loadu_si256((const __m256i *) (coefs + i))));
+
+		__m128i half = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+		half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+		half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+		sums[k] = _mm_cvtsi128_si32(half);
+	}
+
+	return done;
+}
+
+// Same as SSE2, with two frames side by side in the 128-bit lanes, which the unpacks keep apart
+static inline __m256i sum_transposed_avx2(__m256i s0, __m256i s1, __m256i s2, __m256i s3) {
+	__m256i a = _mm256_add_epi32(_mm256_unpacklo_epi32(s0, s1), _mm256_unpackhi_epi32(s0, s1));
+	__m256i b = _mm256_add_epi32(_mm256_unpacklo_epi32(s2, s3), _mm256_unpackhi_epi32(s2, s3));
+	return _mm256_add_epi32(_mm256_unpacklo_epi64(a, b), _mm256_unpackhi_epi64(a, b));
+}
+
+static inline __m256i load_frame_pair(const sample_t *src, int inputChannels) {
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) src)),
+	 _mm_loadu_si128((const __m128i *) (src + inputChannels)), 1);
+}
+
+static inline void store_outputs(sample_t *dst, __m128i packed, int count) {
+	if (count >= 4) {
+		_mm_storel_epi64((__m128i *) dst, packed);
+		return;
+	}
+
+	alignas(16) sample_t lanes[8];
+	_mm_store_si128((__m128i *) lanes, packed);
+	for (int j = 0; j < count; j++)
+		dst[j] = lanes[j];
+}
+
+template <bool Wide>
+static uint32_t mix_frames_avx2(const sample_t *input, int inputChannels, sample_t *output, int outputChannels, const int16_t *gains, uint32_t numFrames) {
+	const __m256i rounding = _mm256_set1_epi32(1 << (MIX_GAIN_BITS - 1));
+	const size_t width = (Wide ? 16 : 8);
+	const size_t end = (size_t) numFrames * inputChannels;
+	uint32_t frame = 0;
+
+	for (; (size_t) (frame + 1) * inputChannels + width <= end; frame += 2) {
+		const sample_t *src = input + (size_t) frame * inputChannels;
+		sample_t *dst = output + (size_t) frame * outputChannels;
+		__m256i low = load_frame_pair(src, inputChannels);
+		__m256i high = (Wide ? load_frame_pair(src + 8, inputChannels) : _mm256_setzero_si256());
+
+		for (int o = 0; o < outputChannels; o += 4) {
+			__m256i products[4];
+			for (int j = 0; j < 4; j++) {
+				const int16_t *row = gains + (size_t) (o + j) * MIX_KERNEL_WIDTH;
+				products[j] = _mm256_madd_epi16(low, _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) row)));
+				if (Wide)
+					products[j] = _mm256_add_epi32(products[j], _mm256_madd_epi16(high, _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) (row + 8)))));
+			}
+
+			__m256i sums = sum_transposed_avx2(products[0], products[1], products[2], products[3]);
+			__m256i packed = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_add_epi32(sums, rounding), MIX_GAIN_BITS), _mm256_setzero_si256());
+
+			store_outputs(dst + o, _mm256_castsi256_si128(packed), outputChannels - o);
+			store_outputs(dst + outputChannels + o, _mm256_extracti128_si256(packed, 1), outputChannels - o);
+		}
+	}
+
+	return frame;
+}
+
+uint32_t mix_channels_16_avx2(const sample_t *input, int inputChannels, sample_t *output, int outputChannels, const int16_t *gains, uint32_t numFrames) {
+	if (inputChannels > 8)
+		return mix_frames_avx2<true>(input, inputChannels, output, outputChannels, gains, numFrames);
+
+	return mix_frames_avx2<false>(input, inputChannels, output, outputChannels, gains, numFrames);
+}
+
+#else
+
+uint32_t deinterleave_bswap_16_avx2(const sample_t *input, sample_t **outputs, int numChannels, uint32_t numFrames) {
+	return 0;
+}
+
+int dot_products_16_avx2(sample_t *const *samples, size_t offset, int count, const int16_t *coefs, int length, int32_t *sums) {
+	return 0;
+}
+
+uint32_t mix_channels_16_avx2(const sample_t *input, int inputChannels, sample_t *output, int outputChannels, const int16_t *gains, uint32_t numFrames) {
+	return 0;
+}
+
+#endif
@@ -0,0 +1,153 @@
+#include "kernels.hpp"
+#include "mix.hpp"
+
+#if defined(__SSE2__)
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#include "kernels_simd.hpp"
+
+struct SSE2Ops {
+	typedef __m128i vec;
+	static const uint32_t FRAMES = 8;
+
+	static inline vec load(const sample_t *src) {
+		return _mm_loadu_si128((const __m128i *) src);
+	}
+
+	static inline void store(sample_t *dst, vec v) {
+		_mm_storeu_si128((__m128i *) dst, v);
+	}
+
+	static inline vec bswap(vec v) {
+		return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+	}
+
+	// Sign extends each half of every 32-bit lane so they can be packed back down without saturating
+	static inline void split(vec a, vec b, vec *even, vec *odd) {
+		*even = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+		*odd = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+	}
+};
+
+uint32_t deinterleave_bswap_16_sse2(const sample_t *input, sample_t **outputs, int numChannels, uint32_t numFrames) {
+	return deinterleave_bswap_simd_dispatch<SSE2Ops>(input, outputs, numChannels, numFrames);
+}
+
+// Four samples per vector; the lanes are summed in the same order as the scalar fallback
+int vadpcm_predictor_errors_sse2(const float *samples, const float *coefs, int numPredictors, float *errors) {
+	for (int p = 0; p < numPredictors; p++) {
+		__m128 a1 = _mm_set1_ps(coefs[p * 2]);
+		__m128 a2 = _mm_set1_ps(coefs[p * 2 + 1]);
+		__m128 sum = _mm_setzero_ps();
+
+		for (int i = 0; i < 16; i += 4) {
+			__m128 x0 = _mm_loadu_ps(samples + 2 + i);
+			__m128 x1 = _mm_loadu_ps(samples + 1 + i);
+			__m128 x2 = _mm_loadu_ps(samples + i);
+			__m128 e = _mm_sub_ps(_mm_sub_ps(x0, _mm_mul_ps(a1, x1)), _mm_mul_ps(a2, x2));
+			sum = _mm_add_ps(sum, _mm_mul_ps(e, e));
+		}
+
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		errors[p] = _mm_cvtss_f32(sum);
+	}
+
+	return numPredictors;
+}
+
+// Eight terms per vector, multiplied and summed pairwise into 32-bit lanes by pmaddwd
+int dot_products_16_sse2(sample_t *const *samples, size_t offset, int count, const int16_t *coefs, int length, int32_t *sums) {
+	int done = length & ~7;
+
+	for (int k = 0; k < count; k++) {
+		const sample_t *src = samples[k] + offset;
+		__m128i acc = _mm_setzero_si128();
+
+		for (int i = 0; i < done; i += 8)
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128((const __m128i *) (src + i)), _mm_loadu_si128((const __m128i *) (coefs + i))));
+
+		acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0x4E));
+		acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0xB1));
+		sums[k] = _mm_cvtsi128_si32(acc);
+	}
+
+	return done;
+}
+
+// Adds up the four vectors of pairwise products of four outputs, by transposing them on the way: one sum per output, in order
+static inline __m128i sum_transposed_sse2(__m128i s0, __m128i s1, __m128i s2, __m128i s3) {
+	__m128i a = _mm_add_epi32(_mm_unpacklo_epi32(s0, s1), _mm_unpackhi_epi32(s0, s1));
+	__m128i b = _mm_add_epi32(_mm_unpacklo_epi32(s2, s3), _mm_unpackhi_epi32(s2, s3));
+	return _mm_add_epi32(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b));
+}
+
+// Up to eight input channels fit one vector, more take two. Loads run past the end of a frame into samples whose gains are 0,
+// but stop at the end of the input, which leaves the last few frames to the scalar kernel.
+template <bool Wide>
+static uint32_t mix_frames_sse2(const sample_t *input, int inputChannels, sample_t *output, int outputChannels, const int16_t *gains, uint32_t numFrames) {
+	const __m128i rounding = _mm_set1_epi32(1 << (MIX_GAIN_BITS - 1));
+	const size_t width = (Wide ? 16 : 8);
+	const size_t end = (size_t) numFrames * inputChannels;
+	uint32_t frame = 0;
+
+	for (; (size_t) frame * inputChannels + width <= end; frame++) {
+		const sample_t *src = input + (size_t) frame * inputChannels;
+		sample_t *dst = output + (size_t) frame * outputChannels;
+		__m128i low = _mm_loadu_si128((const __m128i *) src);
+		__m128i high = (Wide ? _mm_loadu_si128((const __m128i *) (src + 8)) : _mm_setzero_si128());
+
+		for (int o = 0; o < outputChannels; o += 4) {
+			__m128i products[4];
+			for (int j = 0; j < 4; j++) {
+				const int16_t *row = gains + (size_t) (o + j) * MIX_KERNEL_WIDTH;
+				products[j] = _mm_madd_epi16(low, _mm_load_si128((const __m128i *) row));
+				if (Wide)
+					products[j] = _mm_add_epi32(products[j], _mm_madd_epi16(high, _mm_load_si128((const __m128i *) (row + 8))));
+			}
+
+			__m128i sums = sum_transposed_sse2(products[0], products[1], products[2], products[3]);
+			__m128i packed = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(sums, rounding), MIX_GAIN_BITS), _mm_setzero_si128());
+
+			if (o + 4 <= outputChannels) {
+				_mm_storel_epi64((__m128i *) (dst + o), packed);
+			} else {
+				alignas(16) sample_t lanes[8];
+				_mm_store_si128((__m128i *) lanes, packed);
+				for (int j = 0; o + j < outputChannels; j++)
+					dst[o + j] = lanes[j];
+			}
+		}
+	}
+
+	return frame;
+}
+
+uint32_t mix_channels_16_sse2(const sample_t *input, int inputChannels, sample_t *output, int outputChannels, const int16_t *gains, uint32_t numFrames) {
+	if (inputChannels > 8)
+		return mix_frames_sse2<true>(input, inputChannels, output, outputChannels, gains, numFrames);
+
+	return mix_frames_sse2<false>(input, inputChannels, output, outputChannels, gains, numFrames);
+}
+
+#else
+
+uint32_t deinterleave_bswap_16_sse2(const sample_t *input, sample_t **outputs, int numChannels, uint32_t numFrames) {
+	return 0;
+}
+
+int vadpcm_predictor_errors_sse2(const float *samples, const float *coefs, int numPredictors, float *errors) {
+	return 0;
+}
+
+int dot_products_16_sse2(sample_t *const *samples, size_t offset, int count, const int16_t *coefs, int length, int32_t *sums) {
+	return 0;
+}
+
+uint32_t mix_channels_16_sse2(const sample_t *input, int inputChannels, sample_t *output, int outputChannels, const int16_t *gains, uint32_t numFrames) {
+	return 0;
+}
+
+#endif
@@ -8,16 +8,23 @@
 
  /**
  * Usage: STRM64 <input audio file> [optional arguments]
+ * Passing - as the input audio file reads it from standard input.
  *
  * OPTIONAL ARGUMENTS
  *	-o [output filenames]                (default: same as input, not including extension)
  *	-r [sample rate]                     (default: same as source file (affects playback speed))
- *	-R [resample rate]                   (default: same as source file (affects internal resolution))
+ *	-R [resample rate(s) / auto]         (default: same as source file (affects internal resolution))
+ *	-g [channels per resample thread]    (default: all channels on one thread)
+ *	-k [loop cache limit in MiB]         (default: 256)
+ *	-d [number of decoder threads]       (default: 1)
  *	-l [enable/disable loop]             (default: either value in source audio or false)
  *	-s [loop start sample]               (default: either value in source audio or 0)
  *	-t [loop start timestamp]            (default: either value in source audio or 0)
  *	-e [loop end sample / total samples] (default: number of samples in source file)
  *	-f [loop end timestamp / total time] (default: length of source audio)
+ *	--start [first sample]               (default: 0, skips everything before it without decoding where possible)
+ *	--start-time [first timestamp]       (default: 0)
+ *	--append [input file]                (play after the input, looping from its start; repeatable)
  *	-c [number of channels in sequence]  (default: same as source file)
  *	-u [mute scale of sequence]          (default: 63)
  *	-v [master volume of sequence]       (default: 127)
@@ -26,13 +33,40 @@
  *	-y                                   (don't generate sequence file)
  *	-z                                   (don't generate soundbank file)
  *	-h                                   (show help text)
+ *	--stats [text / json]                (print timing, throughput and memory statistics)
+ *	--cache                              (skip conversion if input, arguments and outputs are unchanged)
+ *	--vadpcm                             (write VADPCM compressed .aifc streams instead of .aiff)
+ *	--subsongs                           (convert every subsong of a multi-stream container)
+ *	--resampler [builtin / swr]          (default: builtin)
+ *	--resample-quality [preset]          (draft / default / high, default: default)
+ *	--bandwidth-loss [dB]                (default: 60, energy -R auto may cut off per channel)
+ *	--map [channels]                     (write only these input channels, in this order, e.g. 0,1,4)
+ *	--mix [mono / stereo / matrix]       (downmix channels, e.g. stereo or 0+0.7*2,1+0.7*2)
+ *	--prune-silence [peak dBFS]          (drop channels that never get louder than this)
+ *	--auto-mono [dB]                     (write stereo as one centered stream if L-R stays this far below L+R)
+ *
+ * BATCH MODE
+ *	STRM64 -b [input file / glob] [optional arguments]
+ *	STRM64 -B [job file] [optional arguments]
+ *	-j [number of worker threads]        (default: number of CPU cores)
  *
  * USAGE EXAMPLES
  *	STRM64 inputfile.wav -o outfiles -s 158462 -e 7485124
  *	STRM64 "spaces not recommended.wav" -l 1 -f 1:35.23
  *	STRM64 inputfile.brstm -l false -e 0x10000
+ *	STRM64 longfile.wav --start-time 40 -f 1:40 -l 1
+ *	STRM64 song_intro.ogg --append song_loop.ogg -o song
  *  STRM64 inputfile.mp3 -R 32000 -t 0
+ *	STRM64 inputfile.mp3 -R 32000,26800,22050
+ *	STRM64 inputfile.wav -R auto --bandwidth-loss 50
+ *	STRM64 stems.wav --prune-silence -90
+ *	STRM64 surround.ac3 --mix 0+0.7*2+0.7*4,1+0.7*2+0.7*5
+ *	STRM64 -b "*.wav" --auto-mono 40
  *	STRM64 custom_soundeffect.wav -y -z
+ *	STRM64 -b "*.wav" -R 32000 -j 8
+ *	STRM64 -B tracks.txt
+ *	STRM64 soundbank.awb --subsongs -R 32000
+ *	ffmpeg -i inputfile.mkv -f wav - | STRM64 - -o outfiles
  *
  * Note: STRM64 uses vgmstream to parse audio. You may need to install ffmpeg for certain conversions to be supported.
  * For the Windows build of this application, the bundled DLLs are mandatory for this program to run.
@@ -44,54 +78,45 @@
 #include <stdlib.h>
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <thread>
 
-extern "C" {
-#include "vgmstream.h"
-}
-		
 #include "main.hpp"
+#include "job.hpp"
 #include "stream.hpp"
 #include "sequence.hpp"
-#include "soundbank.hpp"
+#include "batch.hpp"
+#include "stats.hpp"
+#include "input.hpp"
 
 using namespace std;
 
-vector <string> cmdArgs;
-
-string newFilename;
 string parsedExeName;
-bool customNewFilename = false;
-
-bool generateStreams = true;
-bool generateSequence = true;
-bool generateSoundbank = true;
-bool printedHelp = false;
-
-static bool forcedMono = false;
-static uint8_t channelCountOverride = 0;
-static string duplicateStringName = "";
-
-uint16_t gInstFlags = 0x0000;
-
-VGMSTREAM *inFileProperties;
+atomic<bool> printedHelp(false);
 
 void printHelp() {
-	if (printedHelp)
+	if (printedHelp.exchange(true))
 		return;
-	printedHelp = true;
 
 	string print = "\n"
         "Usage: " + parsedExeName + " <input audio file> [optional arguments]\n"
+        "Passing - as the input audio file reads it from standard input.\n"
         "\n"
         "OPTIONAL ARGUMENTS\n"
         "    -o [output filenames]                (default: same as input, not including extension)\n"
         "    -r [sample rate]                     (default: same as source file (affects playback speed))\n"
-        "    -R [resample rate]                   (default: same as source file (affects internal resolution))\n"
+        "    -R [resample rate(s) / auto]         (default: same as source file (affects internal resolution))\n"
+        "    -g [channels per resample thread]    (default: all channels on one thread)\n"
+        "    -k [loop cache limit in MiB]         (default: 256)\n"
+        "    -d [number of decoder threads]       (default: 1)\n"
         "    -l [enable/disable loop]             (default: value in source audio or false)\n"
         "    -s [loop start sample]               (default: value in source audio or 0)\n"
         "    -t [loop start timestamp]            (default: value in source audio or 0)\n"
         "    -e [loop end sample / total samples] (default: number of samples in source file)\n"
         "    -f [loop end timestamp / total time] (default: length of source audio)\n"
+        "    --start [first sample]               (default: 0, skips everything before it without decoding where possible)\n"
+        "    --start-time [first timestamp]       (default: 0)\n"
+        "    --append [input file]                (play after the input, looping from its start; repeatable)\n"
         "    -c [number of channels in sequence]  (default: same as source file)\n"
         "    -u [mute scale of sequence]          (default: 63)\n"
         "    -v [master volume of sequence]       (default: 127)\n"
@@ -100,39 +125,46 @@ void printHelp() {
         "    -y                                   (don't generate sequence file)\n"
         "    -z                                   (don't generate soundbank file)\n"
         "    -h                                   (show help text)\n"
+        "    --stats [text / json]                (print timing, throughput and memory statistics)\n"
+        "    --cache                              (skip conversion if input, arguments and outputs are unchanged)\n"
+        "    --vadpcm                             (write VADPCM compressed .aifc streams instead of .aiff)\n"
+        "    --subsongs                           (convert every subsong of a multi-stream container)\n"
+        "    --resampler [builtin / swr]          (default: builtin)\n"
+        "    --resample-quality [preset]          (draft / default / high, default: default)\n"
+        "    --bandwidth-loss [dB]                (default: 60, energy -R auto may cut off per channel)\n"
+        "    --map [channels]                     (write only these input channels, in this order, e.g. 0,1,4)\n"
+        "    --mix [mono / stereo / matrix]       (downmix channels, e.g. stereo or 0+0.7*2,1+0.7*2)\n"
+        "    --prune-silence [peak dBFS]          (drop channels that never get louder than this)\n"
+        "    --auto-mono [dB]                     (write stereo as one centered stream if L-R stays this far below L+R)\n"
+        "\n"
+        "BATCH MODE\n"
+        "    " + parsedExeName + " -b [input file / glob] [optional arguments]\n"
+        "    " + parsedExeName + " -B [job file] [optional arguments]\n"
+        "    -j [number of worker threads]        (default: number of CPU cores)\n"
         "\n"
         "USAGE EXAMPLES\n"
         "    " + parsedExeName + " inputfile.wav -o custom_outfiles -s 158462 -e 7485124\n"
         "    " + parsedExeName + " \"spaces not recommended.wav\" -l 1 -f 1:35.23\n"
         "    " + parsedExeName + " inputfile.brstm -l false -e 0x10000\n"
+        "    " + parsedExeName + " longfile.wav --start-time 40 -f 1:40 -l 1\n"
+        "    " + parsedExeName + " song_intro.ogg --append song_loop.ogg -o song\n"
         "    " + parsedExeName + " inputfile.mp3 -R 32000 -t 0\n"
+        "    " + parsedExeName + " inputfile.mp3 -R 32000,26800,22050\n"
+        "    " + parsedExeName + " inputfile.wav -R auto --bandwidth-loss 50\n"
+        "    " + parsedExeName + " stems.wav --prune-silence -90\n"
+        "    " + parsedExeName + " surround.ac3 --mix 0+0.7*2+0.7*4,1+0.7*2+0.7*5\n"
+        "    " + parsedExeName + " -b \"*.wav\" --auto-mono 40\n"
         "    " + parsedExeName + " custom_soundeffect.wav -y -z\n"
+        "    " + parsedExeName + " -b \"*.wav\" -R 32000 -j 8\n"
+        "    " + parsedExeName + " -B tracks.txt\n"
+        "    " + parsedExeName + " soundbank.awb --subsongs -R 32000\n"
+        "    ffmpeg -i inputfile.mkv -f wav - | " + parsedExeName + " - -o custom_outfiles\n"
         "\n"
         "Note: " + parsedExeName + " uses vgmstream to parse audio. You may need to install ffmpeg for certain conversions to be supported.\n\n";
 
 	printf("%s", print.c_str());
 }
 
-bool is_mono() {
-	return forcedMono;
-}
-
-string get_filename_duplicate() {
-	return duplicateStringName;
-}
-
-void set_filename_duplicate(string duplicate) {
-	duplicateStringName = duplicate;
-	size_t slash = duplicate.find_last_of("/\\");
-	if (slash != string::npos) {
-		duplicateStringName = duplicate.substr(slash+1);
-	}
-}
-
-void print_param_warning(string param) {
-	printf("WARNING: Invalid value used for %s parameter, skipping...\n", param.c_str());
-}
-
 int64_t parse_string_to_number(string input) {
 	transform(input.begin(), input.end(), input.begin(), ::tolower);
 
@@ -150,6 +182,23 @@ int64_t parse_string_to_number(string input) {
 	return (int64_t) strtoll(input.c_str(), NULL, 10);
 }
 
+// Parses a comma separated list of numbers, such as "32000,26800,22050"
+vector<int64_t> parse_number_list(string input) {
+	vector<int64_t> numbers;
+	size_t start = 0;
+
+	while (start <= input.length()) {
+		size_t comma = input.find(',', start);
+		if (comma == string::npos)
+			comma = input.length();
+
+		numbers.push_back(parse_string_to_number(input.substr(start, comma - start)));
+		start = comma + 1;
+	}
+
+	return numbers;
+}
+
 string strip_extension(string inStr) {
 	size_t offsetPeriod = inStr.find_last_of(".");
 	if (offsetPeriod == string::npos)
@@ -176,12 +225,117 @@ string replace_spaces(string inStr) {
 }
 
 
-int parse_input_arguments() {
+int parse_input_arguments(ConversionJob *job, vector<string> cmdArgs, bool *customNewFilename) {
 	bool isPrintHelp = false;
 	int32_t slash, colon;
 
 	for (size_t i = 0; i < cmdArgs.size(); i++) {
 		string arg = cmdArgs.at(i);
+
+		if (arg.compare("--cache") == 0) {
+			job->useBuildCache = true;
+			continue;
+		}
+
+		if (arg.compare("--vadpcm") == 0) {
+			job->encodeVadpcm = true;
+			continue;
+		}
+
+		if (arg.compare("--subsongs") == 0) {
+			job->convertSubsongs = true;
+			continue;
+		}
+
+		if (arg.compare("--resampler") == 0) {
+			i++;
+			if (i == cmdArgs.size())
+				return RETURN_INVALID_ARGS;
+			set_resampler(job, cmdArgs.at(i));
+			continue;
+		}
+
+		if (arg.compare("--resample-quality") == 0) {
+			i++;
+			if (i == cmdArgs.size())
+				return RETURN_INVALID_ARGS;
+			set_resample_quality(job, cmdArgs.at(i));
+			continue;
+		}
+
+		if (arg.compare("--bandwidth-loss") == 0) {
+			i++;
+			if (i == cmdArgs.size())
+				return RETURN_INVALID_ARGS;
+			set_bandwidth_loss(job, parse_string_to_number(cmdArgs.at(i)));
+			continue;
+		}
+
+		if (arg.compare("--start") == 0) {
+			i++;
+			if (i == cmdArgs.size())
+				return RETURN_INVALID_ARGS;
+			set_start_samples(job, parse_string_to_number(cmdArgs.at(i)));
+			continue;
+		}
+
+		if (arg.compare("--start-time") == 0) {
+			i++;
+			if (i == cmdArgs.size())
+				return RETURN_INVALID_ARGS;
+			set_start_timestamp(job, cmdArgs.at(i));
+			continue;
+		}
+
+		if (arg.compare("--append") == 0) {
+			i++;
+			if (i == cmdArgs.size())
+				return RETURN_INVALID_ARGS;
+			add_appended_input(job, cmdArgs.at(i));
+			continue;
+		}
+
+		if (arg.compare("--map") == 0) {
+			i++;
+			if (i == cmdArgs.size())
+				return RETURN_INVALID_ARGS;
+			set_channel_map(job, cmdArgs.at(i));
+			continue;
+		}
+
+		if (arg.compare("--mix") == 0) {
+			i++;
+			if (i == cmdArgs.size())
+				return RETURN_INVALID_ARGS;
+			set_channel_mix(job, cmdArgs.at(i));
+			continue;
+		}
+
+		if (arg.compare("--prune-silence") == 0) {
+			i++;
+			if (i == cmdArgs.size())
+				return RETURN_INVALID_ARGS;
+			set_silence_threshold(job, parse_string_to_number(cmdArgs.at(i)));
+			continue;
+		}
+
+		if (arg.compare("--auto-mono") == 0) {
+			i++;
+			if (i == cmdArgs.size())
+				return RETURN_INVALID_ARGS;
+			set_auto_mono_tolerance(job, parse_string_to_number(cmdArgs.at(i)));
+			continue;
+		}
+
+		if (arg.compare("--stats") == 0) {
+			i++;
+			if (i == cmdArgs.size())
+				return RETURN_INVALID_ARGS;
+			if (!set_stats_format(&job->stats, cmdArgs.at(i)))
+				print_param_warning(job, "stats format");
+			continue;
+		}
+
 		if (arg.length() != 2 || arg[0] != '-')
 			return RETURN_INVALID_ARGS;
 
@@ -191,16 +345,16 @@ int parse_input_arguments() {
 		// Standalone arguments
 		switch (argVal) {
 		case 'm':
-			forcedMono = true;
+			job->forcedMono = true;
 			continue;
 		case 'x':
-			generateStreams = false;
+			job->generateStreams = false;
 			continue;
 		case 'y':
-			generateSequence = false;
+			job->generateSequence = false;
 			continue;
 		case 'z':
-			generateSoundbank = false;
+			job->generateSoundbank = false;
 			continue;
 		case 'h':
 			isPrintHelp = true;
@@ -225,50 +379,59 @@ int parse_input_arguments() {
 
 			if (arg.find("*") != string::npos || arg.find("?") != string::npos || arg.find("\"") != string::npos || colon > slash
 				|| arg.find("<") != string::npos || arg.find(">") != string::npos || arg.find("|") != string::npos) {
-				printf("WARNING: Output filename \"%s\" contains illegal format/characters. Output argument will be ignored.\n", arg.c_str());
+				job_printf(job, "WARNING: Output filename \"%s\" contains illegal format/characters. Output argument will be ignored.\n", arg.c_str());
 			} else {
 				if (arg.find_last_of("/\\") + 1 == arg.length()) {
-					if (newFilename.find_last_of("/\\") != string::npos)
-						arg += newFilename.substr(newFilename.find_last_of("/\\") + 1, newFilename.length());
+					if (job->outFilename.find_last_of("/\\") != string::npos)
+						arg += job->outFilename.substr(job->outFilename.find_last_of("/\\") + 1, job->outFilename.length());
 					else
-						arg += newFilename;
+						arg += job->outFilename;
 				}
-				newFilename = arg;
+				job->outFilename = arg;
 			}
 
-			customNewFilename = true;
+			*customNewFilename = true;
 			break;
 		case 'r':
-			if (argValNoCase == 'R')
-				set_resample_rate(parse_string_to_number(arg));
+			if (argValNoCase == 'R' && arg.compare("auto") == 0)
+				set_auto_resample_rate(job);
+			else if (argValNoCase == 'R')
+				set_resample_rates(job, parse_number_list(arg));
 			else
-				set_sample_rate(parse_string_to_number(arg));
+				set_sample_rate(job, parse_string_to_number(arg));
+			break;
+		case 'g':
+			set_resample_group_size(job, parse_string_to_number(arg));
+			break;
+		case 'k':
+			set_loop_cache_limit(job, parse_string_to_number(arg));
+			break;
+		case 'd':
+			set_decode_threads(job, parse_string_to_number(arg));
 			break;
 		case 'l':
-			set_enable_loop(parse_string_to_number(arg));
+			set_enable_loop(job, parse_string_to_number(arg));
 			break;
 		case 's':
-			set_loop_start_samples(parse_string_to_number(arg));
+			set_loop_start_samples(job, parse_string_to_number(arg));
 			break;
 		case 't':
-			set_loop_start_timestamp(arg);
+			set_loop_start_timestamp(job, arg);
 			break;
 		case 'e':
-			set_loop_end_samples(parse_string_to_number(arg));
+			set_loop_end_samples(job, parse_string_to_number(arg));
 			break;
 		case 'f':
-			set_loop_end_timestamp(arg);
+			set_loop_end_timestamp(job, arg);
 			break;
 		case 'c':
-			if (seq_set_num_channels(parse_string_to_number(arg))) {
-                channelCountOverride = parse_string_to_number(arg);
-            }
+			seq_set_num_channels(job, parse_string_to_number(arg));
 			break;
 		case 'u':
-			seq_set_mute_scale(parse_string_to_number(arg));
+			seq_set_mute_scale(job, parse_string_to_number(arg));
 			break;
 		case 'v':
-			seq_set_master_volume(parse_string_to_number(arg));
+			seq_set_master_volume(job, parse_string_to_number(arg));
 			break;
 		default:
 			return RETURN_INVALID_ARGS;
@@ -281,76 +444,135 @@ int parse_input_arguments() {
 	return RETURN_SUCCESS;
 }
 
-int get_vgmstream_properties(const char *inFilename) {
-	inFileProperties = init_vgmstream(inFilename);
-	printf("Opening %s for reading...", inFilename);
-	fflush(stdout);
+// Sets up a job from its arguments, without running it yet
+static int prepare_job(ConversionJob *job, string inFilename, vector<string> args, bool isBatchJob, int subsong) {
+	bool customNewFilename = false;
 
-	if (!inFileProperties) {
-		FILE *invalidFile = fopen(inFilename, "r");
-		if (invalidFile == NULL) {
-			printf("...FAILED!\nERROR: Input file cannot be found or opened!\n");
-			return RETURN_CANNOT_FIND_INPUT_FILE;
-		}
-		fclose(invalidFile);
+	job->inFilename = inFilename;
+	job->subsong = subsong;
+	job->isBatchJob = isBatchJob;
+	job->outFilename = (is_stdin_input(inFilename) ? "stdin" : inFilename);
 
-		printf("...FAILED!\nERROR: Input file is not a valid audio file!\nIf you believe this is a fluke, please make sure you have the proper audio libraries installed.\n");
-		printf("Alternatively, you can convert the input file to WAV (16-bit) separately and try again.\n");
-		return RETURN_INVALID_INPUT_FILE;
+	int ret = parse_input_arguments(job, args, &customNewFilename);
+	if (ret) {
+		if (!isBatchJob)
+			printHelp();
+		return ret;
 	}
 
-	if (inFileProperties->channels <= 0) {
-		printf("...FAILED!\nERROR: Audio must have at least 1 channel!\nCONTAINS: %d channels\n", inFileProperties->channels);
-		close_vgmstream(inFileProperties);
-		return RETURN_NOT_ENOUGH_CHANNELS;
+	job->outFilename = replace_spaces(job->outFilename);
+
+	if (!customNewFilename)
+		job->outFilename = strip_extension(job->outFilename);
+
+	return RETURN_SUCCESS;
+}
+
+static bool claim_output_name(ConversionJob *job) {
+	if (batch_claim_output_name(job->outFilename))
+		return true;
+
+	job_printf(job, "ERROR: Output filename \"%s\" is already used by another job in this batch!\n", job->outFilename.c_str());
+	return false;
+}
+
+/**
+ * Converts the input once per resample rate, each into its own set of files named after the output filename followed by the rate.
+ * Every job runs on its own thread, with a single decode feeding all of them; a job that isn't running would hold back all others.
+ * Each job's output is printed in one piece once it's done, or appended to log if set.
+ */
+static int run_resample_rates(string inFilename, vector<string> args, string outFilename, vector<int64_t> rates, int subsong, string *log) {
+	size_t numJobs = rates.size();
+	ConversionJob *jobs = new (nothrow) ConversionJob[numJobs];
+	if (jobs == nullptr) {
+		log_printf(log, "ERROR: Out of memory!\n");
+		return RETURN_STREAM_OUT_OF_MEMORY;
 	}
 
-	if (inFileProperties->channels > (int) NUM_CHANNELS_MAX) {
-		printf("...FAILED!\nERROR: Audio file exceeds maximum of %d channels!\nCONTAINS: %d channels\n", (int) NUM_CHANNELS_MAX, inFileProperties->channels);
-		close_vgmstream(inFileProperties);
-		return RETURN_TOO_MANY_CHANNELS;
+	SharedDecode sharedDecode(numJobs);
+	vector<int> results(numJobs, RETURN_SUCCESS);
+	vector<thread> threads;
+
+	log_printf(log, "Converting %s at %d resample rates from a single decode...\n\n", inFilename.c_str(), (int) numJobs);
+
+	for (size_t i = 0; i < numJobs; i++) {
+		vector<string> rateArgs = args;
+		rateArgs.push_back("-R");
+		rateArgs.push_back(to_string(rates[i]));
+		rateArgs.push_back("-o");
+		rateArgs.push_back(outFilename + "_" + to_string(rates[i]));
+
+		jobs[i].bufferLog = true;
+		results[i] = prepare_job(&jobs[i], inFilename, rateArgs, true, subsong);
+		if (!results[i] && !claim_output_name(&jobs[i]))
+			results[i] = RETURN_INVALID_ARGS;
+
+		if (results[i]) {
+			shared_decode_finish(&sharedDecode, i);
+			log_printf(log, "%s", jobs[i].log.c_str());
+			continue;
+		}
+
+		jobs[i].sharedDecode = &sharedDecode;
+		jobs[i].sharedDecodeIndex = i;
+
+		threads.emplace_back([&, i]() {
+			results[i] = run_conversion_job(&jobs[i]);
+			shared_decode_finish(&sharedDecode, i);
+			log_printf(log, "%s", jobs[i].log.c_str());
+		});
 	}
 
-	// Currently using bitflags to represent channels serves no purpose, but it may be easier to automate for decomp soundbank optimization in the future.
-    gInstFlags = (1ULL << inFileProperties->channels) - 1ULL;
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
 
-	printf("...SUCCESS!\n");
+	int ret = RETURN_SUCCESS;
+	for (size_t i = 0; i < numJobs; i++) {
+		if (results[i] == RETURN_SUCCESS)
+			continue;
 
-	return RETURN_SUCCESS;
+		log_printf(log, "FAILED: %s at %d Hz (error code %d)\n", inFilename.c_str(), (int) rates[i], results[i]);
+		if (ret == RETURN_SUCCESS)
+			ret = results[i];
+	}
+
+	delete[] jobs;
+
+	return ret;
 }
 
+static int run_file_job(ConversionJob *job, string inFilename, vector<string> args, bool isBatchJob, int subsong) {
+	int ret = prepare_job(job, inFilename, args, isBatchJob, subsong);
+	if (ret)
+		return ret;
 
-void print_seq_channels(uint16_t instFlags) {
-	uint8_t numChannels = 0;
+	if (job->convertSubsongs && subsong == 0)
+		return run_subsongs(inFilename, args, job->outFilename, isBatchJob, (job->bufferLog ? &job->log : NULL));
 
-	for (uint8_t i = 0; i < (uint8_t) NUM_CHANNELS_MAX; i++)
-		if (instFlags & (1 << i))
-			numChannels++;
+	if (job->resampleRates.size() > 1)
+		return run_resample_rates(inFilename, args, job->outFilename, job->resampleRates, subsong, (job->bufferLog ? &job->log : NULL));
 
-    if (channelCountOverride != 0 && (generateSequence && !(generateSoundbank && generateStreams))) {
-        numChannels = channelCountOverride;
-    }
+	if (isBatchJob && !claim_output_name(job))
+		return RETURN_INVALID_ARGS;
 
-	printf("\n");
+	ret = run_conversion_job(job);
+	if (!isBatchJob && ((ret >= RETURN_CANNOT_FIND_INPUT_FILE && ret <= RETURN_TOO_MANY_CHANNELS) || ret == RETURN_INVALID_CHANNEL_MAP || ret == RETURN_APPENDED_INPUT_MISMATCH))
+		printHelp();
 
-	printf("    Number of Channels: %d", numChannels);
-    if (channelCountOverride != 0 && channelCountOverride != numChannels) {
-        printf(" (Sequence: %d)", channelCountOverride);
-	} else if (!forcedMono) {
-		if (numChannels == 1)
-			printf(" (mono)");
-		else if (numChannels == 2)
-			printf(" (stereo)");
+	return ret;
+}
 
-	}
-	printf("\n");
+// With a log, everything printed for the conversion is appended to it once done, so conversions running at the same time don't mix up their output
+int convert_file(string inFilename, vector<string> args, bool isBatchJob, int subsong, string *log) {
+	ConversionJob job;
+	job.bufferLog = (log != NULL);
 
-    string timestamp = seq_get_duration_print();
-    if (timestamp.size() > 0) {
-	    printf("    Sequence Duration: %s\n", timestamp.c_str());
-    }
+	int ret = run_file_job(&job, inFilename, args, isBatchJob, subsong);
 
-	printf("\n");
+	if (log != NULL)
+		log_printf(log, "%s", job.log.c_str());
+
+	return ret;
 }
 
 int main(int argc, char **argv) {
@@ -370,50 +592,18 @@ int main(int argc, char **argv) {
 		return RETURN_NOT_ENOUGH_ARGS;
 	}
 
-	newFilename = argv[1];
-
+	vector<string> args;
 	for (int i = 2; i < argc; i++)
-		cmdArgs.emplace_back(argv[i]);
-
-	int ret = parse_input_arguments();
-	if (ret) {
-		printHelp();
-		return ret;
-	}
-
-	newFilename = replace_spaces(newFilename);
+		args.emplace_back(argv[i]);
 
-	if (!customNewFilename)
-		newFilename = strip_extension(newFilename);
+	if (is_batch_argument(argv[1])) {
+		args.insert(args.begin(), argv[1]);
 
-	ret = get_vgmstream_properties(argv[1]);
-	if (ret) {
-		printHelp();
+		int ret = run_batch(args);
+		if (ret == RETURN_INVALID_ARGS || ret == RETURN_BATCH_NO_JOBS)
+			printHelp();
 		return ret;
 	}
 
-	ret = generate_new_streams(inFileProperties, newFilename, argv[1], generateStreams);
-	if (!ret && !generateStreams)
-		print_seq_channels(gInstFlags);
-
-	if (generateSequence) {
-		if (!ret)
-			ret = generate_new_sequence(newFilename, gInstFlags);
-		else
-			generate_new_sequence(newFilename, gInstFlags);
-	}
-
-	if (generateSoundbank) {
-		if (!ret)
-			ret = generate_new_soundbank(newFilename, gInstFlags);
-		else
-			generate_new_soundbank(newFilename, gInstFlags);
-	}
-
-	close_vgmstream(inFileProperties);
-
-	if (!(generateStreams || generateSequence || generateSoundbank))
-		printf("No files to generate!\n");
-
-	return ret;
+	return convert_file(argv[1], args, false);
 }
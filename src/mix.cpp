@@ -0,0 +1,192 @@
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+#include "main.hpp"
+#include "mix.hpp"
+#include "kernels.hpp"
+
+using namespace std;
+
+ChannelMix::ChannelMix() {
+	spec = "";
+	outputChannels = 0;
+	foldChannels = 0;
+	inputChannels = 0;
+}
+
+static vector<string> split_string(string input, char separator) {
+	vector<string> parts;
+	size_t start = 0;
+
+	while (start <= input.length()) {
+		size_t end = input.find(separator, start);
+		if (end == string::npos)
+			end = input.length();
+
+		parts.push_back(input.substr(start, end - start));
+		start = end + 1;
+	}
+
+	return parts;
+}
+
+static bool parse_channel_index(string input, int *channel) {
+	char *end = NULL;
+	long value = strtol(input.c_str(), &end, 10);
+	if (input.empty() || *end != '\0' || value < 0 || value >= (long) NUM_CHANNELS_MAX)
+		return false;
+
+	*channel = (int) value;
+	return true;
+}
+
+bool parse_channel_map(string spec, ChannelMix *mix) {
+	ChannelMix parsed;
+	vector<string> outputs = split_string(spec, ',');
+	if (outputs.size() > NUM_CHANNELS_MAX)
+		return false;
+
+	for (size_t i = 0; i < outputs.size(); i++) {
+		int channel;
+		if (!parse_channel_index(outputs[i], &channel))
+			return false;
+
+		parsed.terms.push_back(vector<pair<int, double>>(1, make_pair(channel, 1.0)));
+	}
+
+	parsed.spec = "map:" + spec;
+	parsed.outputChannels = (int) outputs.size();
+	*mix = parsed;
+	return true;
+}
+
+bool parse_channel_mix(string spec, ChannelMix *mix) {
+	ChannelMix parsed;
+	parsed.spec = "mix:" + spec;
+
+	if (spec.compare("mono") == 0 || spec.compare("stereo") == 0) {
+		parsed.foldChannels = (spec.compare("mono") == 0 ? 1 : 2);
+		parsed.outputChannels = parsed.foldChannels;
+		*mix = parsed;
+		return true;
+	}
+
+	vector<string> outputs = split_string(spec, ',');
+	if (outputs.size() > NUM_CHANNELS_MAX)
+		return false;
+
+	for (size_t i = 0; i < outputs.size(); i++) {
+		vector<string> terms = split_string(outputs[i], '+');
+		vector<pair<int, double>> output;
+
+		for (size_t j = 0; j < terms.size(); j++) {
+			double gain = 1.0;
+			string channelStr = terms[j];
+
+			size_t star = terms[j].find('*');
+			if (star != string::npos) {
+				string gainStr = terms[j].substr(0, star);
+				char *end = NULL;
+				gain = strtod(gainStr.c_str(), &end);
+				if (gainStr.empty() || *end != '\0' || !(fabs(gain) <= MIX_GAIN_MAX))
+					return false;
+				channelStr = terms[j].substr(star + 1);
+			}
+
+			int channel;
+			if (!parse_channel_index(channelStr, &channel))
+				return false;
+
+			output.push_back(make_pair(channel, gain));
+		}
+
+		parsed.terms.push_back(output);
+	}
+
+	parsed.outputChannels = (int) outputs.size();
+	*mix = parsed;
+	return true;
+}
+
+/**
+ * The mono preset averages every channel. The stereo preset averages even channels into the left and odd ones into the right,
+ * which is how interleaved stereo pairs (and the usual L/R first layouts) are laid out; a mono input goes to both sides.
+ */
+bool resolve_channel_mix(ChannelMix *mix, int inputChannels) {
+	if (mix->outputChannels == 0)
+		return true;
+
+	vector<vector<pair<int, double>>> terms = mix->terms;
+	if (mix->foldChannels > 0) {
+		terms.assign((size_t) mix->foldChannels, vector<pair<int, double>>());
+		for (int c = 0; c < inputChannels; c++) {
+			int output = (inputChannels == 1 ? 0 : c % mix->foldChannels);
+			int sources = (inputChannels == 1 ? 1 : (inputChannels - output + mix->foldChannels - 1) / mix->foldChannels);
+			terms[output].push_back(make_pair(c, 1.0 / sources));
+		}
+		if (inputChannels == 1 && mix->foldChannels == 2)
+			terms[1] = terms[0];
+	}
+
+	mix->inputChannels = inputChannels;
+	mix->matrix.assign((size_t) mix->outputChannels * inputChannels, 0);
+
+	for (int i = 0; i < mix->outputChannels; i++) {
+		for (size_t j = 0; j < terms[i].size(); j++) {
+			if (terms[i][j].first >= inputChannels)
+				return false;
+
+			// Terms on the same channel add up
+			double gain = terms[i][j].second * (double) (1 << MIX_GAIN_BITS);
+			mix->matrix[(size_t) i * inputChannels + terms[i][j].first] += (int32_t) lround(gain);
+		}
+	}
+
+	return true;
+}
+
+// Averaging the gains themselves gives the same matrix as the mono preset for decoded channels, and a centered mix of any other layout
+void fold_channel_mix_to_mono(ChannelMix *mix, int inputChannels) {
+	int outputs = (mix->outputChannels > 0 ? mix->outputChannels : inputChannels);
+	vector<int32_t> matrix((size_t) inputChannels, 0);
+
+	for (int i = 0; i < outputs; i++) {
+		for (int c = 0; c < inputChannels; c++) {
+			if (mix->outputChannels > 0)
+				matrix[c] += mix->matrix[(size_t) i * inputChannels + c];
+			else if (i == c)
+				matrix[c] += 1 << MIX_GAIN_BITS;
+		}
+	}
+
+	mix->terms.assign(1, vector<pair<int, double>>());
+	for (int c = 0; c < inputChannels; c++) {
+		matrix[c] = (int32_t) lround((double) matrix[c] / outputs);
+		if (matrix[c] != 0)
+			mix->terms[0].push_back(make_pair(c, (double) matrix[c] / (1 << MIX_GAIN_BITS)));
+	}
+
+	mix->outputChannels = 1;
+	mix->foldChannels = 0;
+	mix->inputChannels = inputChannels;
+	mix->matrix = matrix;
+}
+
+int render_mixed_vgmstream(sample_t *buffer, int32_t sampleCount, VGMSTREAM *vgmstream, const ChannelMix *mix) {
+	if (mix == NULL || mix->outputChannels == 0)
+		return render_vgmstream(buffer, sampleCount, vgmstream);
+
+	sample_t decoded[MIX_CHUNK_FRAMES * NUM_CHANNELS_MAX];
+	int rendered = 0;
+
+	for (int32_t position = 0; position < sampleCount; position += MIX_CHUNK_FRAMES) {
+		int32_t frames = min((int32_t) MIX_CHUNK_FRAMES, sampleCount - position);
+
+		rendered += render_vgmstream(decoded, frames, vgmstream);
+		mix_channels_16(decoded, mix->inputChannels, &buffer[(size_t) position * mix->outputChannels], mix->outputChannels,
+		 mix->matrix.data(), (uint32_t) frames);
+	}
+
+	return rendered;
+}
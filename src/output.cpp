@@ -0,0 +1,177 @@
+#include <string.h>
+#include <new>
+
+#include "output.hpp"
+
+#ifdef OUTPUT_MMAP
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+OutputFile::OutputFile() {
+	file = NULL;
+	mapping = NULL;
+	fd = -1;
+	size = 0;
+	offset = 0;
+	inMemory = false;
+}
+
+#ifdef OUTPUT_MMAP
+// Returns false if the file isn't mapped, with noSpace set if there's no room for it at all, so falling back to stdio would be pointless
+static bool output_map(OutputFile *out, string filename, bool *noSpace) {
+	out->fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (out->fd < 0)
+		return false;
+
+	// Reserve every block now so the file doesn't get fragmented by many small appends. Filesystems that can't only get the size set.
+	int ret = -1;
+	errno = ENOSYS;
+#ifdef __linux__
+	if (out->size > 0)
+		ret = fallocate(out->fd, 0, 0, (off_t) out->size);
+#endif
+	if (ret != 0 && (errno == EOPNOTSUPP || errno == ENOSYS))
+		ret = ftruncate(out->fd, (off_t) out->size);
+	*noSpace = (ret != 0 && (errno == ENOSPC || errno == EDQUOT || errno == EFBIG));
+
+	if (ret == 0) {
+		void *mapping = mmap(NULL, out->size, PROT_READ | PROT_WRITE, MAP_SHARED, out->fd, 0);
+		if (mapping != MAP_FAILED) {
+			out->mapping = (uint8_t*) mapping;
+			return true;
+		}
+	}
+
+	close(out->fd);
+	out->fd = -1;
+	if (*noSpace)
+		unlink(filename.c_str());
+	return false;
+}
+#endif
+
+// Returns false if the file can't be created, or the disk doesn't have room for size bytes of it
+bool output_open(OutputFile *out, string filename, size_t size) {
+	out->size = size;
+	out->offset = 0;
+
+#ifdef OUTPUT_MMAP
+	bool noSpace = false;
+	if (output_map(out, filename, &noSpace))
+		return true;
+	if (noSpace)
+		return false;
+#endif
+
+	out->file = fopen(filename.c_str(), "wb");
+	return out->file != NULL;
+}
+
+bool output_open_memory(OutputFile *out, size_t size) {
+	out->size = size;
+	out->offset = 0;
+	out->mapping = new (nothrow) uint8_t[size];
+	out->inMemory = (out->mapping != NULL);
+
+	return out->inMemory;
+}
+
+void output_write(OutputFile *out, const void *data, size_t length) {
+	if (out->mapping != NULL) {
+		if (out->offset + length > out->size)
+			length = out->size - out->offset;
+		memcpy(out->mapping + out->offset, data, length);
+		out->offset += length;
+		return;
+	}
+
+	fwrite(data, 1, length, out->file);
+	out->offset += length;
+}
+
+// Returns where the next `length` bytes go inside the mapping, or NULL if they have to be passed to output_write instead.
+uint8_t *output_reserve(OutputFile *out, size_t length) {
+	if (out->mapping == NULL || out->offset + length > out->size)
+		return NULL;
+
+	return out->mapping + out->offset;
+}
+
+// Commits bytes that were written in place through output_reserve.
+void output_advance(OutputFile *out, size_t length) {
+	out->offset += length;
+}
+
+/**
+ * Appends length bytes of another file starting at offset, letting the kernel copy them without passing through user space.
+ * Returns false if that isn't supported here or the copy stopped short, in which case the data has to be written normally.
+ * Anything copied so far simply gets overwritten then, since the output offset only moves on success.
+ */
+bool output_copy_from(OutputFile *out, int fd, int64_t offset, size_t length) {
+#if defined(OUTPUT_MMAP) && defined(__linux__)
+	if (out->inMemory || out->fd < 0 || fd < 0 || out->offset + length > out->size)
+		return false;
+
+	off64_t inOffset = (off64_t) offset;
+	off64_t outOffset = (off64_t) out->offset;
+	size_t done = 0;
+
+	while (done < length) {
+		ssize_t ret = copy_file_range(fd, &inOffset, out->fd, &outOffset, length - done, 0);
+		if (ret <= 0)
+			break;
+		done += (size_t) ret;
+	}
+
+	if (done < length)
+		return false;
+
+	out->offset += length;
+	return true;
+#else
+	(void) out;
+	(void) fd;
+	(void) offset;
+	(void) length;
+	return false;
+#endif
+}
+
+bool output_is_mapped(OutputFile *out) {
+	return out->mapping != NULL;
+}
+
+void output_close(OutputFile *out) {
+	if (out->inMemory) {
+		delete[] out->mapping;
+		out->mapping = NULL;
+		out->inMemory = false;
+		return;
+	}
+
+#ifdef OUTPUT_MMAP
+	if (out->mapping != NULL) {
+		munmap(out->mapping, out->size);
+		out->mapping = NULL;
+
+		// Don't leave preallocated garbage behind if writing stopped early
+		if (out->offset < out->size && ftruncate(out->fd, (off_t) out->offset) != 0)
+			printf("WARNING: Could not truncate unfinished output file!\n");
+	}
+
+	if (out->fd >= 0) {
+		close(out->fd);
+		out->fd = -1;
+	}
+#endif
+
+	if (out->file != NULL) {
+		fclose(out->file);
+		out->file = NULL;
+	}
+}
@@ -0,0 +1,424 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <tuple>
+#include <algorithm>
+
+#ifdef STRM64_SWRESAMPLE
+extern "C" {
+#include "libswresample/swresample.h"
+#include "libavutil/opt.h"
+}
+#endif
+
+#include "resampler.hpp"
+#include "kernels.hpp"
+#include "main.hpp"
+#include "job.hpp"
+
+using namespace std;
+
+/**
+ * Filter settings of each quality preset, the same design for both engines. Filter size is in taps when upsampling and gets
+ * stretched by the ratio when downsampling. Cutoff is the passband edge relative to the lower of the two Nyquist frequencies.
+ * The built-in engine runs all three at about the same speed, its work per output sample barely depends on the filter size.
+ */
+struct ResamplerPreset {
+	int filterSize;
+	int phaseShift; // log2 of the phases interpolated between, for ratios that can't use exact ones
+	double cutoff;
+	double kaiserBeta;
+	bool soxr; // swr only: hand resampling over to libsoxr, at the given precision in bits
+	double soxrPrecision;
+};
+
+static const ResamplerPreset gPresets[] = {
+	{16, 8, 0.90, 7.0, false, 0.0},    // draft: a much wider transition band, as little as -33 dB stopband
+	{32, 10, 0.97, 9.0, false, 0.0},   // default: libswresample's own defaults
+	{64, 12, 0.98, 10.0, true, 28.0}   // high: a much narrower transition band
+};
+
+/**
+ * Coefficients of every phase of a windowed sinc filter for one ratio, upFactor / downFactor in lowest terms.
+ * Phase p holds the filter for output samples falling p / numPhases of the way past an input sample.
+ * With interpolation, one extra phase is stored so that the last phase has a neighbor to interpolate towards.
+ */
+struct PolyphaseFilter {
+	int64_t upFactor;
+	int64_t downFactor;
+	int numPhases;
+	bool interpolate;
+	int taps; // Per phase, rounded up so the vector kernels never need a scalar remainder
+	int coefBits; // Fraction bits of coefs, 15 unless a phase's gains add up to too much for a full scale input to fit 32 bits
+	int16_t *coefs;
+};
+
+struct Resampler {
+	ResamplerEngine engine;
+	int channels;
+#ifdef STRM64_SWRESAMPLE
+	struct SwrContext *swrContext;
+#endif
+
+	const PolyphaseFilter *filter;
+	sample_t *historyData;
+	sample_t *history[NUM_CHANNELS_MAX]; // Buffered input of each channel, the first of which starts the window of the next output sample
+	size_t capacity; // Samples per channel
+	size_t filled;
+	size_t position;
+	int64_t phase; // How far the next output sample is past history[position + taps / 2 - 1], in 1 / upFactor
+};
+
+static mutex gFilterLock;
+static map<tuple<int64_t, int64_t, int>, PolyphaseFilter*> gFilters; // Never freed, there's only ever a handful of ratios in use
+
+static int64_t greatest_common_divisor(int64_t a, int64_t b) {
+	while (b != 0) {
+		int64_t t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser window
+static double bessel_i0(double x) {
+	double sum = 1.0, term = 1.0;
+
+	for (int k = 1; k < 64 && term > sum * 1e-17; k++) {
+		term *= (x * x) / (4.0 * k * k);
+		sum += term;
+	}
+
+	return sum;
+}
+
+static PolyphaseFilter *build_polyphase_filter(const ResamplerPreset *preset, int64_t upFactor, int64_t downFactor) {
+	PolyphaseFilter *filter = new (nothrow) PolyphaseFilter;
+	if (filter == nullptr)
+		return NULL;
+
+	// Downsampling has to cut off below the output Nyquist frequency instead, which takes a proportionally longer filter
+	double factor = min(1.0, (double) upFactor / (double) downFactor);
+	int taps = (int) ceil(preset->filterSize / factor);
+	taps = (taps + 15) & ~15;
+
+	filter->upFactor = upFactor;
+	filter->downFactor = downFactor;
+	filter->interpolate = (upFactor > RESAMPLER_MAX_PHASES);
+	filter->numPhases = (filter->interpolate ? 1 << preset->phaseShift : (int) upFactor);
+	filter->taps = taps;
+
+	int rows = filter->numPhases + (filter->interpolate ? 1 : 0);
+	filter->coefs = new (nothrow) int16_t[(size_t) rows * taps];
+	double *gains = new (nothrow) double[(size_t) rows * taps];
+	if (filter->coefs == nullptr || gains == nullptr) {
+		delete[] filter->coefs;
+		delete[] gains;
+		delete filter;
+		return NULL;
+	}
+
+	double cutoff = preset->cutoff * factor;
+	double halfLength = taps / 2;
+	double windowNorm = bessel_i0(preset->kaiserBeta);
+	double largestNorm = 0.0;
+
+	for (int p = 0; p < rows; p++) {
+		double *row = &gains[(size_t) p * taps];
+		double sum = 0.0, norm = 0.0;
+
+		for (int t = 0; t < taps; t++) {
+			double x = (double) (t - (taps / 2 - 1)) - (double) p / filter->numPhases;
+			double w = x / halfLength;
+			double window = (w * w < 1.0 ? bessel_i0(preset->kaiserBeta * sqrt(1.0 - w * w)) / windowNorm : 0.0);
+			double sinc = (x == 0.0 ? 1.0 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x));
+
+			row[t] = cutoff * sinc * window;
+			sum += row[t];
+		}
+
+		// Unity gain at DC for every phase, so steady signals don't pick up a ripple at the phase period
+		for (int t = 0; t < taps; t++) {
+			row[t] /= sum;
+			norm += fabs(row[t]);
+		}
+		largestNorm = max(largestNorm, norm);
+	}
+
+	/**
+	 * A full scale input matching the signs of a phase sums up to 32768 times its quantized L1 norm, which has to stay within the
+	 * 32-bit accumulators of dot_products_16. Long filters go past a norm of 2 at 15 bits, so they drop bits until even the
+	 * worst case rounding (half a step per tap) fits.
+	 */
+	filter->coefBits = 15;
+	while (filter->coefBits > 1 && largestNorm * (double) (1 << filter->coefBits) + taps * 0.5 > (double) (INT32_MAX / 32768))
+		filter->coefBits--;
+
+	double scale = (double) (1 << filter->coefBits);
+	for (size_t i = 0; i < (size_t) rows * taps; i++)
+		filter->coefs[i] = (int16_t) max(-32767.0, min(32767.0, round(gains[i] * scale)));
+
+	delete[] gains;
+	return filter;
+}
+
+static const PolyphaseFilter *get_polyphase_filter(ResamplerQuality quality, int32_t inRate, int32_t outRate) {
+	int64_t divisor = greatest_common_divisor(outRate, inRate);
+	tuple<int64_t, int64_t, int> key((int64_t) outRate / divisor, (int64_t) inRate / divisor, (int) quality);
+
+	lock_guard<mutex> guard(gFilterLock);
+
+	map<tuple<int64_t, int64_t, int>, PolyphaseFilter*>::iterator it = gFilters.find(key);
+	if (it != gFilters.end())
+		return it->second;
+
+	PolyphaseFilter *filter = build_polyphase_filter(&gPresets[quality], get<0>(key), get<1>(key));
+	if (filter != NULL)
+		gFilters[key] = filter;
+
+	return filter;
+}
+
+static bool reserve_history(Resampler *resampler, size_t samples) {
+	if (resampler->filled + samples <= resampler->capacity)
+		return true;
+
+	size_t capacity = max(resampler->capacity * 2, resampler->filled + samples);
+	sample_t *historyData = new (nothrow) sample_t[capacity * resampler->channels];
+	if (historyData == nullptr)
+		return false;
+
+	for (int c = 0; c < resampler->channels; c++) {
+		if (resampler->filled > 0)
+			memcpy(&historyData[capacity * c], resampler->history[c], resampler->filled * sizeof(sample_t));
+		resampler->history[c] = &historyData[capacity * c];
+	}
+
+	delete[] resampler->historyData;
+	resampler->historyData = historyData;
+	resampler->capacity = capacity;
+
+	return true;
+}
+
+static inline sample_t round_fixed(int64_t value, int bits) {
+	value = (value + ((int64_t) 1 << (bits - 1))) >> bits;
+	return (sample_t) max((int64_t) -32768, min((int64_t) 32767, value));
+}
+
+static int polyphase_convert(Resampler *resampler, sample_t **outputs, int outputSamples, const sample_t *input, int inputSamples) {
+	const PolyphaseFilter *filter = resampler->filter;
+	int channels = resampler->channels;
+	size_t taps = (size_t) filter->taps;
+
+	// Drop whatever no output sample needs anymore before appending
+	if (resampler->position > 0) {
+		for (int c = 0; c < channels; c++)
+			memmove(resampler->history[c], resampler->history[c] + resampler->position, (resampler->filled - resampler->position) * sizeof(sample_t));
+		resampler->filled -= resampler->position;
+		resampler->position = 0;
+	}
+
+	if (!reserve_history(resampler, (size_t) inputSamples))
+		return -1;
+
+	sample_t *appendAt[NUM_CHANNELS_MAX];
+	for (int c = 0; c < channels; c++)
+		appendAt[c] = resampler->history[c] + resampler->filled;
+	deinterleave_16(input, appendAt, channels, (uint32_t) inputSamples);
+	resampler->filled += (size_t) inputSamples;
+
+	int32_t sums[NUM_CHANNELS_MAX];
+	int32_t nextSums[NUM_CHANNELS_MAX];
+	int produced = 0;
+	while (produced < outputSamples && resampler->position + taps <= resampler->filled) {
+		if (!filter->interpolate) {
+			dot_products_16(resampler->history, resampler->position, channels, &filter->coefs[(size_t) resampler->phase * taps], (int) taps, sums);
+			for (int c = 0; c < channels; c++)
+				outputs[c][produced] = round_fixed(sums[c], filter->coefBits);
+		} else {
+			// Linear interpolation between the two nearest of the stored phases
+			int64_t scaledPhase = resampler->phase * filter->numPhases;
+			int64_t index = scaledPhase / filter->upFactor;
+			int64_t fraction = scaledPhase % filter->upFactor;
+			const int16_t *coefs = &filter->coefs[(size_t) index * taps];
+
+			dot_products_16(resampler->history, resampler->position, channels, coefs, (int) taps, sums);
+			dot_products_16(resampler->history, resampler->position, channels, coefs + taps, (int) taps, nextSums);
+			for (int c = 0; c < channels; c++)
+				outputs[c][produced] = round_fixed(sums[c] + ((int64_t) nextSums[c] - sums[c]) * fraction / filter->upFactor, filter->coefBits);
+		}
+
+		resampler->phase += filter->downFactor;
+		resampler->position += (size_t) (resampler->phase / filter->upFactor);
+		resampler->phase %= filter->upFactor;
+		produced++;
+	}
+
+	return produced;
+}
+
+#ifdef STRM64_SWRESAMPLE
+static atomic<bool> gWarnedSoxr(false);
+
+static struct SwrContext *create_swr_context(const ResamplerPreset *preset, bool useSoxr, int channels, int32_t inRate, int32_t outRate) {
+	// Works with 18 channels maximum probably, TODO: research whether different bitflags affect how a thing is resampled if it matters for some reason
+	uint64_t channelLayout = (1ULL << channels) - 1;
+#if LIBSWRESAMPLE_VERSION_INT >= AV_VERSION_INT(4, 5, 100) // swr_alloc_set_opts got deprecated here, and removed with FFmpeg 7
+	AVChannelLayout layout;
+	av_channel_layout_from_mask(&layout, channelLayout);
+	struct SwrContext *context = NULL;
+	int ret = swr_alloc_set_opts2(&context, &layout, AV_SAMPLE_FMT_S16P, outRate, &layout, AV_SAMPLE_FMT_S16, inRate, 0, NULL);
+	av_channel_layout_uninit(&layout);
+	if (ret < 0 || context == NULL)
+		return NULL;
+#else
+	struct SwrContext *context = swr_alloc_set_opts(NULL, (int64_t) channelLayout, AV_SAMPLE_FMT_S16P, outRate,
+		(int64_t) channelLayout, AV_SAMPLE_FMT_S16, inRate, 0, NULL);
+	if (context == NULL)
+		return NULL;
+#endif
+
+	av_opt_set_int(context, "filter_size", preset->filterSize, 0);
+	av_opt_set_int(context, "phase_shift", preset->phaseShift, 0);
+	av_opt_set_double(context, "cutoff", preset->cutoff, 0);
+	av_opt_set_double(context, "kaiser_beta", preset->kaiserBeta, 0);
+	if (useSoxr) {
+		av_opt_set_int(context, "resampler", SWR_ENGINE_SOXR, 0);
+		av_opt_set_double(context, "precision", preset->soxrPrecision, 0);
+	}
+
+	if (swr_init(context) != 0 || swr_is_initialized(context) == 0) {
+		swr_free(&context);
+		return NULL;
+	}
+
+	return context;
+}
+#endif
+
+Resampler *resampler_create(ResamplerEngine engine, ResamplerQuality quality, int channels, int32_t inRate, int32_t outRate, string *log) {
+	if (channels <= 0 || channels > (int) NUM_CHANNELS_MAX || inRate <= 0 || outRate <= 0 || !resampler_engine_available(engine))
+		return NULL;
+
+	Resampler *resampler = new (nothrow) Resampler();
+	if (resampler == nullptr)
+		return NULL;
+
+	resampler->engine = engine;
+	resampler->channels = channels;
+
+#ifdef STRM64_SWRESAMPLE
+	if (engine == RESAMPLER_SWR) {
+		const ResamplerPreset *preset = &gPresets[quality];
+		resampler->swrContext = create_swr_context(preset, preset->soxr, channels, inRate, outRate);
+
+		// soxr is an optional part of libswresample, without it the same filter settings are used with swr's own engine
+		if (resampler->swrContext == NULL && preset->soxr) {
+			resampler->swrContext = create_swr_context(preset, false, channels, inRate, outRate);
+			if (resampler->swrContext != NULL && !gWarnedSoxr.exchange(true))
+				log_printf(log, "WARNING: libswresample was built without soxr, resampling with its own engine instead...\n");
+		}
+
+		if (resampler->swrContext == NULL) {
+			resampler_free(&resampler);
+			return NULL;
+		}
+
+		return resampler;
+	}
+#endif
+
+	resampler->filter = get_polyphase_filter(quality, inRate, outRate);
+	if (resampler->filter == NULL) {
+		resampler_free(&resampler);
+		return NULL;
+	}
+
+	// Primed with half a window of silence, which centers the first output sample on the first input sample
+	if (!reserve_history(resampler, (size_t) resampler->filter->taps * 2)) {
+		resampler_free(&resampler);
+		return NULL;
+	}
+	memset(resampler->historyData, 0, resampler->capacity * channels * sizeof(sample_t));
+	resampler->filled = (size_t) (resampler->filter->taps / 2 - 1);
+
+	return resampler;
+}
+
+void resampler_free(Resampler **resampler) {
+	if (*resampler == NULL)
+		return;
+
+#ifdef STRM64_SWRESAMPLE
+	if ((*resampler)->swrContext != NULL)
+		swr_free(&(*resampler)->swrContext);
+#endif
+
+	delete[] (*resampler)->historyData;
+	delete *resampler;
+	*resampler = NULL;
+}
+
+// Upper bound of the output samples the next call to resampler_convert may produce from the given input
+int resampler_get_out_samples(Resampler *resampler, int inSamples) {
+#ifdef STRM64_SWRESAMPLE
+	if (resampler->engine == RESAMPLER_SWR)
+		return swr_get_out_samples(resampler->swrContext, inSamples);
+#endif
+
+	int64_t available = (int64_t) (resampler->filled - resampler->position) + inSamples;
+	return (int) (available * resampler->filter->upFactor / resampler->filter->downFactor + 1);
+}
+
+// Returns the number of output samples written to each of the outputs, or a negative value on failure
+int resampler_convert(Resampler *resampler, sample_t **outputs, int outputSamples, const sample_t *input, int inputSamples) {
+#ifdef STRM64_SWRESAMPLE
+	if (resampler->engine == RESAMPLER_SWR)
+		return swr_convert(resampler->swrContext, (uint8_t**) outputs, outputSamples, (const uint8_t**) &input, inputSamples);
+#endif
+
+	return polyphase_convert(resampler, outputs, outputSamples, input, inputSamples);
+}
+
+bool resampler_engine_available(ResamplerEngine engine) {
+#ifdef STRM64_SWRESAMPLE
+	if (engine == RESAMPLER_SWR)
+		return true;
+#endif
+
+	return (engine == RESAMPLER_BUILTIN);
+}
+
+bool parse_resampler_engine(string name, ResamplerEngine *engine) {
+	transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+	if (name.compare("builtin") == 0)
+		*engine = RESAMPLER_BUILTIN;
+	else if (name.compare("swr") == 0)
+		*engine = RESAMPLER_SWR;
+	else
+		return false;
+
+	return true;
+}
+
+bool parse_resampler_quality(string name, ResamplerQuality *quality) {
+	transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+	if (name.compare("draft") == 0)
+		*quality = RESAMPLE_QUALITY_DRAFT;
+	else if (name.compare("default") == 0)
+		*quality = RESAMPLE_QUALITY_DEFAULT;
+	else if (name.compare("high") == 0)
+		*quality = RESAMPLE_QUALITY_HIGH;
+	else
+		return false;
+
+	return true;
+}
@@ -0,0 +1,101 @@
+#include "segment.hpp"
+
+// Smallest unit a codec decodes on its own: frame bytes per channel and the samples they hold
+struct CodecFrame {
+	int bytes;
+	int samples;
+	SegmentSeekType seekType;
+};
+
+static bool get_codec_frame(coding_t codingType, CodecFrame *frame) {
+	switch (codingType) {
+	case coding_PCM16LE:
+	case coding_PCM16BE:
+		*frame = {2, 1, SEGMENT_SEEK_EXACT};
+		return true;
+	case coding_PCM8:
+	case coding_PCM8_U:
+	case coding_PCM8_SB:
+	case coding_ULAW:
+	case coding_ALAW:
+		*frame = {1, 1, SEGMENT_SEEK_EXACT};
+		return true;
+	case coding_PCMFLOAT:
+		*frame = {4, 1, SEGMENT_SEEK_EXACT};
+		return true;
+	case coding_PSX:
+		*frame = {0x10, 28, SEGMENT_SEEK_WARMUP};
+		return true;
+	case coding_NGC_DSP:
+		*frame = {0x08, 14, SEGMENT_SEEK_WARMUP};
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * Only flat and plain interleaved layouts are supported, since their read position follows directly from the sample position.
+ * Headered blocks, segments and layers all carry state that would have to be parsed from the start of the file.
+ */
+SegmentSeekType get_segment_seek_type(VGMSTREAM *vgmstream) {
+	CodecFrame frame;
+	if (!get_codec_frame(vgmstream->coding_type, &frame))
+		return SEGMENT_SEEK_NONE;
+
+	if (vgmstream->layout_type == layout_none)
+		return frame.seekType;
+
+	if (vgmstream->layout_type == layout_interleave && vgmstream->interleave_first_block_size == 0 && vgmstream->interleave_first_skip == 0 &&
+	 vgmstream->interleave_block_size > 0 && vgmstream->interleave_block_size % frame.bytes == 0)
+		return frame.seekType;
+
+	return SEGMENT_SEEK_NONE;
+}
+
+// Where decoding has to start for the decoder state to be settled by the given sample. Always on a frame boundary.
+int32_t get_segment_warmup_start(VGMSTREAM *vgmstream, int32_t sample) {
+	CodecFrame frame;
+	if (!get_codec_frame(vgmstream->coding_type, &frame) || frame.seekType != SEGMENT_SEEK_WARMUP)
+		return sample;
+
+	int32_t start = sample - SEGMENT_WARMUP_SAMPLES;
+	if (start <= 0)
+		return 0;
+
+	return start - (start % frame.samples);
+}
+
+/**
+ * Moves a freshly opened VGMSTREAM to the given sample without decoding anything before it.
+ * For warm-up codecs the decoder history is left as it was at the start of the stream, so the first samples will be off.
+ */
+bool position_vgmstream(VGMSTREAM *vgmstream, int32_t sample) {
+	if (sample == 0)
+		return true;
+
+	CodecFrame frame;
+	if (get_segment_seek_type(vgmstream) == SEGMENT_SEEK_NONE || !get_codec_frame(vgmstream->coding_type, &frame))
+		return false;
+	if (vgmstream->current_sample != 0 || sample < 0 || sample >= vgmstream->num_samples)
+		return false;
+
+	if (vgmstream->layout_type == layout_interleave) {
+		int32_t blockSamples = (int32_t) (vgmstream->interleave_block_size / frame.bytes) * frame.samples;
+		int32_t blocks = sample / blockSamples;
+
+		// A shorter last block is only switched to when the decoder reaches it by itself
+		if (vgmstream->interleave_last_block_size && (int64_t) (blocks + 1) * blockSamples > vgmstream->num_samples)
+			return false;
+
+		for (int i = 0; i < vgmstream->channels; i++)
+			vgmstream->ch[i].offset += (off_t) blocks * (off_t) vgmstream->interleave_block_size * vgmstream->channels;
+
+		vgmstream->samples_into_block = sample - blocks * blockSamples;
+	} else {
+		vgmstream->samples_into_block = sample;
+	}
+
+	vgmstream->current_sample = sample;
+	return true;
+}
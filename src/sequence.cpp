@@ -1,7 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include "main.hpp"
+#include "job.hpp"
 #include "sequence.hpp"
 #include "stream.hpp"
 
@@ -11,9 +13,6 @@ using namespace std;
 #define TIMESTAMP_DELAY 6 // NOTE: Cannot be less than 1
 #define MAX_DURATION (0x7FFF - TIMESTAMP_DELAY) // NOTE: Must be a bit less than max int64_t value, as additional timestamps are tacked on to the end of this.
 
-#define MUTE_SCALE_DEFAULT 0x3F
-#define MASTER_VOLUME_DEFAULT 0x7F
-
 // These must be changed when manually adding/removing fields
 #define SEQ_HEADER_SIZE 0x17 // Exclusive of looping branch and Channel Pointer commands
 #define CHN_HEADER_SIZE 0x13
@@ -21,37 +20,31 @@ using namespace std;
 #define ABS_PTR_SIZE 0x03
 
 
-static uint8_t gNumChannels = 0;
-static int8_t gMuteScale = MUTE_SCALE_DEFAULT;
-static uint8_t gMasterVolume = MASTER_VOLUME_DEFAULT;
-static uint8_t gTempo = 0;
-static int16_t gTimestamp = -1;
-
-static string warnings = "";
-
-
-SEQHeader::SEQHeader(uint16_t instFlags, uint8_t numChannels) {
+SEQHeader::SEQHeader(ConversionJob *conversionJob, uint16_t instFlags, uint8_t numChannels) {
+	job = conversionJob;
 	channelFlags = instFlags;
 	channelCount = numChannels;
-	muteScale = gMuteScale;
-	volume = gMasterVolume;
+	muteScale = job->muteScale;
+	volume = job->masterVolume;
 }
 SEQHeader::~SEQHeader() {
 
 }
 
-CHNHeader::CHNHeader(uint8_t channelIndex, uint8_t instId, uint8_t numChannels) {
+// Panned by the stream channel the instrument plays rather than by channelIndex, so channels keep their side when others got dropped
+CHNHeader::CHNHeader(ConversionJob *conversionJob, uint8_t channelIndex, uint8_t instId, uint8_t streamChannels) {
+	job = conversionJob;
 	channelId = channelIndex;
 	instrument = instId;
 	
 	// TODO: make channel panning overrideable
-	if (is_mono()) {
+	if (job->forcedMono) {
 		pan = 0x3F;
 	} else {
-		if (channelIndex % 2) { // right channel
+		if (instId % 2) { // right channel
 			pan = 0x7F;
 		} else { // left/mono channel
-			if (channelIndex + 1 == numChannels) // mono channel
+			if (instId + 1 == streamChannels) // mono channel
 				pan = 0x3F;
 			else // left channel
 				pan = 0x00;
@@ -62,21 +55,25 @@ CHNHeader::~CHNHeader() {
 
 }
 
-SEQFile::SEQFile(string fname, uint16_t instFlags, uint8_t numChannels) {
+SEQFile::SEQFile(ConversionJob *conversionJob, string fname, uint16_t instFlags, uint8_t numChannels) {
+	job = conversionJob;
 	filename = fname;
 	channelCount = numChannels;
 	channelFlags = instFlags;
 
+	// Channels written to the streams, including any dropped since; a sequence channel count set by hand replaces them
+	uint8_t streamChannels = (job->seqNumChannels == 0 && job->streamChannels > 0 ? job->streamChannels : numChannels);
+
 	chnHeader = new CHNHeader*[numChannels];
 	for (uint8_t i = 0, j = 0; j < numChannels; i++) {
 		if (!((1 << i) & instFlags))
 			continue;
 
-		chnHeader[j] = new CHNHeader(j, i, numChannels);
+		chnHeader[j] = new CHNHeader(job, j, i, streamChannels);
 		j++;
 	}
 
-	seqhead = new SEQHeader(instFlags, numChannels);
+	seqhead = new SEQHeader(job, instFlags, numChannels);
 }
 SEQFile::~SEQFile() {
 	delete seqhead;
@@ -85,79 +82,75 @@ SEQFile::~SEQFile() {
 	delete[] chnHeader;
 }
 
-string seq_get_duration_print() {
-	if (gTimestamp < 0)
+string seq_get_duration_print(ConversionJob *job) {
+	if (job->timestamp < 0)
 		return "";
 
-	if (gTempo == 0)
-		gTempo = 1;
+	if (job->tempo == 0)
+		job->tempo = 1;
 
 	// Timestamp * 60 seconds / (BPM * tatums per beat), result in microseconds
-	return print_timestamp(1000000 * (uint64_t) gTimestamp * 60 / (48 * (uint64_t) gTempo));
+	return print_timestamp(1000000 * (uint64_t) job->timestamp * 60 / (48 * (uint64_t) job->tempo));
 }
 
-void seq_set_timestamp_duration(long double duration120BPM) {
-	gTempo = 120;
+void seq_set_timestamp_duration(ConversionJob *job, long double duration120BPM) {
+	job->tempo = 120;
 	if (ceil(duration120BPM) <= MAX_DURATION) {
 		// No tempo change needed from 120 BPM, grab value ceiling and return
-		gTimestamp = (int16_t) ceil(duration120BPM);
+		job->timestamp = (int16_t) ceil(duration120BPM);
 		return;
 	}
 
-	gTempo = (120 * MAX_DURATION) / duration120BPM;
+	job->tempo = (120 * MAX_DURATION) / duration120BPM;
 
-	if (gTempo < 1) {
+	if (job->tempo < 1) {
 		// Too long, just play sequence file forever (tbf the music needs to be over 11 hours long for this to happen)
-		gTempo = 0;
-		gTimestamp = -1;
+		job->tempo = 0;
+		job->timestamp = -1;
 		return;
 	}
 
-	int64_t newDuration = ceil(duration120BPM * gTempo / 120.0);
+	int64_t newDuration = ceil(duration120BPM * job->tempo / 120.0);
 	if (newDuration > MAX_DURATION) {
-		printf("FATAL WARNING: Miscalculation in seq_set_timestamp_duration function!\n");
+		job_printf(job, "FATAL WARNING: Miscalculation in seq_set_timestamp_duration function!\n");
 		newDuration = MAX_DURATION;
 	}
 
-	gTimestamp = newDuration;
-}
-
-uint8_t seq_get_num_channels() {
-	return gNumChannels;
+	job->timestamp = newDuration;
 }
 
-bool seq_set_num_channels(int64_t numChannels) {
+bool seq_set_num_channels(ConversionJob *job, int64_t numChannels) {
 	if (numChannels <= 0 || numChannels > (int64_t) NUM_CHANNELS_MAX) {
-		print_param_warning("sequence channel count");
+		print_param_warning(job, "sequence channel count");
 		return false;
 	}
 
-	gNumChannels = (uint8_t) numChannels;
+	job->seqNumChannels = (uint8_t) numChannels;
 
 	return true;
 }
 
-void seq_set_mute_scale(int64_t muteScale) {
+void seq_set_mute_scale(ConversionJob *job, int64_t muteScale) {
 	if (muteScale < -128 || muteScale > 255) {
-		print_param_warning("sequence mute scale");
+		print_param_warning(job, "sequence mute scale");
 		return;
 	}
 	if (muteScale > 127)
 		muteScale -= 256;
 
-	gMuteScale = (int8_t) muteScale;
+	job->muteScale = (int8_t) muteScale;
 }
 
-void seq_set_master_volume(int64_t volume) {
+void seq_set_master_volume(ConversionJob *job, int64_t volume) {
 	if (volume < 0 || volume > 255) {
-		print_param_warning("sequence master volume");
+		print_param_warning(job, "sequence master volume");
 		return;
 	}
 	if (volume > 127) {
-		printf("WARNING: It is not recommended to set a sequence channel volume greater than 127!\n");
+		job_printf(job, "WARNING: It is not recommended to set a sequence channel volume greater than 127!\n");
 	}
 
-	gMasterVolume = (uint8_t) volume;
+	job->masterVolume = (uint8_t) volume;
 }
 
 void SEQHeader::write_seq_header(FILE *seqFile, uint16_t seqHeaderSize) {
@@ -220,16 +213,16 @@ void SEQHeader::write_seq_header(FILE *seqFile, uint16_t seqHeaderSize) {
 
 	// Set tempo (SM64 only allows a minimum tempo of 1 in vanilla, but this value will still be compatible. Modding it to support a tempo of 0 is very easy and recommended, but not that important.)
 	header[headerPtr++] = SEQ_TEMPO;
-	if (gTimestamp >= 0) // If not looping
-		header[headerPtr++] = gTempo;
+	if (job->timestamp >= 0) // If not looping
+		header[headerPtr++] = job->tempo;
 	else
 		header[headerPtr++] = 0x00;
 
 	// Wait for ideally an indefinite amount of time (or at least as indefinite as possible)
 	header[headerPtr++] = SEQ_TIMESTAMP;
-	if (gTimestamp >= 0) {
-		header[headerPtr++] = (uint8_t) ((uint16_t) gTimestamp >> 8) | 0x80;
-		header[headerPtr++] = (uint8_t) ((uint16_t) gTimestamp & 0xFF);
+	if (job->timestamp >= 0) {
+		header[headerPtr++] = (uint8_t) ((uint16_t) job->timestamp >> 8) | 0x80;
+		header[headerPtr++] = (uint8_t) ((uint16_t) job->timestamp & 0xFF);
 	} else {
 		header[headerPtr++] = (uint8_t) ((uint16_t) MAX_DURATION >> 8) | 0x80;
 		header[headerPtr++] = (uint8_t) ((uint16_t) MAX_DURATION & 0xFF);
@@ -238,7 +231,7 @@ void SEQHeader::write_seq_header(FILE *seqFile, uint16_t seqHeaderSize) {
 	/* Almost everything past this point is unnecessary if looping, but still here just in case. */
 
 	// Loop back to channel pointers. If adding/removing anything from this header, the following value should be updated accordingly.
-	if (gTimestamp < 0) {
+	if (job->timestamp < 0) {
 		header[headerPtr++] = SEQ_BRANCH_ABS_ALWAYS; // Loop sequence to address of first channel pointer
 		header[headerPtr++] = 0x00;
 		header[headerPtr++] = 0x09;
@@ -254,8 +247,8 @@ void SEQHeader::write_seq_header(FILE *seqFile, uint16_t seqHeaderSize) {
 
 	// If these values don't match, then something is wrong!
 	if (seqHeaderSize != headerPtr) {
-		warnings += "FATAL WARNING! Precalculated sequence header size does not match output! Your output sequence may not work!\n";
-		warnings += "EXPECTED: " + to_string(seqHeaderSize) + " bytes, ACTUAL: " + to_string(headerPtr) + " bytes\n";
+		job->warnings += "FATAL WARNING! Precalculated sequence header size does not match output! Your output sequence may not work!\n";
+		job->warnings += "EXPECTED: " + to_string(seqHeaderSize) + " bytes, ACTUAL: " + to_string(headerPtr) + " bytes\n";
 	}
 
 	// Write sequence header to file
@@ -305,9 +298,9 @@ void CHNHeader::write_chn_header(FILE *seqFile, uint8_t channelCount, uint16_t s
 
 	// Set channel timestamp to ideally an indefinite amount of time (or at least as indefinite as possible)
 	header[headerPtr++] = CHN_TIMESTAMP;
-	if (gTimestamp >= 0) {
-		header[headerPtr++] = (uint8_t) ((uint16_t) (gTimestamp + TIMESTAMP_DELAY) >> 8) | 0x80;
-		header[headerPtr++] = (uint8_t) ((uint16_t) (gTimestamp + TIMESTAMP_DELAY) & 0xFF);
+	if (job->timestamp >= 0) {
+		header[headerPtr++] = (uint8_t) ((uint16_t) (job->timestamp + TIMESTAMP_DELAY) >> 8) | 0x80;
+		header[headerPtr++] = (uint8_t) ((uint16_t) (job->timestamp + TIMESTAMP_DELAY) & 0xFF);
 	} else {
 		header[headerPtr++] = (uint8_t) ((uint16_t) (MAX_DURATION + TIMESTAMP_DELAY) >> 8) | 0x80;
 		header[headerPtr++] = (uint8_t) ((uint16_t) (MAX_DURATION + TIMESTAMP_DELAY) & 0xFF);
@@ -318,8 +311,8 @@ void CHNHeader::write_chn_header(FILE *seqFile, uint8_t channelCount, uint16_t s
 
 	// If these values don't match, then something is wrong!
 	if (CHN_HEADER_SIZE != headerPtr) {
-		warnings += "FATAL WARNING! Precalculated channel header size does not match output! Your output sequence may not work!\n";
-		warnings += "EXPECTED: " + to_string(CHN_HEADER_SIZE) + " bytes, ACTUAL: " + to_string(headerPtr) + " bytes\n";
+		job->warnings += "FATAL WARNING! Precalculated channel header size does not match output! Your output sequence may not work!\n";
+		job->warnings += "EXPECTED: " + to_string(CHN_HEADER_SIZE) + " bytes, ACTUAL: " + to_string(headerPtr) + " bytes\n";
 	}
 
 	// Write sequence header to file
@@ -344,9 +337,9 @@ void SEQFile::write_trk_header(FILE *seqFile) {
 
 	// Play note with timestamp and velocity 
 	data[dataPtr++] = TRK_NOTE_TV + 0x27; // Middle C
-	if (gTimestamp >= 0) {
-		data[dataPtr++] = (uint8_t) ((uint16_t) (gTimestamp + 1) >> 8) | 0x80;
-		data[dataPtr++] = (uint8_t) ((uint16_t) (gTimestamp + 1) & 0xFF);
+	if (job->timestamp >= 0) {
+		data[dataPtr++] = (uint8_t) ((uint16_t) (job->timestamp + 1) >> 8) | 0x80;
+		data[dataPtr++] = (uint8_t) ((uint16_t) (job->timestamp + 1) & 0xFF);
 	} else {
 		data[dataPtr++] = (uint8_t) ((uint16_t) (MAX_DURATION + 1) >> 8) | 0x80;
 		data[dataPtr++] = (uint8_t) ((uint16_t) (MAX_DURATION + 1) & 0xFF);
@@ -358,8 +351,8 @@ void SEQFile::write_trk_header(FILE *seqFile) {
 
 	// If these values don't match, then something is wrong!
 	if (TRK_HEADER_SIZE != dataPtr) {
-		warnings += "FATAL WARNING! Precalculated track data size does not match output! Your output sequence may not work!\n";
-		warnings += "EXPECTED: " + to_string(TRK_HEADER_SIZE) + " bytes, ACTUAL: " + to_string(dataPtr) + " bytes\n";
+		job->warnings += "FATAL WARNING! Precalculated track data size does not match output! Your output sequence may not work!\n";
+		job->warnings += "EXPECTED: " + to_string(TRK_HEADER_SIZE) + " bytes, ACTUAL: " + to_string(dataPtr) + " bytes\n";
 	}
 
 	// Write track data to file
@@ -372,7 +365,7 @@ void SEQFile::write_trk_header(FILE *seqFile) {
 int SEQFile::write_sequence() {
 	FILE *seqFile;
 
-	printf("Generating sequence file...");
+	job_printf(job, "Generating sequence file...");
 	fflush(stdout);
 
 	string tmpFilename = this->filename;
@@ -384,14 +377,14 @@ int SEQFile::write_sequence() {
 
 	seqFile = fopen(tmpFilename.c_str(), "wb");
 	if (seqFile == NULL) {
-		printf("...FAILED!\nERROR: Could not open %s for writing!\n", this->filename.c_str());
+		job_printf(job, "...FAILED!\nERROR: Could not open %s for writing!\n", this->filename.c_str());
 		return RETURN_SEQUENCE_CANNOT_CREATE_FILE;
 	}
 
-	warnings = "";
+	job->warnings = "";
 
 	uint16_t seqHeaderSize = (uint16_t) (SEQ_HEADER_SIZE + channelCount * ABS_PTR_SIZE); // Size of SEQ header
-	if (gTimestamp < 0) { // If looping
+	if (job->timestamp < 0) { // If looping
 		seqHeaderSize += 3;
 	}
 
@@ -404,17 +397,18 @@ int SEQFile::write_sequence() {
 	write_trk_header(seqFile);
 
 	fclose(seqFile);
+	job->outputFiles.push_back(tmpFilename);
 
-	printf("...DONE!\n");
-	printf("%s", warnings.c_str());
+	job_printf(job, "...DONE!\n");
+	job_printf(job, "%s", job->warnings.c_str());
 
 	return RETURN_SUCCESS;
 }
 
-int generate_new_sequence(string filename, uint16_t instFlags) {
+int generate_new_sequence(ConversionJob *job, string filename, uint16_t instFlags) {
 	uint8_t numChannels = 0;
 
-	if (gNumChannels == 0) {
+	if (job->seqNumChannels == 0) {
 		for (uint8_t i = 0; i < NUM_CHANNELS_MAX; i++) {
 			if (!((1 << i) & instFlags))
 				continue;
@@ -422,14 +416,14 @@ int generate_new_sequence(string filename, uint16_t instFlags) {
 			numChannels++;
 		}
 	} else {
-		numChannels = gNumChannels;
+		numChannels = job->seqNumChannels;
 		instFlags = (1ULL << numChannels) - 1ULL;
 	}
 
 	if (numChannels == 0)
 		return RETURN_SEQUENCE_NO_CHANNELS;
 
-	SEQFile sequence(filename, instFlags, numChannels);
+	SEQFile sequence(job, filename, instFlags, numChannels);
 
 	return sequence.write_sequence();
 }
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 
 #include "main.hpp"
+#include "job.hpp"
 
 using namespace std;
 
@@ -19,7 +20,7 @@ string generate_bank_start() {
 		"    \"instruments\": {\n";
 }
 
-string generate_instrument_strings(string bankStr, string filename, uint16_t instFlags, uint8_t numChannels) {
+string generate_instrument_strings(ConversionJob *job, string bankStr, string filename, uint16_t instFlags, uint8_t numChannels) {
 	string instruments = "";
 	string instList = "    \"instrument_list\": [\n";
 
@@ -44,24 +45,25 @@ string generate_instrument_strings(string bankStr, string filename, uint16_t ins
 			"            \"envelope\": \"envelope0\",\n"
 			"            \"sound\": \"";
 
+		// Streams are named after their channel index, which silent channels dropped from instFlags no longer line up with
 		string newFilename = filename;
 		
-		if (numChannels == 2 && !is_mono()) {
-			if (j == 0) {
+		if (job->streamChannels == 2 && !job->forcedMono) {
+			if (i == 0) {
 				newFilename += "_L";
 			} else {
 				newFilename += "_R";
 			}
-		} else if (numChannels != 1) {
+		} else if (job->streamChannels != 1) {
 			newFilename += '_';
 
-			char index = (j & 0x0F) + 48;
+			char index = (i & 0x0F) + 48;
 			if (index >= 58)
 				index += 7;
 			newFilename += index;
 		}
 
-		if (newFilename.compare(get_filename_duplicate()) == 0) {
+		if (newFilename.compare(job->duplicateFilename) == 0) {
 			newFilename += "_0";
 		}
 
@@ -86,10 +88,10 @@ string generate_instrument_strings(string bankStr, string filename, uint16_t ins
 	return instruments + instList;
 }
 
-int write_to_soundbank(string filename, uint16_t instFlags, uint8_t numChannels) {
+int write_to_soundbank(ConversionJob *job, string filename, uint16_t instFlags, uint8_t numChannels) {
 	FILE *seqBank;
 
-	printf("Generating soundbank file...");
+	job_printf(job, "Generating soundbank file...");
 	fflush(stdout);
 
 	string shortFilename;
@@ -106,23 +108,24 @@ int write_to_soundbank(string filename, uint16_t instFlags, uint8_t numChannels)
 
 	seqBank = fopen(tmpFilename.c_str(), "wb");
 	if (seqBank == NULL) {
-		printf("...FAILED!\nERROR: Could not open %s for writing!\n", filename.c_str());
+		job_printf(job, "...FAILED!\nERROR: Could not open %s for writing!\n", filename.c_str());
 		return RETURN_SOUNDBANK_CANNOT_CREATE_FILE;
 	}
 
 	string bankStr = generate_bank_start();
-	bankStr += generate_instrument_strings(bankStr, shortFilename, instFlags, numChannels);
+	bankStr += generate_instrument_strings(job, bankStr, shortFilename, instFlags, numChannels);
 
 	fwrite(bankStr.c_str(), 1, bankStr.length(), seqBank); // Not using fprintf here to avoid carriage returns on Windows
 
 	fclose(seqBank);
+	job->outputFiles.push_back(tmpFilename);
 
-	printf("...DONE!\n");
+	job_printf(job, "...DONE!\n");
 
 	return RETURN_SUCCESS;
 }
 
-int generate_new_soundbank(string filename, uint16_t instFlags) {
+int generate_new_soundbank(ConversionJob *job, string filename, uint16_t instFlags) {
 	uint8_t numChannels = 0;
 
 	for (uint8_t i = 0; i < NUM_CHANNELS_MAX; i++) {
@@ -134,5 +137,5 @@ int generate_new_soundbank(string filename, uint16_t instFlags) {
 	if (numChannels == 0)
 		return RETURN_SOUNDBANK_NO_CHANNELS;
 
-	return write_to_soundbank(filename, instFlags, numChannels);
+	return write_to_soundbank(job, filename, instFlags, numChannels);
 }
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <algorithm>
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "stats.hpp"
+#include "job.hpp"
+
+using namespace std;
+
+static const char *stageNames[NUM_STATS_STAGES] = {
+	"decode",
+	"resample",
+	"byteswap",
+	"encode",
+	"write",
+	"streams",
+	"analyze"
+};
+
+ConversionStats::ConversionStats() {
+	format = STATS_DISABLED;
+
+	for (int i = 0; i < NUM_STATS_STAGES; i++)
+		stageNanoseconds[i].store(0);
+
+	samplesDecoded.store(0);
+	samplesResampled.store(0);
+	samplesWritten.store(0);
+	bytesWritten.store(0);
+	inputRequests.store(0);
+	inputReads.store(0);
+	inputBytes.store(0);
+	allocations.store(0);
+	allocatedBytes.store(0);
+}
+
+// Peak resident set size of the whole process in bytes, or 0 if unknown
+uint64_t get_peak_rss() {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return (uint64_t) counters.PeakWorkingSetSize;
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#if defined(__APPLE__)
+	return (uint64_t) usage.ru_maxrss;
+#else
+	return (uint64_t) usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+bool set_stats_format(ConversionStats *stats, string format) {
+	transform(format.begin(), format.end(), format.begin(), ::tolower);
+
+	if (format.compare("text") == 0)
+		stats->format = STATS_TEXT;
+	else if (format.compare("json") == 0)
+		stats->format = STATS_JSON;
+	else
+		return false;
+
+	return true;
+}
+
+static double per_second(uint64_t value, uint64_t nanoseconds) {
+	if (nanoseconds == 0)
+		return 0.0;
+
+	return (double) value * 1000000000.0 / (double) nanoseconds;
+}
+
+static string escape_json(string str) {
+	string escaped = "";
+
+	for (size_t i = 0; i < str.length(); i++) {
+		unsigned char c = (unsigned char) str[i];
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+			escaped += (char) c;
+		} else if (c < 0x20) {
+			char code[8];
+			snprintf(code, sizeof(code), "\\u%04x", c);
+			escaped += code;
+		} else {
+			escaped += (char) c;
+		}
+	}
+
+	return escaped;
+}
+
+void print_stats(ConversionStats *stats, string inFilename, string *log) {
+	if (stats->format == STATS_DISABLED)
+		return;
+
+	uint64_t streamsTime = stats->stageNanoseconds[STATS_STAGE_STREAMS].load();
+	uint64_t decodeTime = stats->stageNanoseconds[STATS_STAGE_DECODE].load();
+	uint64_t resampleTime = stats->stageNanoseconds[STATS_STAGE_RESAMPLE].load();
+	uint64_t peakRss = get_peak_rss();
+
+	if (stats->format == STATS_JSON) {
+		string json = "{\"file\":\"" + escape_json(inFilename) + "\",\"stages\":{";
+		char buffer[256];
+
+		for (int i = 0; i < NUM_STATS_STAGES; i++) {
+			snprintf(buffer, sizeof(buffer), "%s\"%s\":%.6f", (i ? "," : ""), stageNames[i], (double) stats->stageNanoseconds[i].load() / 1e9);
+			json += buffer;
+		}
+
+		snprintf(buffer, sizeof(buffer), "},\"samples_decoded\":%" PRIu64 ",\"samples_resampled\":%" PRIu64 ",\"samples_written\":%" PRIu64,
+		 stats->samplesDecoded.load(), stats->samplesResampled.load(), stats->samplesWritten.load());
+		json += buffer;
+		snprintf(buffer, sizeof(buffer), ",\"decode_samples_per_sec\":%.0f,\"resample_samples_per_sec\":%.0f,\"output_samples_per_sec\":%.0f",
+		 per_second(stats->samplesDecoded.load(), decodeTime), per_second(stats->samplesResampled.load(), resampleTime),
+		 per_second(stats->samplesWritten.load(), streamsTime));
+		json += buffer;
+		snprintf(buffer, sizeof(buffer), ",\"input_requests\":%" PRIu64 ",\"input_reads\":%" PRIu64 ",\"input_bytes\":%" PRIu64,
+		 stats->inputRequests.load(), stats->inputReads.load(), stats->inputBytes.load());
+		json += buffer;
+		snprintf(buffer, sizeof(buffer), ",\"bytes_written\":%" PRIu64 ",\"peak_rss_bytes\":%" PRIu64 ",\"allocations\":%" PRIu64 ",\"allocated_bytes\":%" PRIu64 "}",
+		 stats->bytesWritten.load(), peakRss, stats->allocations.load(), stats->allocatedBytes.load());
+		json += buffer;
+
+		log_printf(log, "%s\n", json.c_str());
+		return;
+	}
+
+	log_printf(log, "\nStatistics for %s:\n", inFilename.c_str());
+	for (int i = 0; i < NUM_STATS_STAGES; i++)
+		log_printf(log, "    %-9s %10.3f ms\n", stageNames[i], (double) stats->stageNanoseconds[i].load() / 1e6);
+	log_printf(log, "    Samples Decoded: %" PRIu64 " (%.0f samples/s)\n", stats->samplesDecoded.load(), per_second(stats->samplesDecoded.load(), decodeTime));
+	if (stats->samplesResampled.load())
+		log_printf(log, "    Samples Resampled: %" PRIu64 " (%.0f samples/s)\n", stats->samplesResampled.load(), per_second(stats->samplesResampled.load(), resampleTime));
+	log_printf(log, "    Samples Written: %" PRIu64 " (%.0f samples/s)\n", stats->samplesWritten.load(), per_second(stats->samplesWritten.load(), streamsTime));
+	log_printf(log, "    Input Reads: %" PRIu64 " requested, %" PRIu64 " from disk (%" PRIu64 " bytes)\n", stats->inputRequests.load(),
+	 stats->inputReads.load(), stats->inputBytes.load());
+	log_printf(log, "    Bytes Written: %" PRIu64 "\n", stats->bytesWritten.load());
+	log_printf(log, "    Peak RSS: %" PRIu64 " KiB\n", peakRss / 1024);
+	log_printf(log, "    Allocations: %" PRIu64 " (%" PRIu64 " bytes)\n\n", stats->allocations.load(), stats->allocatedBytes.load());
+}
@@ -1,10 +1,26 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <inttypes.h>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 #include "main.hpp"
+#include "job.hpp"
 #include "stream.hpp"
 #include "sequence.hpp"
+#include "kernels.hpp"
+#include "pipeline.hpp"
+#include "output.hpp"
+#include "stats.hpp"
+#include "vadpcm.hpp"
+#include "segment.hpp"
+#include "input.hpp"
 #include "bswp.hpp"
+#include "bandwidth.hpp"
 
 using namespace std;
 
@@ -14,6 +30,9 @@ using namespace std;
 #define MARK_HEADER_SIZE 0x20
 #define INST_HEADER_SIZE 0x1C
 #define SSND_PRE_HEADER_SIZE 0x10
+#define AIFC_COMM_HEADER_SIZE 0x2A
+#define AIFC_CODES_HEADER_SIZE 0x1E // Not including the codebook itself
+#define AIFC_LOOPS_HEADER_SIZE 0x48
 
 #define MICROSECOND_DECIMALS 6
 #define TIME_SECOND          1000000LL // microseconds
@@ -22,27 +41,16 @@ using namespace std;
 #define TIME_DAY             (TIME_HOUR * 24)
 
 
-// Override parameters
-static int64_t ovrdSampleRate = -1;
-static int64_t ovrdResampleRate = -1;
-static int64_t ovrdEnableLoop = -1;
-static int64_t ovrdLoopStartSamples = INT64_MAX;
-static int64_t ovrdLoopEndSamples = INT64_MAX;
-static int64_t ovrdLoopStartMicro = INT64_MAX;
-static int64_t ovrdLoopEndMicro = INT64_MAX;
-
-static uint32_t gFileSize = 0;
-
-static long double gSequenceTimestamp = -1.0;
-
-
-AudioOutData::AudioOutData(VGMSTREAM *inFileProperties) {
-	resample = (ovrdResampleRate > 0 ? true : false);
+AudioOutData::AudioOutData(ConversionJob *conversionJob, VGMSTREAM *inFileProperties) {
+	job = conversionJob;
+	resample = (job->ovrdResampleRate > 0 ? true : false);
 	vgmstreamLoopPointMismatch = false; // Only used with data resampling to enforce a manual stream seek
 	sampleRate = inFileProperties->sample_rate;
 	enableLoop = inFileProperties->loop_flag;
 	numSamples = inFileProperties->num_samples;
-	numChannels = inFileProperties->channels;
+	startOffset = 0;
+	numChannels = (job->channelMix.outputChannels > 0 ? job->channelMix.outputChannels : inFileProperties->channels);
+	decodedChannels = numChannels;
 	
 	if (enableLoop) {
 		loopStartSamples = inFileProperties->loop_start_sample;
@@ -60,7 +68,11 @@ AudioOutData::AudioOutData(VGMSTREAM *inFileProperties) {
 	resampledLoopEndSamples = loopEndSamples;
 	resampledNumSamples = numSamples;
 
-	resampleContext = NULL;
+	vadpcmLoopStartSamples = 0;
+	vadpcmLoopEndSamples = 0;
+	vadpcmNumSamples = 0;
+
+	fileSize = 0;
 }
 AudioOutData::~AudioOutData() {
 
@@ -159,62 +171,86 @@ int64_t timestamp_to_us(string timestamp) {
 	return days + hours + minutes + seconds + microseconds;
 }
 
-void AudioOutData::print_header_info() {
-	printf("\n");
+// channelData holds the channels written at their own rate, if any
+void AudioOutData::print_header_info(const vector<AudioOutData> &channelData) {
+	job_printf(job, "\n");
+
+	uint32_t totalFileSize = fileSize * (uint32_t) numChannels;
+	if (!channelData.empty()) {
+		totalFileSize = 0;
+		for (size_t i = 0; i < channelData.size(); i++)
+			totalFileSize += channelData[i].fileSize;
+	}
 
+	const char *format = (job->encodeVadpcm ? "AIFC" : "AIFF");
 	if (numChannels == 1)
-		printf("    File Size of AIFF: %u bytes\n", gFileSize * (uint32_t) numChannels);
+		job_printf(job, "    File Size of %s: %u bytes\n", format, totalFileSize);
 	else
-		printf("    Cumulative File Size of AIFFs: %u bytes\n", gFileSize * (uint32_t) numChannels);
+		job_printf(job, "    Cumulative File Size of %ss: %u bytes\n", format, totalFileSize);
+
+	job_printf(job, "    Sample Rate: %d Hz", resampledSampleRate);
+	if (!resample && job->ovrdSampleRate <= 0 && resampledSampleRate > 32000)
+		job_printf(job, " (Downsampling recommended! [-R 32000])");
+	job_printf(job, "\n");
+
+	if (!channelRates.empty()) {
+		job_printf(job, "    Channel Sample Rates:");
+		for (size_t i = 0; i < channelRates.size(); i++)
+			job_printf(job, "%s %d", (i ? "," : ""), channelRates[i]);
+		job_printf(job, " Hz\n");
+	}
 
-	printf("    Sample Rate: %d Hz", resampledSampleRate);
-	if (!resample && ovrdSampleRate <= 0 && resampledSampleRate > 32000)
-		printf(" (Downsampling recommended! [-R 32000])");
-	printf("\n");
+	if (startOffset > 0) {
+		job_printf(job, "    Start Offset in Source: %d Samples (Time: %s)\n", startOffset,
+			print_timestamp(samples_to_us(startOffset, sampleRate)).c_str());
+	}
 
-	printf("    Is Looped: ");
+	job_printf(job, "    Is Looped: ");
 	if (enableLoop) {
-		printf("true\n");
+		job_printf(job, "true\n");
+
+		int32_t printedLoopStart = (job->encodeVadpcm ? (int32_t) vadpcmLoopStartSamples : resampledLoopStartSamples);
+		int32_t printedLoopEnd = (job->encodeVadpcm ? (int32_t) vadpcmLoopEndSamples : resampledLoopEndSamples);
 
-		printf("    Starting Loop Point: %d Samples (Time: %s)\n", resampledLoopStartSamples,
-			print_timestamp(samples_to_us(resampledLoopStartSamples, resampledSampleRate)).c_str());
+		job_printf(job, "    Starting Loop Point: %d Samples (Time: %s)\n", printedLoopStart,
+			print_timestamp(samples_to_us(printedLoopStart, resampledSampleRate)).c_str());
 
-		printf("    Ending Loop Point: %d Samples (Time: %s)\n", resampledLoopEndSamples,
-			print_timestamp(samples_to_us(resampledLoopEndSamples, resampledSampleRate)).c_str());
+		job_printf(job, "    Ending Loop Point: %d Samples (Time: %s)\n", printedLoopEnd,
+			print_timestamp(samples_to_us(printedLoopEnd, resampledSampleRate)).c_str());
 	} else {
-		printf("false\n");
+		job_printf(job, "false\n");
 
 		int32_t samplesPadded = resampledNumSamples;
 		if (samplesPadded % SAMPLE_COUNT_PADDING)
 			samplesPadded += SAMPLE_COUNT_PADDING - (samplesPadded % SAMPLE_COUNT_PADDING);
-		printf("    End of Stream: %d Samples (Time: %s)\n", samplesPadded,
+		job_printf(job, "    End of Stream: %d Samples (Time: %s)\n", samplesPadded,
 			print_timestamp(samples_to_us(samplesPadded, resampledSampleRate)).c_str());
 	}
 
-	if (gSequenceTimestamp >= 0.0) { // If looping only
-		printf("    Miniseq Duration (For SFX): ");
-		int64_t duration = ceil(gSequenceTimestamp);
+	if (job->sequenceTimestamp >= 0.0) { // If looping only
+		job_printf(job, "    Miniseq Duration (For SFX): ");
+		int64_t duration = ceil(job->sequenceTimestamp);
 		if (duration > 0x7FFF) {
-			printf("N/A (Too long!)\n");
+			job_printf(job, "N/A (Too long!)\n");
 		} else {
-			printf("0x%x\n", (uint32_t) duration);
+			job_printf(job, "0x%x\n", (uint32_t) duration);
 		}
 	}
 
-	uint8_t seqChannelCount = seq_get_num_channels();
-	printf("    Number of Channels: %d", numChannels);
+	uint8_t seqChannelCount = job->seqNumChannels;
+	job_printf(job, "    Number of Channels: %d", numChannels);
 	if (seqChannelCount != 0 && seqChannelCount != numChannels) {
-		printf(" (Sequence: %d)", seqChannelCount);
-	} else if (!is_mono()) {
+		job_printf(job, " (Sequence: %d)", seqChannelCount);
+	} else if (!job->forcedMono) {
 		if (numChannels == 1)
-			printf(" (mono)");
+			job_printf(job, " (mono)");
 		else if (numChannels == 2)
-			printf(" (stereo)");
+			job_printf(job, " (stereo)");
 
 	}
-	printf("\n");
+	job_printf(job, "\n");
 
-	printf("\n");
+	job_printf(job, "\n");
 }
 
 
@@ -232,80 +268,203 @@ void AudioOutData::set_sequence_duration_120bpm() {
 
 	// Get sequence duration in update count; this assumes 48 tatums per beat at 120 BPM initially.
 	// Simplifies to time in seconds * 96. Ceiling of value should be used if no additional computation is needed.
-	gSequenceTimestamp = (long double) sampleCount / (long double) resampledSampleRate * (120.0 * 48.0 / 60.0);
+	job->sequenceTimestamp = (long double) sampleCount / (long double) resampledSampleRate * (120.0 * 48.0 / 60.0);
 
-	seq_set_timestamp_duration(gSequenceTimestamp);
+	seq_set_timestamp_duration(job, job->sequenceTimestamp);
 }
 
-void set_sample_rate(int64_t sampleRate) {
+void set_sample_rate(ConversionJob *job, int64_t sampleRate) {
 	if (sampleRate <= 0) {
-		print_param_warning("sample rate");
+		print_param_warning(job, "sample rate");
+		return;
+	}
+
+	job->ovrdSampleRate = sampleRate;
+}
+
+// Each rate after the first is converted into its own set of files, all from a single decode
+void set_resample_rates(ConversionJob *job, vector<int64_t> resampleRates) {
+	job->resampleRates.clear();
+
+	for (size_t i = 0; i < resampleRates.size(); i++) {
+		if (resampleRates[i] <= 0) {
+			print_param_warning(job, "resample rate");
+			continue;
+		}
+
+		if (find(job->resampleRates.begin(), job->resampleRates.end(), resampleRates[i]) == job->resampleRates.end())
+			job->resampleRates.push_back(resampleRates[i]);
+	}
+
+	if (!job->resampleRates.empty()) {
+		job->ovrdResampleRate = job->resampleRates[0];
+		job->autoResampleRate = false;
+	}
+}
+
+void set_auto_resample_rate(ConversionJob *job) {
+	job->resampleRates.clear();
+	job->ovrdResampleRate = -1;
+	job->autoResampleRate = true;
+}
+
+void set_bandwidth_loss(ConversionJob *job, int64_t decibels) {
+	if (decibels <= 0 || decibels > 120) {
+		print_param_warning(job, "bandwidth loss");
+		return;
+	}
+
+	job->bandwidthLoss = (double) decibels;
+}
+
+void set_channel_map(ConversionJob *job, string spec) {
+	if (!parse_channel_map(spec, &job->channelMix))
+		print_param_warning(job, "channel map");
+}
+
+void set_channel_mix(ConversionJob *job, string spec) {
+	if (!parse_channel_mix(spec, &job->channelMix))
+		print_param_warning(job, "channel mix");
+}
+
+void set_silence_threshold(ConversionJob *job, int64_t decibels) {
+	if (decibels < -96 || decibels >= 0) {
+		print_param_warning(job, "silence threshold");
+		return;
+	}
+
+	// -96 dBFS is below the quietest nonzero 16-bit sample, leaving only digital silence
+	job->silenceThreshold = (int32_t) (32768.0 * pow(10.0, (double) decibels / 20.0));
+}
+
+void set_auto_mono_tolerance(ConversionJob *job, int64_t decibels) {
+	if (decibels <= 0 || decibels > 120) {
+		print_param_warning(job, "auto mono tolerance");
+		return;
+	}
+
+	job->autoMonoTolerance = (double) decibels;
+}
+
+void set_resampler(ConversionJob *job, string name) {
+	ResamplerEngine engine;
+	if (!parse_resampler_engine(name, &engine)) {
+		print_param_warning(job, "resampler");
+		return;
+	}
+
+	if (!resampler_engine_available(engine)) {
+		job_printf(job, "WARNING: This build of STRM64 does not include the %s resampler, skipping...\n", name.c_str());
+		return;
+	}
+
+	job->resamplerEngine = engine;
+}
+
+void set_resample_quality(ConversionJob *job, string name) {
+	if (!parse_resampler_quality(name, &job->resampleQuality))
+		print_param_warning(job, "resample quality");
+}
+
+void set_resample_group_size(ConversionJob *job, int64_t groupSize) {
+	if (groupSize <= 0 || groupSize > (int64_t) NUM_CHANNELS_MAX) {
+		print_param_warning(job, "resample group size");
+		return;
+	}
+
+	job->resampleGroupSize = groupSize;
+}
+
+void set_decode_threads(ConversionJob *job, int64_t threads) {
+	if (threads <= 0 || threads > DECODE_THREADS_MAX) {
+		print_param_warning(job, "decoder thread count");
 		return;
 	}
 
-	ovrdSampleRate = sampleRate;
+	job->decodeThreads = threads;
 }
 
-void set_resample_rate(int64_t resampleRate) {
-	if (resampleRate <= 0) {
-		print_param_warning("resample rate");
+void set_loop_cache_limit(ConversionJob *job, int64_t megabytes) {
+	if (megabytes < 0 || megabytes > (INT64_MAX >> 20)) {
+		print_param_warning(job, "loop cache limit");
 		return;
 	}
 
-	ovrdResampleRate = resampleRate;
+	job->loopCacheLimit = megabytes << 20;
 }
 
-void set_enable_loop(int64_t isLoopingEnabled) {
+void set_enable_loop(ConversionJob *job, int64_t isLoopingEnabled) {
 	if (!(isLoopingEnabled == 0 || isLoopingEnabled == 1)) {
-		print_param_warning("loop enable/disable");
+		print_param_warning(job, "loop enable/disable");
 		return;
 	}
 
-	ovrdEnableLoop = isLoopingEnabled;
+	job->ovrdEnableLoop = isLoopingEnabled;
 }
 
-void set_loop_start_samples(int64_t samples) {
+void set_loop_start_samples(ConversionJob *job, int64_t samples) {
 	if (samples >= 0x100000000) {
-		print_param_warning("loop start (samples)");
+		print_param_warning(job, "loop start (samples)");
 		return;
 	}
 
-	ovrdEnableLoop = 1;
-	ovrdLoopStartSamples = samples;
-	ovrdLoopStartMicro = INT64_MAX;
+	job->ovrdEnableLoop = 1;
+	job->ovrdLoopStartSamples = samples;
+	job->ovrdLoopStartMicro = INT64_MAX;
 }
 
-void set_loop_end_samples(int64_t samples) {
+void set_loop_end_samples(ConversionJob *job, int64_t samples) {
 	if (samples >= 0x100000000) {
-		print_param_warning("loop end (samples)");
+		print_param_warning(job, "loop end (samples)");
 		return;
 	}
 
-	ovrdLoopEndSamples = samples;
-	ovrdLoopEndMicro = INT64_MAX;
+	job->ovrdLoopEndSamples = samples;
+	job->ovrdLoopEndMicro = INT64_MAX;
 }
 
-void set_loop_start_timestamp(string arg) {
+void set_loop_start_timestamp(ConversionJob *job, string arg) {
 	int64_t microseconds = timestamp_to_us(arg);
 	if (microseconds == INT64_MIN) {
-		print_param_warning("loop start (timestamp)");
+		print_param_warning(job, "loop start (timestamp)");
 		return;
 	}
 
-	ovrdEnableLoop = 1;
-	ovrdLoopStartMicro = microseconds;
-	ovrdLoopStartSamples = INT64_MAX;
+	job->ovrdEnableLoop = 1;
+	job->ovrdLoopStartMicro = microseconds;
+	job->ovrdLoopStartSamples = INT64_MAX;
 }
 
-void set_loop_end_timestamp(string arg) {
+void set_loop_end_timestamp(ConversionJob *job, string arg) {
 	int64_t microseconds = timestamp_to_us(arg);
 	if (microseconds == INT64_MIN) {
-		print_param_warning("loop end (timestamp)");
+		print_param_warning(job, "loop end (timestamp)");
+		return;
+	}
+
+	job->ovrdLoopEndMicro = microseconds;
+	job->ovrdLoopEndSamples = INT64_MAX;
+}
+
+void set_start_samples(ConversionJob *job, int64_t samples) {
+	if (samples < 0 || samples >= 0x100000000) {
+		print_param_warning(job, "start (samples)");
 		return;
 	}
 
-	ovrdLoopEndMicro = microseconds;
-	ovrdLoopEndSamples = INT64_MAX;
+	job->ovrdStartSamples = samples;
+	job->ovrdStartMicro = INT64_MAX;
+}
+
+void set_start_timestamp(ConversionJob *job, string arg) {
+	int64_t microseconds = timestamp_to_us(arg);
+	if (microseconds == INT64_MIN || microseconds < 0) {
+		print_param_warning(job, "start (timestamp)");
+		return;
+	}
+
+	job->ovrdStartMicro = microseconds;
+	job->ovrdStartSamples = INT64_MAX;
 }
 
 char get_num_to_hex(uint8_t num) {
@@ -322,49 +481,49 @@ int64_t us_to_samples(int64_t sampleRate, int64_t timeOffset) {
 
 int AudioOutData::check_properties(VGMSTREAM *inFileProperties, string newFilename) {
 	if (sampleRate <= 0) {
-		printf("ERROR: Input file has invalid sample rate value!\n");
+		job_printf(job, "ERROR: Input file has invalid sample rate value!\n");
 		return RETURN_STREAM_INVALID_PARAMETERS;
 	}
 	if (numSamples <= 0) {
-		printf("ERROR: Input file has no sample data!\n");
+		job_printf(job, "ERROR: Input file has no sample data!\n");
 		return RETURN_STREAM_INVALID_PARAMETERS;
 	}
 
 	// Overridden sample rate
-	if (ovrdSampleRate > 0) {
-		resampledSampleRate = (int32_t) ovrdSampleRate;
+	if (job->ovrdSampleRate > 0) {
+		resampledSampleRate = (int32_t) job->ovrdSampleRate;
 		sampleRate = resampledSampleRate;
 	}
 
 	// Resample rate
 	if (resample) {
-		resampledSampleRate = (int32_t) ovrdResampleRate;
+		resampledSampleRate = (int32_t) job->ovrdResampleRate;
 	}
 
 	// Overridden loop flag
-	if (ovrdEnableLoop >= 0) {
-		if (ovrdEnableLoop && !enableLoop) {
+	if (job->ovrdEnableLoop >= 0) {
+		if (job->ovrdEnableLoop && !enableLoop) {
 			loopStartSamples = 0;
 			loopEndSamples = numSamples;
 		}
-		enableLoop = (int) ovrdEnableLoop;
+		enableLoop = (int) job->ovrdEnableLoop;
 	}
 
 	// Overridden total sample count / end loop point
-	if (ovrdLoopEndSamples != INT64_MAX) {
-		if (ovrdLoopEndSamples > 0) {
-			if (numSamples > ovrdLoopEndSamples)
-				numSamples = (int32_t) ovrdLoopEndSamples;
+	if (job->ovrdLoopEndSamples != INT64_MAX) {
+		if (job->ovrdLoopEndSamples > 0) {
+			if (numSamples > job->ovrdLoopEndSamples)
+				numSamples = (int32_t) job->ovrdLoopEndSamples;
 		}
 		else {
-			numSamples = (int32_t) ovrdLoopEndSamples + numSamples;
+			numSamples = (int32_t) job->ovrdLoopEndSamples + numSamples;
 		}
 		if (enableLoop)
 			loopEndSamples = numSamples;
 	}
 	// Overridden total sample count / end loop point, represented in microseconds
-	else if (ovrdLoopEndMicro != INT64_MAX) {
-		int64_t tmpNumSamples = us_to_samples(sampleRate, ovrdLoopEndMicro);
+	else if (job->ovrdLoopEndMicro != INT64_MAX) {
+		int64_t tmpNumSamples = us_to_samples(sampleRate, job->ovrdLoopEndMicro);
 		if (tmpNumSamples > 0) {
 			if (numSamples > tmpNumSamples)
 				numSamples = (int32_t) tmpNumSamples;
@@ -387,15 +546,15 @@ int AudioOutData::check_properties(VGMSTREAM *inFileProperties, string newFilena
 	// Loop Start, only handled if looping is enabled
 	if (enableLoop) {
 		// Overridden start loop point
-		if (ovrdLoopStartSamples != INT64_MAX) {
-			if (ovrdLoopStartSamples >= 0)
-				loopStartSamples = (int32_t) ovrdLoopStartSamples;
+		if (job->ovrdLoopStartSamples != INT64_MAX) {
+			if (job->ovrdLoopStartSamples >= 0)
+				loopStartSamples = (int32_t) job->ovrdLoopStartSamples;
 			else
-				loopStartSamples = (int32_t) ovrdLoopStartSamples + numSamples;
+				loopStartSamples = (int32_t) job->ovrdLoopStartSamples + numSamples;
 		}
 		// Overridden start loop point, represented in microseconds
-		else if (ovrdLoopStartMicro != INT64_MAX) {
-			int64_t tmpNumSamples = us_to_samples(sampleRate, ovrdLoopStartMicro);
+		else if (job->ovrdLoopStartMicro != INT64_MAX) {
+			int64_t tmpNumSamples = us_to_samples(sampleRate, job->ovrdLoopStartMicro);
 			if (tmpNumSamples >= 0)
 				loopStartSamples = (int32_t) tmpNumSamples;
 			else
@@ -403,6 +562,33 @@ int AudioOutData::check_properties(VGMSTREAM *inFileProperties, string newFilena
 		}
 	}
 
+	if (numSamples <= 0) {
+		job_printf(job, "ERROR: Negative stream length value extends beyond the original stream length!\n");
+		job_printf(job, "ATTEMPTED VALUE: %d\n", numSamples);
+		return RETURN_STREAM_INVALID_PARAMETERS;
+	}
+
+	// Start offset: every position above is within the source, which the output now starts partway into.
+	// A loop start before the first kept sample loops back to the start of the output instead.
+	if (job->ovrdStartSamples != INT64_MAX || job->ovrdStartMicro != INT64_MAX) {
+		int64_t start = (job->ovrdStartSamples != INT64_MAX ? job->ovrdStartSamples : us_to_samples(sampleRate, job->ovrdStartMicro));
+		if (start >= numSamples) {
+			job_printf(job, "ERROR: Start offset extends beyond the end of the stream!\n");
+			job_printf(job, "ATTEMPTED VALUE: %" PRId64 ", END OF STREAM: %d\n", start, numSamples);
+			return RETURN_STREAM_INVALID_PARAMETERS;
+		}
+
+		startOffset = (int32_t) start;
+		numSamples -= startOffset;
+		loopEndSamples -= startOffset;
+		loopStartSamples = max(loopStartSamples - startOffset, 0);
+	}
+
+	return resolve_resampled_metadata(inFileProperties);
+}
+
+// Calculates the stream length and loop points at resampledSampleRate, once those at the source rate are final
+int AudioOutData::resolve_resampled_metadata(VGMSTREAM *inFileProperties) {
 	// Calculate new metadata for use if resampling audio
 	if (resample) {
 		double ratio = (double) resampledSampleRate / (double) sampleRate;
@@ -421,8 +607,8 @@ int AudioOutData::check_properties(VGMSTREAM *inFileProperties, string newFilena
 
 			if (
 				!inFileProperties->loop_flag ||
-				loopStartSamples != inFileProperties->loop_start_sample ||
-				loopEndSamples != inFileProperties->loop_end_sample
+				loopStartSamples + startOffset != inFileProperties->loop_start_sample ||
+				loopEndSamples + startOffset != inFileProperties->loop_end_sample
 			) {
 				vgmstreamLoopPointMismatch = true; // Force manual seeking in the stream once the loop end is reached
 			}
@@ -434,125 +620,287 @@ int AudioOutData::check_properties(VGMSTREAM *inFileProperties, string newFilena
 		vgmstreamLoopPointMismatch = false;
 	}
 
-	if (numSamples <= 0) {
-		printf("ERROR: Negative stream length value extends beyond the original stream length!\n");
-		printf("ATTEMPTED VALUE: %d\n", numSamples);
-		return RETURN_STREAM_INVALID_PARAMETERS;
-	}
 	if (resampledNumSamples <= 0) {
-		printf("ERROR: Output audio file size is too large after resampling!\n");
-		printf("ATTEMPTED VALUE: %d\n", resampledNumSamples);
+		job_printf(job, "ERROR: Output audio file size is too large after resampling!\n");
+		job_printf(job, "ATTEMPTED VALUE: %d\n", resampledNumSamples);
 		return RETURN_STREAM_INVALID_PARAMETERS;
 	}
 	if (enableLoop && resampledLoopEndSamples <= resampledLoopStartSamples) {
-		printf("ERROR: Starting loop point must be smaller than ending loop point!\n");
-		printf("LOOP_START: %d, LOOP_END: %d\n", resampledLoopStartSamples, resampledLoopEndSamples);
+		job_printf(job, "ERROR: Starting loop point must be smaller than ending loop point!\n");
+		job_printf(job, "LOOP_START: %d, LOOP_END: %d\n", resampledLoopStartSamples, resampledLoopEndSamples);
 		return RETURN_STREAM_INVALID_PARAMETERS;
 	}
 	if (enableLoop && resampledLoopStartSamples < 0) {
-		printf("ERROR: Negative starting loop point value extends beyond the total stream length!\n");
-		printf("ATTEMPTED VALUE: %d\n", resampledLoopStartSamples);
+		job_printf(job, "ERROR: Negative starting loop point value extends beyond the total stream length!\n");
+		job_printf(job, "ATTEMPTED VALUE: %d\n", resampledLoopStartSamples);
 		return RETURN_STREAM_INVALID_PARAMETERS;
 	}
 
 	return RETURN_SUCCESS;
 }
 
+/**
+ * Moves the stream to the first sample kept by --start. Stateless codecs are positioned there directly without decoding anything,
+ * while everything else is left to vgmstream's own seek. Only ever called on a stream that is at its start.
+ */
+void AudioOutData::seek_to_start(VGMSTREAM *inFileProperties) {
+	if (startOffset == 0)
+		return;
+
+	StatsTimer timer(&job->stats, STATS_STAGE_DECODE);
+	if (get_segment_seek_type(inFileProperties) == SEGMENT_SEEK_EXACT && position_vgmstream(inFileProperties, startOffset))
+		return;
+
+	seek_vgmstream(inFileProperties, startOffset);
+}
+
+/**
+ * -R auto: measures the bandwidth of every channel and gives each one the lowest rate that still holds it.
+ * Channels that end up at different rates are converted separately by write_channel_rate_audio_data, while this object
+ * keeps describing the decode they share, at the highest of those rates.
+ */
+int AudioOutData::choose_channel_rates(VGMSTREAM *inFileProperties) {
+	vector<double> bandwidths;
+
+	job_printf(job, "Analyzing channel bandwidth(s)...");
+	fflush(stdout);
+	seek_to_start(inFileProperties);
+	if (!measure_channel_bandwidths(inFileProperties, &job->channelMix, numSamples, job->bandwidthLoss, &bandwidths, &job->stats)) {
+		job_printf(job, "...FAILED!\nERROR: Out of memory!\n");
+		return RETURN_STREAM_OUT_OF_MEMORY;
+	}
+	job_printf(job, "...DONE!\n");
+
+	channelRates.clear();
+	int32_t maxRate = 0;
+	for (int i = 0; i < numChannels; i++) {
+		channelRates.push_back(choose_resample_rate(bandwidths[i], sampleRate));
+		maxRate = max(maxRate, channelRates[i]);
+	}
+
+	if (count(channelRates.begin(), channelRates.end(), maxRate) == (ptrdiff_t) channelRates.size())
+		channelRates.clear();
+
+	resampledSampleRate = maxRate;
+	resample = (!channelRates.empty() || resampledSampleRate != sampleRate);
+
+	return resolve_resampled_metadata(inFileProperties);
+}
+
+// --auto-mono: decodes the whole stream before any resampling, and sets fold if the difference of both channels stays far enough below their sum
+int AudioOutData::compare_stereo_channels(VGMSTREAM *inFileProperties, bool *fold) {
+	sample_t *audioBuffer = allocate_samples((size_t) MIN_PRINT_BUFFER_SIZE * numChannels);
+	if (audioBuffer == nullptr) {
+		job_printf(job, "...FAILED!\nERROR: Out of memory!\n");
+		return RETURN_STREAM_OUT_OF_MEMORY;
+	}
+
+	job_printf(job, "Comparing stereo channels...");
+	fflush(stdout);
+	seek_to_start(inFileProperties);
+
+	double energy[2] = {0.0, 0.0};
+	for (int32_t position = 0; position < numSamples; position += MIN_PRINT_BUFFER_SIZE) {
+		int32_t frames = min((int32_t) MIN_PRINT_BUFFER_SIZE, numSamples - position);
+
+		{
+			StatsTimer timer(&job->stats, STATS_STAGE_DECODE);
+			render_mixed_vgmstream(audioBuffer, frames, inFileProperties, &job->channelMix);
+			stats_add(&job->stats, &job->stats.samplesDecoded, (uint64_t) frames * numChannels);
+		}
+
+		StatsTimer timer(&job->stats, STATS_STAGE_ANALYZE);
+		stereo_energy_16(audioBuffer, audioBuffer + 1, (size_t) numChannels, (uint32_t) frames, false, energy);
+	}
+
+	reset_vgmstream(inFileProperties);
+	delete[] audioBuffer;
+	job_printf(job, "...DONE!\n");
+
+	*fold = (energy[1] <= energy[0] * pow(10.0, -job->autoMonoTolerance / 10.0));
+	return RETURN_SUCCESS;
+}
+
+/**
+ * --auto-mono: if the stereo channels are nearly identical, the channel mix gets folded into one centered channel, which is all that's decoded and written.
+ * Jobs converting the same input at other -R rates reuse the decision of whichever one compared the channels first, so they're only decoded for it once.
+ */
+int AudioOutData::choose_mono_fold(VGMSTREAM *inFileProperties) {
+	if (job->autoMonoTolerance <= 0.0 || numChannels != 2 || job->forcedMono)
+		return RETURN_SUCCESS;
+
+	SharedDecode *shared = job->sharedDecode;
+	unique_lock<mutex> sharedLock;
+	if (shared != NULL)
+		sharedLock = unique_lock<mutex>(shared->monoFoldLock);
+
+	bool fold;
+	if (shared != NULL && shared->monoFold >= 0) {
+		fold = (shared->monoFold != 0);
+	} else {
+		int ret = compare_stereo_channels(inFileProperties, &fold);
+		if (ret != RETURN_SUCCESS)
+			return ret;
+		if (shared != NULL)
+			shared->monoFold = (fold ? 1 : 0);
+	}
+
+	if (!fold)
+		return RETURN_SUCCESS;
+
+	fold_channel_mix_to_mono(&job->channelMix, inFileProperties->channels);
+	numChannels = 1;
+	decodedChannels = 1;
+	job->instFlags = 0x0001;
+	job->streamChannels = 1;
+	job_printf(job, "Stereo channels are nearly identical, writing a single centered stream\n");
+
+	return RETURN_SUCCESS;
+}
 
 void AudioOutData::calculate_aiff_file_size() {
-	gFileSize = 0;
+	fileSize = 0;
 
-	gFileSize += FORM_HEADER_SIZE;
-	gFileSize += COMM_HEADER_SIZE;
+	fileSize += FORM_HEADER_SIZE;
+	fileSize += COMM_HEADER_SIZE;
 
 	if (enableLoop) {
-		gFileSize += MARK_HEADER_SIZE;
-		gFileSize += INST_HEADER_SIZE;
+		fileSize += MARK_HEADER_SIZE;
+		fileSize += INST_HEADER_SIZE;
 	}
 
-	gFileSize += SSND_PRE_HEADER_SIZE;
+	fileSize += SSND_PRE_HEADER_SIZE;
 
 	int32_t samplesPadded = resampledNumSamples;
 	if (samplesPadded % SAMPLE_COUNT_PADDING)
 		samplesPadded += SAMPLE_COUNT_PADDING - (samplesPadded % SAMPLE_COUNT_PADDING);
 
-	gFileSize += samplesPadded * sizeof(sample_t);
+	fileSize += samplesPadded * sizeof(sample_t);
+}
+
+
+/**
+ * VADPCM can only resume decoding at the start of a frame, so a loop that doesn't start on one gets shifted forward until it does.
+ * Samples past the original loop end are then filled in from the loop start, which keeps the looped audio itself unchanged.
+ */
+void AudioOutData::calculate_aifc_file_size() {
+	uint32_t samplesPadded = (uint32_t) resampledNumSamples;
+	if (samplesPadded % VADPCM_FRAME_SAMPLES)
+		samplesPadded += VADPCM_FRAME_SAMPLES - (samplesPadded % VADPCM_FRAME_SAMPLES);
+
+	vadpcmLoopStartSamples = 0;
+	vadpcmLoopEndSamples = samplesPadded;
+	vadpcmNumSamples = samplesPadded;
+
+	if (enableLoop) {
+		uint32_t shift = (VADPCM_FRAME_SAMPLES - (uint32_t) resampledLoopStartSamples % VADPCM_FRAME_SAMPLES) % VADPCM_FRAME_SAMPLES;
+		vadpcmLoopStartSamples = (uint32_t) resampledLoopStartSamples + shift;
+		vadpcmLoopEndSamples = (uint32_t) resampledLoopEndSamples + shift;
+
+		vadpcmNumSamples = vadpcmLoopEndSamples;
+		if (vadpcmNumSamples % VADPCM_FRAME_SAMPLES)
+			vadpcmNumSamples += VADPCM_FRAME_SAMPLES - (vadpcmNumSamples % VADPCM_FRAME_SAMPLES);
+	}
+
+	uint32_t dataSize = (vadpcmNumSamples / VADPCM_FRAME_SAMPLES) * VADPCM_FRAME_BYTES;
+
+	fileSize = 0;
+
+	fileSize += FORM_HEADER_SIZE;
+	fileSize += AIFC_COMM_HEADER_SIZE;
+	fileSize += AIFC_CODES_HEADER_SIZE + VADPCM_PREDICTORS_DEFAULT * VADPCM_ORDER * 8 * sizeof(int16_t);
+	fileSize += SSND_PRE_HEADER_SIZE + dataSize + (dataSize & 1);
+
+	if (enableLoop)
+		fileSize += AIFC_LOOPS_HEADER_SIZE;
+}
+
+static void put_header_data(uint8_t **header, const void *data, size_t size) {
+	memcpy(*header, data, size);
+	*header += size;
 }
 
+// Sample rate as the 80-bit extended float used by AIFF and AIFC headers
+static void put_sample_rate(uint8_t **header, uint32_t sampleRate) {
+	uint16_t tmp16BitValue;
+
+	// Calculate sample rate stuffs manually; uses an 80-bit extended float value in the AIFF header
+	uint16_t sampleRateMultiple = SAMPLE_RATE_MULTIPLE_CONSTANT;
+	uint32_t sampleRateCurrent = sampleRate;
+	uint64_t sampleRateRemainder = 0;
+	while (sampleRateCurrent < 0x8000) {
+		sampleRateMultiple--;
+		sampleRateCurrent <<= 1;
+	}
+	while (sampleRateCurrent > 0xFFFF) {
+		sampleRateMultiple++;
+		sampleRateRemainder >>= 1;
+		sampleRateRemainder |= ((sampleRateCurrent & 1) << (sizeof(sampleRateRemainder) - 1));
+		sampleRateCurrent >>= 1;
+	}
+
+	// NOTE: The endianness checks here are funky, since this "weird structure" has now been recognized to essentially be an 80-bit float.
+	// All 10 bytes of the data here probably need to be swapped as one, if there's ever any reason to implement little-endian exports.
+
+	// Sample Rate Exponential Multiple [+0x00]
+	tmp16BitValue = bswap_16(sampleRateMultiple);
+	put_header_data(header, &tmp16BitValue, 2);
+
+	// Modified Sample Rate [+0x02]
+	tmp16BitValue = bswap_16((uint16_t) sampleRateCurrent);
+	put_header_data(header, &tmp16BitValue, 2);
+
+	// Modified Sample Rate Remainder (6 bytes) [+0x04]
+	put_header_data(header, &sampleRateRemainder, 6); // FIXME: Missing endianness check. Will break if exporting as little-endian.
+}
 
-void AudioOutData::write_form_header(FILE *streamFile) {
+void AudioOutData::write_form_header(uint8_t **header) {
 	const char formHeader[] = "FORM";
 	const char aiffHeader[] = "AIFF";
-	uint32_t bswpFileSize = bswap_32(gFileSize - 8);
+	uint32_t bswpFileSize = bswap_32(fileSize - 8);
 
 	// FORM [0x00]
-	fwrite(formHeader, 1, 4, streamFile);
+	put_header_data(header, formHeader, 4);
 
 	// File Size - 8 [0x04]
-	fwrite(&bswpFileSize, 4, 1, streamFile);
+	put_header_data(header, &bswpFileSize, 4);
 
 	// AIFF [0x08]
-	fwrite(aiffHeader, 1, 4, streamFile);
+	put_header_data(header, aiffHeader, 4);
 }
 
-void AudioOutData::write_comm_header(FILE *streamFile) {
+void AudioOutData::write_comm_header(uint8_t **header) {
 	const char commHeader[] = "COMM";
 	uint16_t tmp16BitValue;
 	uint32_t tmp32BitValue;
 
 	// COMM [0x00]
-	fwrite(commHeader, 1, 4, streamFile);
+	put_header_data(header, commHeader, 4);
 
 	// COMM Size - 8 [0x04]
 	tmp32BitValue = bswap_32((uint32_t) (COMM_HEADER_SIZE - 8));
-	fwrite(&tmp32BitValue, 4, 1, streamFile);
+	put_header_data(header, &tmp32BitValue, 4);
 	
 	// Channel Count (always 1 in this case) [0x08]
 	tmp16BitValue = bswap_16((uint16_t) 1);
-	fwrite(&tmp16BitValue, 2, 1, streamFile);
+	put_header_data(header, &tmp16BitValue, 2);
 
 	// Number of Samples, padded to SAMPLE_COUNT_PADDING [0x0A]
 	tmp32BitValue = (uint32_t) resampledNumSamples;
 	if (tmp32BitValue % SAMPLE_COUNT_PADDING)
 		tmp32BitValue += SAMPLE_COUNT_PADDING - (tmp32BitValue % SAMPLE_COUNT_PADDING);
 	tmp32BitValue = bswap_32(tmp32BitValue);
-	fwrite(&tmp32BitValue, 4, 1, streamFile);
+	put_header_data(header, &tmp32BitValue, 4);
 
 	// Bit Depth (always 16) [0x0E]
 	tmp16BitValue = bswap_16((uint16_t) 16);
-	fwrite(&tmp16BitValue, 2, 1, streamFile);
-
-	// Calculate sample rate stuffs manually; uses an 80-bit extended float value in the AIFF header
-	uint16_t sampleRateMultiple = SAMPLE_RATE_MULTIPLE_CONSTANT;
-	uint32_t sampleRateCurrent = (uint32_t) resampledSampleRate;
-	uint64_t sampleRateRemainder = 0;
-	while (sampleRateCurrent < 0x8000) {
-		sampleRateMultiple--;
-		sampleRateCurrent <<= 1;
-	}
-	while (sampleRateCurrent > 0xFFFF) {
-		sampleRateMultiple++;
-		sampleRateRemainder >>= 1;
-		sampleRateRemainder |= ((sampleRateCurrent & 1) << (sizeof(sampleRateRemainder) - 1));
-		sampleRateCurrent >>= 1;
-	}
-
-	// NOTE: The endianness checks here are funky, since this "weird structure" has now been recognized to essentially be an 80-bit float.
-	// All 10 bytes of the data here probably need to be swapped as one, if there's ever any reason to implement little-endian exports.
-
-	// Sample Rate Exponential Multiple [0x10]
-	tmp16BitValue = bswap_16(sampleRateMultiple);
-	fwrite(&tmp16BitValue, 2, 1, streamFile);
+	put_header_data(header, &tmp16BitValue, 2);
 
-	// Modified Sample Rate [0x12]
-	tmp16BitValue = bswap_16((uint16_t) sampleRateCurrent);
-	fwrite(&tmp16BitValue, 2, 1, streamFile);
-
-	// Modified Sample Rate Remainder (6 bytes) [0x14]
-	fwrite(&sampleRateRemainder, 1, 6, streamFile); // FIXME: Missing endianness check. Will break if exporting as little-endian.
+	// Sample Rate [0x10]
+	put_sample_rate(header, (uint32_t) resampledSampleRate);
 }
 
-void AudioOutData::write_mark_header(FILE *streamFile) {
+void AudioOutData::write_mark_header(uint8_t **header) {
 	const char markHeader[] = "MARK";
 	const char startMarker[] = "start";
 	const char endMarker[] = "end";
@@ -561,317 +909,315 @@ void AudioOutData::write_mark_header(FILE *streamFile) {
 	uint32_t tmp32BitValue;
 
 	// MARK [0x00]
-	fwrite(markHeader, 1, 4, streamFile);
+	put_header_data(header, markHeader, 4);
 
 	// MARK Size - 8 [0x04]
 	tmp32BitValue = bswap_32((uint32_t) (MARK_HEADER_SIZE - 8));
-	fwrite(&tmp32BitValue, 4, 1, streamFile);
+	put_header_data(header, &tmp32BitValue, 4);
 
 	// Marker Count (Always 2 in this case) [0x08]
 	tmp16BitValue = bswap_16((uint16_t) 2);
-	fwrite(&tmp16BitValue, 2, 1, streamFile);
+	put_header_data(header, &tmp16BitValue, 2);
 
 	// First Marker ID (Indexed at 1) [0x0A]
 	tmp16BitValue = bswap_16((uint16_t) 1);
-	fwrite(&tmp16BitValue, 2, 1, streamFile);
+	put_header_data(header, &tmp16BitValue, 2);
 
 	// Sample Offset (Loop Start Value) [0x0C]
 	tmp32BitValue = bswap_32((uint32_t) (resampledLoopStartSamples));
-	fwrite(&tmp32BitValue, 4, 1, streamFile);
+	put_header_data(header, &tmp32BitValue, 4);
 
 	// Marker Id ("start" is 5 characters) [0x10]
 	tmp8BitValue = 5;
-	fwrite(&tmp8BitValue, 1, 1, streamFile);
+	put_header_data(header, &tmp8BitValue, 1);
 
 	// "start" (Loop Start Marker) [0x11]
-	fwrite(startMarker, 1, 5, streamFile);
+	put_header_data(header, startMarker, 5);
 
 	// Second Marker ID (Indexed at 1) [0x16]
 	tmp16BitValue = bswap_16((uint16_t) 2);
-	fwrite(&tmp16BitValue, 2, 1, streamFile);
+	put_header_data(header, &tmp16BitValue, 2);
 
 	// Sample Offset (Loop End Value) [0x18]
 	tmp32BitValue = bswap_32((uint32_t) (resampledLoopEndSamples));
-	fwrite(&tmp32BitValue, 4, 1, streamFile);
+	put_header_data(header, &tmp32BitValue, 4);
 
 	// Marker Id ("end" is 3 characters) [0x1C]
 	tmp8BitValue = 3;
-	fwrite(&tmp8BitValue, 1, 1, streamFile);
+	put_header_data(header, &tmp8BitValue, 1);
 
 	// "end" (Loop End Marker) [0x1D]
-	fwrite(endMarker, 1, 3, streamFile);
+	put_header_data(header, endMarker, 3);
 }
 
 // May not even be needed, but here just in case
-void AudioOutData::write_inst_header(FILE *streamFile) {
+void AudioOutData::write_inst_header(uint8_t **header) {
 	const char instHeader[] = "INST";
 	uint8_t tmp8BitValue;
 	uint16_t tmp16BitValue;
 	uint32_t tmp32BitValue;
 
 	// INST [0x00]
-	fwrite(instHeader, 1, 4, streamFile);
+	put_header_data(header, instHeader, 4);
 
 	// INST Size - 8 [0x04]
 	tmp32BitValue = bswap_32((uint32_t) (INST_HEADER_SIZE - 8));
-	fwrite(&tmp32BitValue, 4, 1, streamFile);
+	put_header_data(header, &tmp32BitValue, 4);
 
 	// Base Note (0) [0x08]
 	tmp8BitValue = 0;
-	fwrite(&tmp8BitValue, 1, 1, streamFile);
+	put_header_data(header, &tmp8BitValue, 1);
 
 	// Detune (0) [0x09]
 	tmp8BitValue = 0;
-	fwrite(&tmp8BitValue, 1, 1, streamFile);
+	put_header_data(header, &tmp8BitValue, 1);
 
 	// Low Note (0) [0x0A]
 	tmp8BitValue = 0;
-	fwrite(&tmp8BitValue, 1, 1, streamFile);
+	put_header_data(header, &tmp8BitValue, 1);
 
 	// High Note (0) [0x0B]
 	tmp8BitValue = 0;
-	fwrite(&tmp8BitValue, 1, 1, streamFile);
+	put_header_data(header, &tmp8BitValue, 1);
 
 	// Low Velocity (0) [0x0C]
 	tmp8BitValue = 0;
-	fwrite(&tmp8BitValue, 1, 1, streamFile);
+	put_header_data(header, &tmp8BitValue, 1);
 
 	// High Velocity (0) [0x0D]
 	tmp8BitValue = 0;
-	fwrite(&tmp8BitValue, 1, 1, streamFile);
+	put_header_data(header, &tmp8BitValue, 1);
 
 	// Gain (0) [0x0E]
 	tmp16BitValue = bswap_16((uint16_t) 0);
-	fwrite(&tmp16BitValue, 2, 1, streamFile);
+	put_header_data(header, &tmp16BitValue, 2);
 
 	// Sustain Loop? (0) [0x10]
 	tmp32BitValue = bswap_32((uint32_t) 0x10001);
-	fwrite(&tmp32BitValue, 4, 1, streamFile);
+	put_header_data(header, &tmp32BitValue, 4);
 
 	// Release Loop? (0) [0x14]
 	tmp32BitValue = bswap_32((uint32_t) 0x20000);
-	fwrite(&tmp32BitValue, 4, 1, streamFile);
+	put_header_data(header, &tmp32BitValue, 4);
 
 	// Padding? [0x18]
 	tmp32BitValue = bswap_32((uint32_t) 0);
-	fwrite(&tmp32BitValue, 4, 1, streamFile);
+	put_header_data(header, &tmp32BitValue, 4);
 }
 
-void AudioOutData::write_ssnd_header(FILE *streamFile) {
+void AudioOutData::write_ssnd_header(uint8_t **header) {
 	const char ssndHeader[] = "SSND";
 	uint32_t tmp32BitValue;
 
 	// SSND [0x00]
-	fwrite(ssndHeader, 1, 4, streamFile);
+	put_header_data(header, ssndHeader, 4);
 
 	// SSND Size - 8 [0x04]
 	uint32_t samplesPadded = (uint32_t) resampledNumSamples;
 	if (samplesPadded % SAMPLE_COUNT_PADDING)
 		samplesPadded += SAMPLE_COUNT_PADDING - (samplesPadded % SAMPLE_COUNT_PADDING);
 	tmp32BitValue = bswap_32((uint32_t) (SSND_PRE_HEADER_SIZE + samplesPadded * sizeof(sample_t) - 8));
-	fwrite(&tmp32BitValue, 4, 1, streamFile);
+	put_header_data(header, &tmp32BitValue, 4);
 	
 	// Offset (always 0 in this case) [0x08]
 	tmp32BitValue = bswap_32((uint32_t) 0);
-	fwrite(&tmp32BitValue, 4, 1, streamFile);
+	put_header_data(header, &tmp32BitValue, 4);
 	
 	// Block Size (always 0 in this case) [0x0C]
 	tmp32BitValue = bswap_32((uint32_t) 0);
-	fwrite(&tmp32BitValue, 4, 1, streamFile);
+	put_header_data(header, &tmp32BitValue, 4);
 }
 
-void AudioOutData::write_stream_headers(FILE **streamFiles) {
-	for (int i = 0; i < numChannels; i++) {
-		write_form_header(streamFiles[i]);
-		write_comm_header(streamFiles[i]);
+// Every channel shares the same headers, so they only need to be serialized once.
+void AudioOutData::write_stream_headers(OutputFile *streamFiles) {
+	uint8_t headerData[FORM_HEADER_SIZE + COMM_HEADER_SIZE + MARK_HEADER_SIZE + INST_HEADER_SIZE + SSND_PRE_HEADER_SIZE];
+	uint8_t *header = headerData;
 
-		if (enableLoop) {
-			write_mark_header(streamFiles[i]);
-			write_inst_header(streamFiles[i]);
-		}
+	write_form_header(&header);
+	write_comm_header(&header);
 
-		write_ssnd_header(streamFiles[i]);
+	if (enableLoop) {
+		write_mark_header(&header);
+		write_inst_header(&header);
 	}
-}
 
-void AudioOutData::cleanup_resample_context() {
-	if (resampleContext != NULL)
-		swr_free(&resampleContext);
-}
+	write_ssnd_header(&header);
 
-int AudioOutData::init_audio_resampling(VGMSTREAM *inFileProperties, int inputBufferSize) {
-	uint64_t channelLayout = (1ULL << numChannels) - 1;
+	StatsTimer timer(&job->stats, STATS_STAGE_WRITE);
+	for (int i = 0; i < numChannels; i++)
+		output_write(&streamFiles[i], headerData, (size_t) (header - headerData));
+	stats_add(&job->stats, &job->stats.bytesWritten, (uint64_t) (header - headerData) * numChannels);
+}
 
-	// Works with 18 channels maximum probably, TODO: research whether different bitflags affect how a thing is resampled if it matters for some reason
-	resampleContext = swr_alloc_set_opts(NULL, (int64_t) channelLayout, AV_SAMPLE_FMT_S16, resampledSampleRate,
-		(int64_t) channelLayout, AV_SAMPLE_FMT_S16, sampleRate, 0, NULL);
-	
-	if (resampleContext == NULL) {
-		printf("...FAILED!\nERROR: Could not allocate resampling context!\n");
-		swr_free(&resampleContext);
-		return RETURN_STREAM_FAILED_RESAMPLING;
-	}
+int AudioOutData::init_audio_resampling(Resampler **context, int channels) {
+	*context = resampler_create(job->resamplerEngine, job->resampleQuality, channels, sampleRate, resampledSampleRate,
+	 (job->bufferLog ? &job->log : NULL));
 
-	if (swr_init(resampleContext) != 0) {
-		printf("...FAILED!\nERROR: Could not initialize resampling context!\n");
-		swr_free(&resampleContext);
-		return RETURN_STREAM_FAILED_RESAMPLING;
-	}
-	
-	if (swr_is_initialized(resampleContext) == 0) {
-		printf("...FAILED!\nERROR: Resample context has not been properly initialized!\n");
-		cleanup_resample_context();
+	if (*context == NULL) {
+		job_printf(job, "...FAILED!\nERROR: Could not initialize resampling context!\n");
 		return RETURN_STREAM_FAILED_RESAMPLING;
 	}
 
 	return RETURN_SUCCESS;
 }
 
-int AudioOutData::resample_audio_data(const sample_t *inputAudioBuffer, sample_t *audioOutBuffer, sample_t *printBuffer,
- FILE **streamFiles, int inputBufferSize, int outputBufferSamples, uint32_t samplesPadded, uint32_t *totalSamplesProcessed) {
-	if (swr_is_initialized(resampleContext) == 0) {
-		printf("...FAILED!\nERROR: Resample context has not been properly initialized!\n");
-		return RETURN_STREAM_FAILED_RESAMPLING;
+// Resamples interleaved input into one buffer per channel, each holding room for outputBufferSamples samples
+int AudioOutData::resample_audio_data(Resampler *context, int channels, const sample_t *inputAudioBuffer, sample_t **audioOutBuffers,
+ int inputBufferSize, int outputBufferSamples, uint32_t samplesPadded, uint32_t *totalSamplesProcessed, uint32_t *samplesToWrite) {
+	StatsTimer timer(&job->stats, STATS_STAGE_RESAMPLE);
+	int result;
+	if (context != NULL) {
+		result = resampler_convert(context, audioOutBuffers, outputBufferSamples, inputAudioBuffer, inputBufferSize);
+	} else {
+		// Channels kept at the source rate by -R auto pass through unfiltered
+		result = min(inputBufferSize, outputBufferSamples);
+		deinterleave_16(inputAudioBuffer, audioOutBuffers, channels, (uint32_t) result);
 	}
 
-	int result = swr_convert(resampleContext, (uint8_t**) &audioOutBuffer, outputBufferSamples, (const uint8_t**) &inputAudioBuffer, inputBufferSize);
-
 	if (result < 0) {
-		printf("...FAILED!\nERROR: Unable to resample given input buffer!\n");
+		job_printf(job, "...FAILED!\nERROR: Unable to resample given input buffer!\n");
 		return RETURN_STREAM_FAILED_RESAMPLING;
 	}
 
 	if (result > outputBufferSamples) {
-		printf("...FAILED!\nERROR: Memory overflow!\n");
+		job_printf(job, "...FAILED!\nERROR: Memory overflow!\n");
 		return RETURN_STREAM_FAILED_RESAMPLING;
 	}
 
 	outputBufferSamples = result;
 
 	// Eliminate any unwanted data for padding
-	int64_t samplesToPadStart = ((int64_t) resampledNumSamples - *totalSamplesProcessed) * (int64_t) numChannels;
+	int64_t samplesToPadStart = (int64_t) resampledNumSamples - *totalSamplesProcessed;
 	if (samplesToPadStart < 0)
 		samplesToPadStart = 0;
-	for (int64_t j = samplesToPadStart; j < (int64_t) outputBufferSamples * (int64_t) numChannels; j++)
-		audioOutBuffer[j] = 0;
-
-	for (int32_t i = 0; i < numChannels; i++) {
-		for (uint64_t j = 0; j < (uint64_t) outputBufferSamples; j++)
-			printBuffer[j] = (sample_t) bswap_16((uint16_t) audioOutBuffer[j * numChannels + i]);
-
-		if (*totalSamplesProcessed + outputBufferSamples > (uint32_t) samplesPadded)
-			fwrite(printBuffer, sizeof(sample_t), samplesPadded - *totalSamplesProcessed, streamFiles[i]);
-		else
-			fwrite(printBuffer, sizeof(sample_t), outputBufferSamples, streamFiles[i]);
+	for (int i = 0; i < channels; i++) {
+		for (int64_t j = samplesToPadStart; j < (int64_t) outputBufferSamples; j++)
+			audioOutBuffers[i][j] = 0;
 	}
 
+	if (*totalSamplesProcessed + outputBufferSamples > (uint32_t) samplesPadded)
+		*samplesToWrite = samplesPadded - *totalSamplesProcessed;
+	else
+		*samplesToWrite = outputBufferSamples;
+
 	*totalSamplesProcessed += outputBufferSamples;
+	stats_add(&job->stats, &job->stats.samplesResampled, (uint64_t) outputBufferSamples * channels);
 
 	return RETURN_SUCCESS;
 }
 
-int AudioOutData::write_resampled_audio_data(VGMSTREAM *inFileProperties, FILE **streamFiles) {
-	uint32_t resampledSamplesPadded = (uint32_t) resampledNumSamples;
-	if (resampledSamplesPadded % SAMPLE_COUNT_PADDING)
-		resampledSamplesPadded += SAMPLE_COUNT_PADDING - (resampledSamplesPadded % SAMPLE_COUNT_PADDING);
-
-	uint32_t bufferSize = MIN_PRINT_BUFFER_SIZE;
-	if (MIN_PRINT_BUFFER_SIZE < SAMPLE_COUNT_PADDING)
-		bufferSize = SAMPLE_COUNT_PADDING;
-
-	sample_t *audioBuffer = new (nothrow) sample_t[bufferSize * (size_t) numChannels];
-	if (audioBuffer == nullptr) {
-		printf("...FAILED!\nERROR: Out of memory!\n");
-		return RETURN_STREAM_FAILED_RESAMPLING;
-	}
+bool allocate_audio_ring(AudioRing *ring, size_t samplesPerBlock, ConversionStats *stats) {
+	bool success = true;
 
-	int retCode = init_audio_resampling(inFileProperties, bufferSize);
-	if (retCode != RETURN_SUCCESS) {
-		delete[] audioBuffer;
-		return retCode;
+	for (size_t i = 0; i < ring->capacity(); i++) {
+		ring->slot(i).samples = new (nothrow) sample_t[samplesPerBlock];
+		stats_count_allocation(stats, samplesPerBlock * sizeof(sample_t));
+		ring->slot(i).frames = 0;
+		if (ring->slot(i).samples == nullptr)
+			success = false;
 	}
 
-	int outputBufferSamples = swr_get_out_samples(resampleContext, bufferSize);
+	return success;
+}
 
-	sample_t *audioOutBuffer = new (nothrow) sample_t[(size_t) outputBufferSamples * (size_t) numChannels];
-	if (audioOutBuffer == nullptr) {
-		printf("...FAILED!\nERROR: Out of memory!\n");
-		cleanup_resample_context();
-		delete[] audioBuffer;
-		return RETURN_STREAM_FAILED_RESAMPLING;
+void free_audio_ring(AudioRing *ring) {
+	for (size_t i = 0; i < ring->capacity(); i++) {
+		delete[] ring->slot(i).samples;
+		ring->slot(i).samples = nullptr;
 	}
+}
 
-	sample_t *printBuffer = new (nothrow) sample_t[(size_t) outputBufferSamples];
-	if (printBuffer == nullptr) {
-		printf("...FAILED!\nERROR: Out of memory!\n");
-		cleanup_resample_context();
-		delete[] audioBuffer;
-		delete[] audioOutBuffer;
-		return RETURN_STREAM_FAILED_RESAMPLING;
+SharedDecode::SharedDecode(size_t jobs) : numJobs(jobs), consumersPerJob(0), ring(NULL), producerClaimed(false), attached(jobs, false),
+ finished(jobs, false), consumersRemaining(0), stopDecoding(false), monoFold(-1) {
+}
+
+SharedDecode::~SharedDecode() {
+	if (ring != NULL) {
+		free_audio_ring(ring);
+		delete ring;
 	}
+}
 
-	uint32_t samplesProcessed = 0;
-	uint32_t resampledSamplesProcessed = 0;
+// Must be called with the lock held. Consumers of jobs that won't ever read shouldn't hold the decoder back.
+static void shared_decode_detach_job(SharedDecode *shared, size_t jobIndex) {
+	for (size_t i = 0; i < shared->consumersPerJob; i++)
+		shared_decode_release(shared, jobIndex * shared->consumersPerJob + i);
+}
 
-	while (true) {
-		int64_t samplesRemaining = numSamples - (int64_t) samplesProcessed;
-		render_vgmstream(audioBuffer, bufferSize, inFileProperties);
+/**
+ * Returns the ring holding the decoded blocks, creating it if this is the first job to get here.
+ * Every job must use the same number of consumers, since they all convert the same input with the same channel layout.
+ * isProducer is set for exactly one job, which has to decode into the ring until stopDecoding gets set.
+ */
+AudioRing *shared_decode_attach(SharedDecode *shared, size_t jobIndex, size_t consumersPerJob, size_t samplesPerBlock, ConversionStats *stats,
+ bool *isProducer) {
+	lock_guard<mutex> lock(shared->lock);
+
+	if (shared->ring == NULL) {
+		AudioRing *ring = new (nothrow) AudioRing(PIPELINE_RING_BLOCKS, shared->numJobs * consumersPerJob);
+		if (ring == nullptr)
+			return NULL;
+		if (!allocate_audio_ring(ring, samplesPerBlock, stats)) {
+			free_audio_ring(ring);
+			delete ring;
+			return NULL;
+		}
 
-		if (enableLoop && vgmstreamLoopPointMismatch && samplesRemaining < bufferSize) {
-			int64_t loopSampleDifference = loopEndSamples - loopStartSamples;
+		shared->ring = ring;
+		shared->consumersPerJob = consumersPerJob;
+		shared->consumersRemaining.store((int) (shared->numJobs * consumersPerJob));
 
-			while (samplesRemaining < bufferSize) {
-				sample_t *startOffset = &(audioBuffer[samplesRemaining * numChannels]);
-				seek_vgmstream(inFileProperties, loopStartSamples);
-				render_vgmstream(startOffset, (int64_t) bufferSize - samplesRemaining, inFileProperties);
-				samplesProcessed = loopStartSamples + (bufferSize - samplesRemaining);
-				samplesRemaining += loopSampleDifference;
-			}
-		} else {
-			samplesProcessed += bufferSize;
+		for (size_t i = 0; i < shared->numJobs; i++) {
+			if (shared->finished[i])
+				shared_decode_detach_job(shared, i);
 		}
+	}
 
-		int retCode = resample_audio_data((const sample_t*) audioBuffer, audioOutBuffer, printBuffer, streamFiles,
-		 (int) bufferSize, outputBufferSamples, resampledSamplesPadded, &resampledSamplesProcessed);
+	if (shared->consumersPerJob != consumersPerJob || shared->attached[jobIndex] || shared->finished[jobIndex])
+		return NULL;
 
-		if (retCode != RETURN_SUCCESS) {
-			cleanup_resample_context();
-			delete[] audioBuffer;
-			delete[] audioOutBuffer;
-			delete[] printBuffer;
+	shared->attached[jobIndex] = true;
+	*isProducer = !shared->producerClaimed;
+	shared->producerClaimed = true;
 
-			return retCode;
-		}
+	return shared->ring;
+}
 
-		if (resampledSamplesProcessed >= resampledSamplesPadded)
-			break;
+// Called once per consumer when it stops reading, whether it's done or failed
+void shared_decode_release(SharedDecode *shared, size_t consumer) {
+	shared->ring->detach(consumer);
+	if (shared->consumersRemaining.fetch_sub(1) == 1) {
+		shared->stopDecoding.store(true);
+		shared->ring->wake();
 	}
-
-	cleanup_resample_context();
-	delete[] printBuffer;
-	delete[] audioOutBuffer;
-	delete[] audioBuffer;
-
-	return RETURN_SUCCESS;
 }
 
-void AudioOutData::write_audio_data(VGMSTREAM *inFileProperties, FILE **streamFiles) {
-	uint32_t samplesPadded = (uint32_t) numSamples;
-	if (samplesPadded % SAMPLE_COUNT_PADDING)
-		samplesPadded += SAMPLE_COUNT_PADDING - (samplesPadded % SAMPLE_COUNT_PADDING);
+// Called once a job is over, so its consumers get released if it never attached
+void shared_decode_finish(SharedDecode *shared, size_t jobIndex) {
+	lock_guard<mutex> lock(shared->lock);
 
-	uint32_t bufferSize = MIN_PRINT_BUFFER_SIZE;
-	if (MIN_PRINT_BUFFER_SIZE < SAMPLE_COUNT_PADDING)
-		bufferSize = SAMPLE_COUNT_PADDING;
+	if (shared->finished[jobIndex])
+		return;
 
-	sample_t *audioBuffer = new sample_t[bufferSize * (size_t) numChannels];
+	shared->finished[jobIndex] = true;
+	if (shared->ring != NULL && !shared->attached[jobIndex])
+		shared_decode_detach_job(shared, jobIndex);
+}
 
-	sample_t **printBuffer = new sample_t*[(size_t) numChannels];
-	for (int i = 0; i < numChannels; i++)
-		printBuffer[i] = new sample_t[bufferSize];
+// Decode stage: renders the stream from the start, zero padding everything past the final sample.
+void AudioOutData::decode_stage(VGMSTREAM *inFileProperties, AudioRing *decodedRing, uint32_t bufferSize, uint32_t samplesPadded,
+ atomic<bool> *cancelled) {
+	seek_to_start(inFileProperties);
 
 	for (uint32_t samplesProcessed = 0; samplesProcessed < samplesPadded; samplesProcessed += bufferSize) {
-		render_vgmstream(audioBuffer, bufferSize, inFileProperties);
+		AudioBlock *block = decodedRing->wait_write(*cancelled);
+		if (block == NULL)
+			break;
+
+		StatsTimer timer(&job->stats, STATS_STAGE_DECODE);
+		sample_t *audioBuffer = block->samples;
+		render_mixed_vgmstream(audioBuffer, bufferSize, inFileProperties, &job->channelMix);
+		stats_add(&job->stats, &job->stats.samplesDecoded, (uint64_t) bufferSize * numChannels);
 
 		// Not using inFileProperties->num_samples here is by intention, so padding is composed of zeros rather than unwanted audio data.
 		int64_t samplesToPadStart = ((int64_t) numSamples - samplesProcessed) * (int64_t) numChannels;
@@ -880,33 +1226,1013 @@ void AudioOutData::write_audio_data(VGMSTREAM *inFileProperties, FILE **streamFi
 		for (int64_t j = samplesToPadStart; j < (int64_t) bufferSize * (int64_t) numChannels; j++)
 			audioBuffer[j] = 0;
 
-		for (uint32_t j = 0; j < bufferSize * (uint32_t) numChannels; j++)
-			printBuffer[j % numChannels][j / numChannels] = (sample_t) bswap_16((uint16_t) audioBuffer[j]);
+		if (samplesProcessed + bufferSize > (uint32_t) samplesPadded)
+			block->frames = samplesPadded - samplesProcessed;
+		else
+			block->frames = bufferSize;
 
-		for (int32_t j = 0; j < numChannels; j++)
-			if (samplesProcessed + bufferSize > (uint32_t) samplesPadded)
-				fwrite(printBuffer[j], sizeof(sample_t), samplesPadded - samplesProcessed, streamFiles[j]);
-			else
-				fwrite(printBuffer[j], sizeof(sample_t), bufferSize, streamFiles[j]);
+		decodedRing->commit_write();
+	}
+
+	decodedRing->close_write();
+}
+
+// Decode stage for resampling: keeps rendering (wrapping around the loop if needed) until the resampler has everything it needs.
+void AudioOutData::decode_looped_stage(VGMSTREAM *inFileProperties, AudioRing *decodedRing, uint32_t bufferSize, atomic<bool> *stopDecoding) {
+	uint32_t samplesProcessed = 0;
+	sample_t *loopCache = NULL;
+	bool loopCacheFilled = false;
+
+	if (enableLoop && vgmstreamLoopPointMismatch)
+		loopCache = allocate_loop_cache();
+
+	seek_to_start(inFileProperties);
+
+	while (true) {
+		AudioBlock *block = decodedRing->wait_write(*stopDecoding);
+		if (block == NULL)
+			break;
+
+		StatsTimer timer(&job->stats, STATS_STAGE_DECODE);
+		sample_t *audioBuffer = block->samples;
+		stats_add(&job->stats, &job->stats.samplesDecoded, (uint64_t) bufferSize * numChannels);
+
+		if (loopCache != NULL) {
+			render_cached_loop(inFileProperties, loopCache, audioBuffer, bufferSize, &samplesProcessed, &loopCacheFilled);
+			block->frames = bufferSize;
+			decodedRing->commit_write();
+			continue;
+		}
+
+		int64_t samplesRemaining = numSamples - (int64_t) samplesProcessed;
+		render_mixed_vgmstream(audioBuffer, bufferSize, inFileProperties, &job->channelMix);
+
+		if (enableLoop && vgmstreamLoopPointMismatch && samplesRemaining < bufferSize) {
+			int64_t loopSampleDifference = loopEndSamples - loopStartSamples;
+
+			while (samplesRemaining < bufferSize) {
+				sample_t *loopOutput = &(audioBuffer[samplesRemaining * numChannels]);
+				seek_vgmstream(inFileProperties, startOffset + loopStartSamples);
+				render_mixed_vgmstream(loopOutput, (int32_t) (bufferSize - samplesRemaining), inFileProperties, &job->channelMix);
+				samplesProcessed = loopStartSamples + (bufferSize - samplesRemaining);
+				samplesRemaining += loopSampleDifference;
+			}
+		} else {
+			samplesProcessed += bufferSize;
+		}
+
+		block->frames = bufferSize;
+		decodedRing->commit_write();
+	}
+
+	delete[] loopCache;
+	decodedRing->close_write();
+}
+
+sample_t *AudioOutData::allocate_samples(size_t count) {
+	stats_count_allocation(&job->stats, count * sizeof(sample_t));
+	return new (nothrow) sample_t[count];
+}
+
+// Returns a buffer large enough to hold the decoded loop body, or NULL if it exceeds the loop cache limit.
+sample_t *AudioOutData::allocate_loop_cache() {
+	uint64_t loopCacheSize = (uint64_t) (loopEndSamples - loopStartSamples) * (uint64_t) numChannels * sizeof(sample_t);
+	if (loopCacheSize == 0 || loopCacheSize > (uint64_t) job->loopCacheLimit)
+		return NULL;
+
+	return allocate_samples((size_t) (loopEndSamples - loopStartSamples) * (size_t) numChannels);
+}
+
+/**
+ * Fills one block of the looped stream without ever seeking. The first pass through the stream is rendered as usual while the loop
+ * body gets captured into loopCache; every later pass through the loop is replayed from there.
+ * position holds the current position within the stream, which wraps back to the loop start once the loop end is reached.
+ */
+void AudioOutData::render_cached_loop(VGMSTREAM *inFileProperties, sample_t *loopCache, sample_t *audioBuffer, uint32_t bufferSize,
+ uint32_t *position, bool *cacheFilled) {
+	uint32_t framesFilled = 0;
+
+	while (framesFilled < bufferSize) {
+		uint32_t frames = bufferSize - framesFilled;
+		sample_t *output = &audioBuffer[(size_t) framesFilled * numChannels];
+
+		if (!*cacheFilled) {
+			render_mixed_vgmstream(output, (int32_t) frames, inFileProperties, &job->channelMix);
+
+			int64_t captureStart = max((int64_t) *position, (int64_t) loopStartSamples);
+			int64_t captureEnd = min((int64_t) *position + frames, (int64_t) loopEndSamples);
+			if (captureStart < captureEnd) {
+				memcpy(&loopCache[(size_t) (captureStart - loopStartSamples) * numChannels], &output[(size_t) (captureStart - *position) * numChannels],
+				 (size_t) (captureEnd - captureStart) * numChannels * sizeof(sample_t));
+			}
+
+			if ((int64_t) *position + frames < (int64_t) numSamples) {
+				*position += frames;
+				framesFilled += frames;
+			} else {
+				// Anything rendered past the loop end gets overwritten with the start of the loop
+				framesFilled += numSamples - *position;
+				*position = loopStartSamples;
+				*cacheFilled = true;
+			}
+		} else {
+			if (frames > (uint32_t) (loopEndSamples - *position))
+				frames = loopEndSamples - *position;
+
+			memcpy(output, &loopCache[(size_t) (*position - loopStartSamples) * numChannels], (size_t) frames * numChannels * sizeof(sample_t));
+
+			*position += frames;
+			framesFilled += frames;
+			if (*position == (uint32_t) loopEndSamples)
+				*position = loopStartSamples;
+		}
+	}
+}
+
+// Points the output of every channel at the next length bytes of its file, or at printBuffer for files that can't be written in place
+static void reserve_channel_outputs(OutputFile *streamFiles, sample_t **printBuffer, int channels, size_t length, sample_t **outputs) {
+	for (int i = 0; i < channels; i++) {
+		outputs[i] = (sample_t*) output_reserve(&streamFiles[i], length);
+		if (outputs[i] == NULL)
+			outputs[i] = printBuffer[i];
+	}
+}
+
+/**
+ * Splits interleaved samples into their channels and appends them to the matching output files.
+ * Mapped files receive the big-endian samples in place; anything else goes through printBuffer first.
+ * Input is native samples unless bigEndianInput is set, for PCM taken straight from a big-endian source.
+ */
+static void write_channel_samples(const sample_t *input, sample_t **printBuffer, OutputFile *streamFiles, int channels, uint32_t frames,
+ ConversionStats *stats, bool bigEndianInput = false) {
+	sample_t *outputs[NUM_CHANNELS_MAX];
+	size_t length = (size_t) frames * sizeof(sample_t);
+
+	reserve_channel_outputs(streamFiles, printBuffer, channels, length, outputs);
+
+	{
+		StatsTimer timer(stats, STATS_STAGE_BYTESWAP);
+		if (bigEndianInput)
+			deinterleave_16(input, outputs, channels, frames);
+		else
+			deinterleave_bswap_16(input, outputs, channels, frames);
+	}
+
+	stats_add(stats, &stats->samplesWritten, (uint64_t) frames * channels);
+	if (!streamFiles[0].inMemory) // Encoded streams are counted once they actually get written out
+		stats_add(stats, &stats->bytesWritten, (uint64_t) length * channels);
+
+	StatsTimer timer(stats, STATS_STAGE_WRITE);
+	for (int i = 0; i < channels; i++) {
+		if (outputs[i] == printBuffer[i])
+			output_write(&streamFiles[i], printBuffer[i], length);
+		else
+			output_advance(&streamFiles[i], length);
+	}
+}
+
+/**
+ * Appends the first frames samples of each channel, produced straight into the outputs given by reserve_channel_outputs.
+ * Those only need converting to big-endian where they already are, after which any left in printBuffer get written out.
+ */
+static void write_reserved_samples(sample_t **outputs, sample_t **printBuffer, OutputFile *streamFiles, int channels, uint32_t frames,
+ ConversionStats *stats) {
+	size_t length = (size_t) frames * sizeof(sample_t);
+
+	{
+		StatsTimer timer(stats, STATS_STAGE_BYTESWAP);
+		for (int i = 0; i < channels; i++)
+			bswap_16_inplace(outputs[i], frames);
+	}
+
+	stats_add(stats, &stats->samplesWritten, (uint64_t) frames * channels);
+	if (!streamFiles[0].inMemory)
+		stats_add(stats, &stats->bytesWritten, (uint64_t) length * channels);
+
+	StatsTimer timer(stats, STATS_STAGE_WRITE);
+	for (int i = 0; i < channels; i++) {
+		if (outputs[i] == printBuffer[i])
+			output_write(&streamFiles[i], printBuffer[i], length);
+		else
+			output_advance(&streamFiles[i], length);
+	}
+}
+
+// Keeps the loudest sample of each channel for --prune-silence, which is the only reason to look at them at all
+void AudioOutData::track_channel_peaks(const sample_t *input, int firstChannel, int channels, uint32_t frames, bool bigEndian) {
+	if (job->channelPeaks.empty())
+		return;
+
+	StatsTimer timer(&job->stats, STATS_STAGE_ANALYZE);
+	channel_peaks_16(input, channels, frames, bigEndian, &job->channelPeaks[(size_t) firstChannel]);
+}
+
+// Channels that never got louder than the silence threshold, keeping the first one if every channel is silent
+uint16_t AudioOutData::find_silent_channels() {
+	uint16_t silentFlags = 0;
+	if (job->channelPeaks.empty())
+		return silentFlags;
+
+	for (int i = 0; i < numChannels; i++) {
+		if (job->channelPeaks[i] <= job->silenceThreshold)
+			silentFlags |= (uint16_t) (1 << i);
+	}
+
+	if (silentFlags == (uint16_t) ((1ULL << numChannels) - 1ULL))
+		silentFlags &= (uint16_t) ~1;
+
+	return silentFlags;
+}
+
+// Write stage: splits each block into its channels and appends them to the stream files.
+void AudioOutData::write_stage(AudioRing *ring, sample_t **printBuffer, OutputFile *streamFiles, atomic<bool> *cancelled) {
+	while (true) {
+		AudioBlock *block = ring->wait_read(*cancelled);
+		if (block == NULL)
+			break;
+
+		track_channel_peaks(block->samples, 0, numChannels, block->frames, false);
+		write_channel_samples(block->samples, printBuffer, streamFiles, numChannels, block->frames, &job->stats);
+
+		ring->release_read();
+	}
+}
+
+/**
+ * Resamples and writes one group of adjacent channels on its own thread, reading from the decoded blocks shared by all groups.
+ * Each group gets its own resampler with identical settings, so sample counts and padding match the single resampler path exactly.
+ * Resampled samples go straight into the space reserved for them in the output files, leaving only the byteswap to do there.
+ */
+int AudioOutData::resample_channel_group(SharedDecode *shared, size_t consumer, int firstChannel, int groupChannels, OutputFile *streamFiles,
+ uint32_t bufferSize, uint32_t resampledSamplesPadded, atomic<bool> *cancelled) {
+	AudioRing *decodedRing = shared->ring;
+	Resampler *context = NULL;
+	sample_t *groupBuffer = NULL;
+	sample_t **printBuffer = NULL;
+	sample_t *printBufferData = NULL;
+	int outputBufferSamples = 0;
+
+	// A group of every decoded channel resamples the decoded blocks as they are
+	bool gatherGroup = (groupChannels != decodedChannels);
+
+	int retCode = RETURN_SUCCESS;
+	if (resample)
+		retCode = init_audio_resampling(&context, groupChannels);
+	if (retCode == RETURN_SUCCESS) {
+		outputBufferSamples = (context != NULL ? resampler_get_out_samples(context, (int) bufferSize) : (int) bufferSize);
+
+		if (gatherGroup)
+			groupBuffer = allocate_samples(bufferSize * (size_t) groupChannels);
+		printBuffer = new (nothrow) sample_t*[(size_t) groupChannels];
+		printBufferData = allocate_samples((size_t) outputBufferSamples * (size_t) groupChannels);
+
+		if ((gatherGroup && groupBuffer == nullptr) || printBuffer == nullptr || printBufferData == nullptr) {
+			job_printf(job, "...FAILED!\nERROR: Out of memory!\n");
+			retCode = RETURN_STREAM_OUT_OF_MEMORY;
+		}
+	}
+
+	if (retCode == RETURN_SUCCESS) {
+		uint32_t resampledSamplesProcessed = 0;
+		uint32_t samplesToWrite = 0;
+		sample_t *outputs[NUM_CHANNELS_MAX];
+
+		for (int i = 0; i < groupChannels; i++)
+			printBuffer[i] = &printBufferData[(size_t) outputBufferSamples * i];
+
+		while (resampledSamplesProcessed < resampledSamplesPadded) {
+			AudioBlock *block = decodedRing->wait_read(*cancelled, consumer);
+			if (block == NULL)
+				break;
+
+			const sample_t *input = block->samples;
+			if (gatherGroup) {
+				const sample_t *src = block->samples + firstChannel;
+				sample_t *dst = groupBuffer;
+				for (uint32_t j = 0; j < bufferSize; j++, src += decodedChannels, dst += groupChannels) {
+					for (int i = 0; i < groupChannels; i++)
+						dst[i] = src[i];
+				}
+
+				decodedRing->release_read(consumer);
+				input = groupBuffer;
+			}
+
+			reserve_channel_outputs(&streamFiles[firstChannel], printBuffer, groupChannels, (size_t) outputBufferSamples * sizeof(sample_t), outputs);
+
+			retCode = resample_audio_data(context, groupChannels, input, outputs, (int) bufferSize, outputBufferSamples, resampledSamplesPadded,
+			 &resampledSamplesProcessed, &samplesToWrite);
+
+			if (!gatherGroup)
+				decodedRing->release_read(consumer);
+
+			if (retCode != RETURN_SUCCESS)
+				break;
+
+			for (int i = 0; i < groupChannels; i++)
+				track_channel_peaks(outputs[i], firstChannel + i, 1, samplesToWrite, false);
+			write_reserved_samples(outputs, printBuffer, &streamFiles[firstChannel], groupChannels, samplesToWrite, &job->stats);
+		}
+	}
+
+	// Only stops the other groups of this job, jobs sharing the decode carry on
+	if (retCode != RETURN_SUCCESS) {
+		cancelled->store(true);
+		decodedRing->wake();
+	}
+
+	shared_decode_release(shared, consumer);
+
+	resampler_free(&context);
+	delete[] groupBuffer;
+	delete[] printBuffer;
+	delete[] printBufferData;
+
+	return retCode;
+}
+
+/**
+ * Without a decode shared with other jobs, this job simply gets a shared decode of its own, which it always ends up producing.
+ * Otherwise, only the first job to get here decodes, on its calling thread like it would for itself.
+ */
+int AudioOutData::write_resampled_channel_groups(VGMSTREAM *inFileProperties, OutputFile *streamFiles, uint32_t bufferSize,
+ uint32_t resampledSamplesPadded, int groupSize) {
+	int numGroups = (numChannels + groupSize - 1) / groupSize;
+
+	SharedDecode ownDecode(1);
+	SharedDecode *shared = (job->sharedDecode != NULL ? job->sharedDecode : &ownDecode);
+	size_t jobIndex = (job->sharedDecode != NULL ? job->sharedDecodeIndex : 0);
+
+	bool isProducer = false;
+	if (shared_decode_attach(shared, jobIndex, (size_t) numGroups, bufferSize * (size_t) numChannels, &job->stats, &isProducer) == NULL) {
+		job_printf(job, "...FAILED!\nERROR: Out of memory!\n");
+		return RETURN_STREAM_OUT_OF_MEMORY;
+	}
+
+	atomic<bool> cancelled(false);
+
+	vector<int> groupRetCodes((size_t) numGroups, RETURN_SUCCESS);
+	vector<thread> groupThreads;
+
+	for (int i = 0; i < numGroups; i++) {
+		int firstChannel = i * groupSize;
+		int groupChannels = min(groupSize, numChannels - firstChannel);
+		size_t consumer = jobIndex * (size_t) numGroups + (size_t) i;
+
+		groupThreads.emplace_back([&, i, consumer, firstChannel, groupChannels]() {
+			groupRetCodes[i] = resample_channel_group(shared, consumer, firstChannel, groupChannels, streamFiles, bufferSize,
+			 resampledSamplesPadded, &cancelled);
+		});
+	}
+
+	// Decoding stays on the calling thread, since every group depends on it anyway
+	if (isProducer)
+		decode_looped_stage(inFileProperties, shared->ring, bufferSize, &shared->stopDecoding);
+
+	for (size_t i = 0; i < groupThreads.size(); i++)
+		groupThreads[i].join();
+
+	for (int i = 0; i < numGroups; i++) {
+		if (groupRetCodes[i] != RETURN_SUCCESS)
+			return groupRetCodes[i];
+	}
+
+	return RETURN_SUCCESS;
+}
+
+/**
+ * Decoding and resampling run on separate threads, passing fixed-size blocks through a bounded ring.
+ * Resampling produces every channel right where it belongs in the output files, so there's no separate write stage to hand it to.
+ * With a resample group size set, channels are split into groups that are each resampled and written on their own thread.
+ */
+int AudioOutData::write_resampled_audio_data(VGMSTREAM *inFileProperties, OutputFile *streamFiles) {
+	uint32_t resampledSamplesPadded = (uint32_t) resampledNumSamples;
+	if (resampledSamplesPadded % SAMPLE_COUNT_PADDING)
+		resampledSamplesPadded += SAMPLE_COUNT_PADDING - (resampledSamplesPadded % SAMPLE_COUNT_PADDING);
+
+	uint32_t bufferSize = MIN_PRINT_BUFFER_SIZE;
+	if (MIN_PRINT_BUFFER_SIZE < SAMPLE_COUNT_PADDING)
+		bufferSize = SAMPLE_COUNT_PADDING;
+
+	bool splitGroups = (job->resampleGroupSize > 0 && job->resampleGroupSize < numChannels);
+	return write_resampled_channel_groups(inFileProperties, streamFiles, bufferSize, resampledSamplesPadded,
+	 (splitGroups ? (int) job->resampleGroupSize : numChannels));
+}
+
+/**
+ * Converts every channel to its own rate from -R auto, using the channels of channelData that each describe one of them.
+ * All channels read from a single decode, each resampled and written on its own thread like a resample group of one channel.
+ */
+int AudioOutData::write_channel_rate_audio_data(VGMSTREAM *inFileProperties, OutputFile *streamFiles, vector<AudioOutData> &channelData) {
+	uint32_t bufferSize = MIN_PRINT_BUFFER_SIZE;
+	if (MIN_PRINT_BUFFER_SIZE < SAMPLE_COUNT_PADDING)
+		bufferSize = SAMPLE_COUNT_PADDING;
+
+	SharedDecode shared(1);
+	bool isProducer = false;
+	if (shared_decode_attach(&shared, 0, (size_t) numChannels, bufferSize * (size_t) numChannels, &job->stats, &isProducer) == NULL) {
+		job_printf(job, "...FAILED!\nERROR: Out of memory!\n");
+		return RETURN_STREAM_OUT_OF_MEMORY;
+	}
+
+	atomic<bool> cancelled(false);
+
+	vector<int> channelRetCodes((size_t) numChannels, RETURN_SUCCESS);
+	vector<thread> channelThreads;
+
+	for (int i = 0; i < numChannels; i++) {
+		uint32_t resampledSamplesPadded = (uint32_t) channelData[i].resampledNumSamples;
+		if (resampledSamplesPadded % SAMPLE_COUNT_PADDING)
+			resampledSamplesPadded += SAMPLE_COUNT_PADDING - (resampledSamplesPadded % SAMPLE_COUNT_PADDING);
+
+		channelThreads.emplace_back([&, i, resampledSamplesPadded]() {
+			channelRetCodes[i] = channelData[i].resample_channel_group(&shared, (size_t) i, i, 1, streamFiles, bufferSize,
+			 resampledSamplesPadded, &cancelled);
+		});
+	}
+
+	decode_looped_stage(inFileProperties, shared.ring, bufferSize, &shared.stopDecoding);
+
+	for (size_t i = 0; i < channelThreads.size(); i++)
+		channelThreads[i].join();
+
+	for (int i = 0; i < numChannels; i++) {
+		if (channelRetCodes[i] != RETURN_SUCCESS)
+			return channelRetCodes[i];
+	}
+
+	return RETURN_SUCCESS;
+}
+
+// Decodes [start, end) of the stream straight into the per-channel outputs, which point at sample 0 of every channel
+void AudioOutData::decode_segment(VGMSTREAM *vgmstream, int32_t start, int32_t end, sample_t **outputs, sample_t *audioBuffer, uint32_t bufferSize) {
+	sample_t *positions[NUM_CHANNELS_MAX];
+
+	for (int32_t position = start; position < end; position += (int32_t) bufferSize) {
+		uint32_t frames = (uint32_t) min((int32_t) bufferSize, end - position);
+
+		{
+			StatsTimer timer(&job->stats, STATS_STAGE_DECODE);
+			render_mixed_vgmstream(audioBuffer, (int32_t) frames, vgmstream, &job->channelMix);
+			stats_add(&job->stats, &job->stats.samplesDecoded, (uint64_t) frames * numChannels);
+		}
+
+		for (int i = 0; i < numChannels; i++)
+			positions[i] = outputs[i] + position;
+
+		StatsTimer timer(&job->stats, STATS_STAGE_BYTESWAP);
+		deinterleave_bswap_16(audioBuffer, positions, numChannels, frames);
+		stats_add(&job->stats, &job->stats.samplesWritten, (uint64_t) frames * numChannels);
+	}
+}
+
+// Decodes [start, end) only to settle the decoder, keeping the last SEGMENT_HISTORY_SAMPLES frames to check the result against
+void AudioOutData::warm_up_segment(VGMSTREAM *vgmstream, int32_t start, int32_t end, sample_t *history, sample_t *audioBuffer, uint32_t bufferSize) {
+	for (int32_t position = start; position < end; position += (int32_t) bufferSize) {
+		uint32_t frames = (uint32_t) min((int32_t) bufferSize, end - position);
+
+		StatsTimer timer(&job->stats, STATS_STAGE_DECODE);
+		render_mixed_vgmstream(audioBuffer, (int32_t) frames, vgmstream, &job->channelMix);
+		stats_add(&job->stats, &job->stats.samplesDecoded, (uint64_t) frames * numChannels);
+
+		for (uint32_t i = (frames > SEGMENT_HISTORY_SAMPLES ? frames - SEGMENT_HISTORY_SAMPLES : 0); i < frames; i++) {
+			memmove(history, &history[numChannels], sizeof(sample_t) * numChannels * (SEGMENT_HISTORY_SAMPLES - 1));
+			memcpy(&history[numChannels * (SEGMENT_HISTORY_SAMPLES - 1)], &audioBuffer[(size_t) i * numChannels], sizeof(sample_t) * numChannels);
+		}
+	}
+}
+
+int AudioOutData::get_decode_segment_count(VGMSTREAM *inFileProperties, uint32_t samplesPadded) {
+	if (job->decodeThreads <= 1 || get_segment_seek_type(inFileProperties) == SEGMENT_SEEK_NONE)
+		return 1;
+
+	// Warm-up checks compare written samples with what the decoder produced, which only tells anything about its state if they weren't mixed
+	if (job->channelMix.outputChannels > 0)
+		return 1;
+
+	// Segments are decoded without ever reaching the loop end, so the stream must never loop back within them
+	int32_t decodeEnd = min(numSamples, (int32_t) samplesPadded);
+	if (inFileProperties->loop_flag && startOffset + decodeEnd > inFileProperties->loop_end_sample)
+		return 1;
+
+	int64_t numSegments = min(job->decodeThreads, (int64_t) (decodeEnd / SEGMENT_MIN_SAMPLES));
+	return (int) max(numSegments, (int64_t) 1);
+}
+
+/**
+ * Splits the stream into ranges that are each decoded by their own VGMSTREAM on their own thread, straight into the mapped output files.
+ * Instances for codecs with decoder state start early to warm up; once every range is done, the last warm-up samples of each range
+ * are compared with what the previous range decoded at the same position. If they differ, the range gets decoded again by continuing
+ * the instance of the previous range, so the output is always identical to decoding serially.
+ * Returns false without writing anything if the stream or the output files don't allow this.
+ */
+bool AudioOutData::write_segmented_audio_data(VGMSTREAM *inFileProperties, OutputFile *streamFiles, uint32_t samplesPadded, int numSegments) {
+	sample_t *outputs[NUM_CHANNELS_MAX];
+	for (int i = 0; i < numChannels; i++) {
+		outputs[i] = (sample_t*) output_reserve(&streamFiles[i], (size_t) samplesPadded * sizeof(sample_t));
+		if (outputs[i] == NULL)
+			return false;
+	}
+
+	int32_t decodeEnd = min(numSamples, (int32_t) samplesPadded);
+	bool warmUp = (get_segment_seek_type(inFileProperties) == SEGMENT_SEEK_WARMUP);
+	uint32_t bufferSize = MIN_PRINT_BUFFER_SIZE;
+
+	vector<VGMSTREAM*> instances((size_t) numSegments, NULL);
+	vector<int32_t> starts((size_t) numSegments + 1);
+	sample_t *audioBuffers = allocate_samples((size_t) bufferSize * numChannels * numSegments);
+	sample_t *histories = allocate_samples((size_t) SEGMENT_HISTORY_SAMPLES * numChannels * numSegments);
+
+	bool opened = (audioBuffers != nullptr && histories != nullptr);
+	for (int i = 0; i <= numSegments; i++)
+		starts[i] = (int32_t) ((int64_t) decodeEnd * i / numSegments);
+
+	// The first range is decoded by the already opened stream. Ranges start at output positions, which lie startOffset into the source.
+	instances[0] = inFileProperties;
+	for (int i = 1; i < numSegments && opened; i++) {
+		int32_t sourceStart = startOffset + starts[i];
+		instances[i] = open_input_vgmstream(job->inFilename, &job->stats, job->subsong);
+		opened = (instances[i] != NULL && position_vgmstream(instances[i], (warmUp ? get_segment_warmup_start(instances[i], sourceStart) : sourceStart)));
+	}
+
+	if (!opened) {
+		for (int i = 1; i < numSegments; i++)
+			if (instances[i] != NULL)
+				close_vgmstream(instances[i]);
+		delete[] audioBuffers;
+		delete[] histories;
+		return false;
+	}
+
+	seek_to_start(inFileProperties);
+
+	auto decode_range = [&](int i) {
+		sample_t *audioBuffer = &audioBuffers[(size_t) bufferSize * numChannels * i];
+		if (warmUp && i > 0)
+			warm_up_segment(instances[i], instances[i]->current_sample, startOffset + starts[i], &histories[(size_t) SEGMENT_HISTORY_SAMPLES * numChannels * i],
+			 audioBuffer, bufferSize);
+		decode_segment(instances[i], starts[i], starts[i + 1], outputs, audioBuffer, bufferSize);
+	};
+
+	vector<thread> segmentThreads;
+	for (int i = 1; i < numSegments; i++)
+		segmentThreads.emplace_back(decode_range, i);
+
+	decode_range(0);
+
+	for (size_t i = 0; i < segmentThreads.size(); i++)
+		segmentThreads[i].join();
+
+	// Every check relies on the range before it being final already, so ranges are verified in order
+	VGMSTREAM *exactInstance = instances[0];
+	for (int i = 1; i < numSegments; i++) {
+		bool matches = true;
+		sample_t *history = &histories[(size_t) SEGMENT_HISTORY_SAMPLES * numChannels * i];
+
+		for (int j = 0; warmUp && j < SEGMENT_HISTORY_SAMPLES * numChannels && matches; j++) {
+			sample_t expected = (sample_t) bswap_16((uint16_t) outputs[j % numChannels][starts[i] - SEGMENT_HISTORY_SAMPLES + j / numChannels]);
+
+			// Clipped samples don't tell what the decoder history holds
+			matches = (history[j] == expected && expected != INT16_MAX && expected != INT16_MIN);
+		}
+
+		if (matches) {
+			exactInstance = instances[i];
+		} else {
+			decode_segment(exactInstance, starts[i], starts[i + 1], outputs, audioBuffers, bufferSize);
+		}
+	}
+
+	for (int i = 1; i < numSegments; i++)
+		close_vgmstream(instances[i]);
+	delete[] audioBuffers;
+	delete[] histories;
+
+	// Padding is composed of zeros, just like with serial decoding
+	for (int i = 0; i < numChannels; i++) {
+		track_channel_peaks(outputs[i], i, 1, (uint32_t) decodeEnd, true);
+		memset(&outputs[i][decodeEnd], 0, (samplesPadded - (uint32_t) decodeEnd) * sizeof(sample_t));
+		output_advance(&streamFiles[i], (size_t) samplesPadded * sizeof(sample_t));
+	}
+
+	if (!streamFiles[0].inMemory)
+		stats_add(&job->stats, &job->stats.bytesWritten, (uint64_t) samplesPadded * sizeof(sample_t) * numChannels);
+
+	return true;
+}
+
+/**
+ * Returns where the samples of a plain 16-bit PCM stream start within the mapped input, or NULL if it has to be decoded.
+ * Only frame interleaved data (every channel's sample for one frame, then the next frame) with nothing applied on top by vgmstream qualifies.
+ */
+const uint8_t *AudioOutData::get_passthrough_data(VGMSTREAM *inFileProperties, off_t *dataOffset) {
+	if (inFileProperties->coding_type != coding_PCM16LE && inFileProperties->coding_type != coding_PCM16BE)
+		return NULL;
+	if (inFileProperties->config_enabled || inFileProperties->meta_type == meta_TXTP || inFileProperties->current_sample != 0)
+		return NULL;
+	if (job->channelMix.outputChannels > 0) // Mixed channels only exist once rendered
+		return NULL;
+
+	bool frameInterleaved = (inFileProperties->layout_type == layout_interleave && inFileProperties->interleave_block_size == 2 &&
+	 inFileProperties->interleave_first_block_size == 0 && inFileProperties->interleave_first_skip == 0);
+	if (!frameInterleaved && !(inFileProperties->layout_type == layout_none && numChannels == 1))
+		return NULL;
+
+	off_t start = inFileProperties->ch[0].offset;
+	for (int i = 1; i < numChannels; i++) {
+		if (inFileProperties->ch[i].offset != start + (off_t) i * 2 || inFileProperties->ch[i].streamfile != inFileProperties->ch[0].streamfile)
+			return NULL;
+	}
+
+	size_t inputSize = 0;
+	const uint8_t *input = get_input_mapping(inFileProperties->ch[0].streamfile, &inputSize);
+	// Samples before the start offset are simply skipped over
+	start += (off_t) startOffset * numChannels * 2;
+	if (input == NULL || start < 0 || start % 2 != 0 || (uint64_t) start + (uint64_t) numSamples * numChannels * 2 > inputSize)
+		return NULL;
+
+	*dataOffset = start;
+	return input;
+}
+
+/**
+ * Fast path for plain 16-bit PCM input: samples are split and byteswapped straight from the mapped input into the outputs,
+ * without vgmstream decoding anything. Big-endian mono input is copied by the kernel where possible.
+ * Output is identical to decoding, padding included. Returns false if the input doesn't qualify.
+ */
+bool AudioOutData::write_passthrough_audio_data(VGMSTREAM *inFileProperties, OutputFile *streamFiles, uint32_t samplesPadded, uint32_t bufferSize) {
+	off_t dataOffset = 0;
+	const uint8_t *input = get_passthrough_data(inFileProperties, &dataOffset);
+	if (input == NULL)
+		return false;
+
+	bool bigEndian = (inFileProperties->coding_type == coding_PCM16BE);
+	size_t frameBytes = (size_t) numChannels * sizeof(sample_t);
+
+	if (bigEndian && numChannels == 1) {
+		StatsTimer timer(&job->stats, STATS_STAGE_WRITE);
+		size_t length = (size_t) numSamples * sizeof(sample_t);
+
+		if (output_copy_from(&streamFiles[0], get_input_fd(inFileProperties->ch[0].streamfile), (int64_t) dataOffset, length)) {
+			track_channel_peaks((const sample_t*) (input + dataOffset), 0, 1, (uint32_t) numSamples, true);
+
+			sample_t padding[SAMPLE_COUNT_PADDING] = {0};
+			output_write(&streamFiles[0], padding, (size_t) (samplesPadded - (uint32_t) numSamples) * sizeof(sample_t));
+
+			stats_add(&job->stats, &job->stats.samplesWritten, samplesPadded);
+			stats_add(&job->stats, &job->stats.bytesWritten, (uint64_t) samplesPadded * sizeof(sample_t));
+			return true;
+		}
+	}
+
+	sample_t **printBuffer = new (nothrow) sample_t*[(size_t) numChannels];
+	sample_t *printBufferData = allocate_samples(bufferSize * (size_t) numChannels);
+	sample_t *tailBuffer = allocate_samples(bufferSize * (size_t) numChannels);
+
+	if (printBuffer == nullptr || printBufferData == nullptr || tailBuffer == nullptr) {
+		delete[] printBuffer;
+		delete[] printBufferData;
+		delete[] tailBuffer;
+		return false;
 	}
+	for (int i = 0; i < numChannels; i++)
+		printBuffer[i] = &printBufferData[(size_t) bufferSize * i];
+
+	for (uint32_t samplesProcessed = 0; samplesProcessed < samplesPadded; samplesProcessed += bufferSize) {
+		uint32_t frames = min(bufferSize, samplesPadded - samplesProcessed);
+		uint32_t available = (samplesProcessed < (uint32_t) numSamples ? min(frames, (uint32_t) numSamples - samplesProcessed) : 0);
+		const uint8_t *src = input + dataOffset + (size_t) samplesProcessed * frameBytes;
+
+		// The last block is zero padded past the final sample, same as when decoding
+		if (available < frames) {
+			memcpy(tailBuffer, src, (size_t) available * frameBytes);
+			memset(&tailBuffer[(size_t) available * numChannels], 0, (size_t) (frames - available) * frameBytes);
+			src = (const uint8_t*) tailBuffer;
+		}
+
+		track_channel_peaks((const sample_t*) src, 0, numChannels, frames, bigEndian);
+		write_channel_samples((const sample_t*) src, printBuffer, streamFiles, numChannels, frames, &job->stats, bigEndian);
+	}
+
+	delete[] printBuffer;
+	delete[] printBufferData;
+	delete[] tailBuffer;
+
+	return true;
+}
+
+int AudioOutData::write_audio_data(VGMSTREAM *inFileProperties, OutputFile *streamFiles) {
+	uint32_t samplesPadded = (uint32_t) numSamples;
+	if (samplesPadded % SAMPLE_COUNT_PADDING)
+		samplesPadded += SAMPLE_COUNT_PADDING - (samplesPadded % SAMPLE_COUNT_PADDING);
+
+	uint32_t bufferSize = MIN_PRINT_BUFFER_SIZE;
+	if (MIN_PRINT_BUFFER_SIZE < SAMPLE_COUNT_PADDING)
+		bufferSize = SAMPLE_COUNT_PADDING;
+
+	if (write_passthrough_audio_data(inFileProperties, streamFiles, samplesPadded, bufferSize))
+		return RETURN_SUCCESS;
+
+	int numSegments = get_decode_segment_count(inFileProperties, samplesPadded);
+	if (numSegments > 1 && write_segmented_audio_data(inFileProperties, streamFiles, samplesPadded, numSegments))
+		return RETURN_SUCCESS;
+
+	AudioRing decodedRing(PIPELINE_RING_BLOCKS);
 
+	sample_t **printBuffer = new (nothrow) sample_t*[(size_t) numChannels];
+	sample_t *printBufferData = allocate_samples(bufferSize * (size_t) numChannels);
+
+	if (!allocate_audio_ring(&decodedRing, bufferSize * (size_t) numChannels, &job->stats) || printBuffer == nullptr || printBufferData == nullptr) {
+		job_printf(job, "...FAILED!\nERROR: Out of memory!\n");
+		free_audio_ring(&decodedRing);
+		delete[] printBuffer;
+		delete[] printBufferData;
+		return RETURN_STREAM_OUT_OF_MEMORY;
+	}
 	for (int i = 0; i < numChannels; i++)
-		delete[] printBuffer[i];
+		printBuffer[i] = &printBufferData[(size_t) bufferSize * i];
+
+	atomic<bool> cancelled(false);
+
+	thread decodeThread(&AudioOutData::decode_stage, this, inFileProperties, &decodedRing, bufferSize, samplesPadded, &cancelled);
+
+	write_stage(&decodedRing, printBuffer, streamFiles, &cancelled);
+
+	decodeThread.join();
+
+	free_audio_ring(&decodedRing);
 	delete[] printBuffer;
-	delete[] audioBuffer;
+	delete[] printBufferData;
+
+	return RETURN_SUCCESS;
+}
+
+// Restores the samples of one channel from its big-endian PCM, extended past the loop end as laid out by calculate_aifc_file_size
+void AudioOutData::fill_vadpcm_samples(const uint8_t *pcmData, size_t pcmSamples, sample_t *samples) {
+	const uint16_t *pcm = (const uint16_t*) pcmData;
+	uint32_t loopLength = (uint32_t) (resampledLoopEndSamples - resampledLoopStartSamples);
+
+	size_t available = min(pcmSamples, (size_t) vadpcmNumSamples);
+	if (enableLoop)
+		available = min(available, (size_t) resampledLoopEndSamples);
+
+	for (size_t i = 0; i < available; i++)
+		samples[i] = (sample_t) bswap_16(pcm[i]);
+
+	for (size_t i = available; i < vadpcmNumSamples; i++) {
+		if (enableLoop && loopLength > 0 && i >= (size_t) resampledLoopEndSamples)
+			samples[i] = samples[resampledLoopStartSamples + (i - resampledLoopEndSamples) % loopLength];
+		else
+			samples[i] = 0;
+	}
+}
+
+// Trains a codebook for one channel and serializes the complete AIFC file into aifcData (fileSize bytes)
+size_t AudioOutData::write_aifc_data(const sample_t *samples, int numThreads, uint8_t *aifcData) {
+	const char formHeader[] = "FORM";
+	const char aifcHeader[] = "AIFC";
+	const char commHeader[] = "COMM";
+	const char compressionType[] = "VAPC";
+	const char compressionName[] = "\x0bVADPCM ~4-1";
+	const char applHeader[] = "APPL";
+	const char applSignature[] = "stoc";
+	const char codesName[] = "\x0bVADPCMCODES";
+	const char loopsName[] = "\x0bVADPCMLOOPS";
+	const char ssndHeader[] = "SSND";
+	uint8_t *header = aifcData;
+	uint16_t tmp16BitValue;
+	uint32_t tmp32BitValue;
+
+	uint32_t numFrames = vadpcmNumSamples / VADPCM_FRAME_SAMPLES;
+	uint32_t dataSize = numFrames * VADPCM_FRAME_BYTES;
+	int16_t loopState[VADPCM_LOOP_STATE_SIZE];
+	VadpcmCodebook codebook;
+
+	vadpcm_train_codebook(samples, vadpcmNumSamples, VADPCM_PREDICTORS_DEFAULT, numThreads, &codebook);
+
+	// FORM, File Size - 8, AIFC [0x00]
+	put_header_data(&header, formHeader, 4);
+	tmp32BitValue = bswap_32(fileSize - 8);
+	put_header_data(&header, &tmp32BitValue, 4);
+	put_header_data(&header, aifcHeader, 4);
+
+	// COMM, COMM Size - 8 [0x0C]
+	put_header_data(&header, commHeader, 4);
+	tmp32BitValue = bswap_32((uint32_t) (AIFC_COMM_HEADER_SIZE - 8));
+	put_header_data(&header, &tmp32BitValue, 4);
+
+	// Channel Count (always 1 in this case) [0x14]
+	tmp16BitValue = bswap_16((uint16_t) 1);
+	put_header_data(&header, &tmp16BitValue, 2);
+
+	// Number of Samples [0x16]
+	tmp32BitValue = bswap_32(vadpcmNumSamples);
+	put_header_data(&header, &tmp32BitValue, 4);
+
+	// Bit Depth (always 16) [0x1A]
+	tmp16BitValue = bswap_16((uint16_t) 16);
+	put_header_data(&header, &tmp16BitValue, 2);
+
+	// Sample Rate [0x1C]
+	put_sample_rate(&header, (uint32_t) resampledSampleRate);
+
+	// Compression Type and Name [0x26]
+	put_header_data(&header, compressionType, 4);
+	put_header_data(&header, compressionName, 12);
+
+	// APPL, APPL Size - 8, stoc, VADPCMCODES [0x36]
+	put_header_data(&header, applHeader, 4);
+	tmp32BitValue = bswap_32((uint32_t) (AIFC_CODES_HEADER_SIZE - 8 + codebook.numPredictors * VADPCM_ORDER * 8 * sizeof(int16_t)));
+	put_header_data(&header, &tmp32BitValue, 4);
+	put_header_data(&header, applSignature, 4);
+	put_header_data(&header, codesName, 12);
+
+	// Version, Order, Number of Predictors [0x4E]
+	tmp16BitValue = bswap_16((uint16_t) 1);
+	put_header_data(&header, &tmp16BitValue, 2);
+	tmp16BitValue = bswap_16((uint16_t) VADPCM_ORDER);
+	put_header_data(&header, &tmp16BitValue, 2);
+	tmp16BitValue = bswap_16((uint16_t) codebook.numPredictors);
+	put_header_data(&header, &tmp16BitValue, 2);
+
+	// Codebook [0x54]
+	for (int p = 0; p < codebook.numPredictors; p++) {
+		for (int j = 0; j < VADPCM_ORDER; j++) {
+			for (int k = 0; k < 8; k++) {
+				tmp16BitValue = bswap_16((uint16_t) codebook.book[p][j][k]);
+				put_header_data(&header, &tmp16BitValue, 2);
+			}
+		}
+	}
+
+	// SSND, SSND Size - 8, Offset, Block Size
+	put_header_data(&header, ssndHeader, 4);
+	tmp32BitValue = bswap_32((uint32_t) (SSND_PRE_HEADER_SIZE - 8 + dataSize));
+	put_header_data(&header, &tmp32BitValue, 4);
+	tmp32BitValue = 0;
+	put_header_data(&header, &tmp32BitValue, 4);
+	put_header_data(&header, &tmp32BitValue, 4);
+
+	// Frames are encoded straight into place
+	vadpcm_encode(samples, numFrames, &codebook, header, vadpcmLoopStartSamples / VADPCM_FRAME_SAMPLES, (enableLoop ? loopState : NULL));
+	header += dataSize;
+	if (dataSize & 1)
+		*header++ = 0;
+
+	if (enableLoop) {
+		// APPL, APPL Size - 8, stoc, VADPCMLOOPS
+		put_header_data(&header, applHeader, 4);
+		tmp32BitValue = bswap_32((uint32_t) (AIFC_LOOPS_HEADER_SIZE - 8));
+		put_header_data(&header, &tmp32BitValue, 4);
+		put_header_data(&header, applSignature, 4);
+		put_header_data(&header, loopsName, 12);
+
+		// Version, Number of Loops
+		tmp16BitValue = bswap_16((uint16_t) 1);
+		put_header_data(&header, &tmp16BitValue, 2);
+		put_header_data(&header, &tmp16BitValue, 2);
+
+		// Loop Start, Loop End, Loop Count (infinite)
+		tmp32BitValue = bswap_32(vadpcmLoopStartSamples);
+		put_header_data(&header, &tmp32BitValue, 4);
+		tmp32BitValue = bswap_32(vadpcmLoopEndSamples);
+		put_header_data(&header, &tmp32BitValue, 4);
+		tmp32BitValue = 0xFFFFFFFF;
+		put_header_data(&header, &tmp32BitValue, 4);
+
+		// Decoder state at the loop start
+		for (int i = 0; i < VADPCM_LOOP_STATE_SIZE; i++) {
+			tmp16BitValue = bswap_16((uint16_t) loopState[i]);
+			put_header_data(&header, &tmp16BitValue, 2);
+		}
+	}
+
+	return (size_t) (header - aifcData);
+}
+
+/**
+ * Encoding needs every sample of a channel up front, so this only runs once the pipeline has written all channels into memory.
+ * Channels are encoded on separate threads, with any cores left over used to train the codebook of each channel.
+ * Batch jobs encode on their own thread only, since the batch already runs one job per core.
+ * Only channels set in channelFlags get encoded and written, the rest are left out entirely.
+ */
+int AudioOutData::write_vadpcm_streams(OutputFile *pcmFiles, const vector<string> &filenames, uint16_t channelFlags) {
+	int numThreads = (job->isBatchJob ? 1 : (int) thread::hardware_concurrency());
+	if (numThreads < 1)
+		numThreads = 1;
+
+	int channelThreads = min(numThreads, numChannels);
+	int trainingThreads = max(numThreads / channelThreads, 1);
+
+	vector<int> retCodes((size_t) numChannels, RETURN_SUCCESS);
+	atomic<int> nextChannel(0);
+
+	auto encode_channels = [&]() {
+		for (int i = nextChannel.fetch_add(1); i < numChannels; i = nextChannel.fetch_add(1)) {
+			if (!(channelFlags & (1 << i)))
+				continue;
+
+			sample_t *samples = allocate_samples(vadpcmNumSamples);
+			uint8_t *aifcData = new (nothrow) uint8_t[fileSize];
+
+			if (samples == nullptr || aifcData == nullptr) {
+				retCodes[i] = RETURN_STREAM_OUT_OF_MEMORY;
+				delete[] samples;
+				delete[] aifcData;
+				continue;
+			}
+
+			size_t aifcSize;
+			{
+				StatsTimer timer(&job->stats, STATS_STAGE_ENCODE);
+				fill_vadpcm_samples(pcmFiles[i].mapping, pcmFiles[i].size / sizeof(sample_t), samples);
+				aifcSize = write_aifc_data(samples, trainingThreads, aifcData);
+			}
+
+			OutputFile aifcFile;
+			if (output_open(&aifcFile, filenames[i], aifcSize)) {
+				StatsTimer timer(&job->stats, STATS_STAGE_WRITE);
+				output_write(&aifcFile, aifcData, aifcSize);
+				output_close(&aifcFile);
+				stats_add(&job->stats, &job->stats.bytesWritten, (uint64_t) aifcSize);
+			} else {
+				retCodes[i] = RETURN_STREAM_CANNOT_CREATE_FILE;
+			}
+
+			delete[] samples;
+			delete[] aifcData;
+		}
+	};
+
+	vector<thread> threads;
+	for (int i = 1; i < channelThreads; i++)
+		threads.emplace_back(encode_channels);
+
+	encode_channels();
+
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	for (int i = 0; i < numChannels; i++) {
+		if (retCodes[i] == RETURN_STREAM_OUT_OF_MEMORY) {
+			job_printf(job, "...FAILED!\nERROR: Out of memory!\n");
+			return retCodes[i];
+		}
+		if (retCodes[i] == RETURN_STREAM_CANNOT_CREATE_FILE) {
+			job_printf(job, "...FAILED!\nERROR: Could not open %s for writing!\n", filenames[i].c_str());
+			return retCodes[i];
+		}
+	}
+
+	return RETURN_SUCCESS;
 }
 
 int AudioOutData::write_streams(VGMSTREAM *inFileProperties, string newFilename, string oldFilename) {
-	FILE **streamFiles = new FILE*[(size_t) numChannels];
+	StatsTimer timer(&job->stats, STATS_STAGE_STREAMS);
 
-	calculate_aiff_file_size();
-	print_header_info();
+	int ret = choose_mono_fold(inFileProperties);
+	if (ret == RETURN_SUCCESS && job->autoResampleRate)
+		ret = choose_channel_rates(inFileProperties);
+	if (ret != RETURN_SUCCESS)
+		return ret;
 
-	printf("Generating streamed file(s)...");
+	// Channels at different rates each get their own length, loop points and file size
+	vector<AudioOutData> channelData;
+	for (size_t i = 0; i < channelRates.size(); i++) {
+		channelData.push_back(*this);
+
+		AudioOutData &data = channelData.back();
+		data.numChannels = 1;
+		data.channelRates.clear();
+		data.resampledSampleRate = channelRates[i];
+		data.resample = (channelRates[i] != sampleRate);
+
+		ret = data.resolve_resampled_metadata(inFileProperties);
+		if (ret != RETURN_SUCCESS)
+			return ret;
+
+		if (job->encodeVadpcm)
+			data.calculate_aifc_file_size();
+		else
+			data.calculate_aiff_file_size();
+	}
+
+	if (job->encodeVadpcm)
+		calculate_aifc_file_size();
+	else
+		calculate_aiff_file_size();
+	print_header_info(channelData);
+
+	OutputFile *streamFiles = new OutputFile[(size_t) numChannels];
+
+	string extension = (job->encodeVadpcm ? ".aifc" : ".aiff");
+	vector<string> filenames;
+
+	job_printf(job, "Generating streamed file(s)...");
 	fflush(stdout);
 	for (int i = 0; i < numChannels; i++) {
 		string suffix = "";
-		if (numChannels == 2 && !is_mono()) {
+		if (numChannels == 2 && !job->forcedMono) {
 			if (i == 0) {
 				suffix += "_L";
 			} else {
@@ -916,38 +2242,85 @@ int AudioOutData::write_streams(VGMSTREAM *inFileProperties, string newFilename,
 			suffix += string("_") + get_num_to_hex((uint8_t) i);
 		}
 
-		string finalFilename = newFilename + suffix + ".aiff";
+		string finalFilename = newFilename + suffix + extension;
 
 		// Only check for duplicates here; if exporting only the soundbank but not the streams, the soundbank should ignore duplicate filenames.
 		// This is necessary as to not overwrite the source file being read by vgmstream, without having to terminate the entire application.
 		// Even if we were to just rely on fopen failing, this doesn't always work as expected.
 		if (finalFilename.compare(oldFilename) == 0) {
-			set_filename_duplicate(newFilename + suffix);
-			finalFilename = newFilename + suffix + "_0" + ".aiff";
+			set_filename_duplicate(job, newFilename + suffix);
+			finalFilename = newFilename + suffix + "_0" + extension;
 		}
 
-		streamFiles[i] = fopen((finalFilename).c_str(), "wb");
-		if (!streamFiles[i]) {
-			printf("...FAILED!\nERROR: Could not open %s for writing!\n", (finalFilename).c_str());
+		// VADPCM streams are first collected as PCM in memory, then encoded once every sample is known
+		uint32_t samplesPadded = (uint32_t) (channelData.empty() ? resampledNumSamples : channelData[i].resampledNumSamples);
+		if (samplesPadded % SAMPLE_COUNT_PADDING)
+			samplesPadded += SAMPLE_COUNT_PADDING - (samplesPadded % SAMPLE_COUNT_PADDING);
+		uint32_t streamFileSize = (channelData.empty() ? fileSize : channelData[i].fileSize);
+
+		if (job->encodeVadpcm && !output_open_memory(&streamFiles[i], (size_t) samplesPadded * sizeof(sample_t))) {
+			job_printf(job, "...FAILED!\nERROR: Out of memory!\n");
 
 			for (int j = i - 1; j >= 0; j--)
-				fclose(streamFiles[j]);
+				output_close(&streamFiles[j]);
+
+			delete[] streamFiles;
+			return RETURN_STREAM_OUT_OF_MEMORY;
+		}
+
+		if (!job->encodeVadpcm && !output_open(&streamFiles[i], finalFilename, (size_t) streamFileSize)) {
+			job_printf(job, "...FAILED!\nERROR: Could not open %s for writing!\n", (finalFilename).c_str());
+
+			for (int j = i - 1; j >= 0; j--)
+				output_close(&streamFiles[j]);
 
 			delete[] streamFiles;
 			return RETURN_STREAM_CANNOT_CREATE_FILE;
 		}
+
+		filenames.push_back(finalFilename);
+		job->outputFiles.push_back(finalFilename);
 	}
 
-	write_stream_headers(streamFiles);
+	if (!job->encodeVadpcm && channelData.empty())
+		write_stream_headers(streamFiles);
+	for (size_t i = 0; i < channelData.size() && !job->encodeVadpcm; i++)
+		channelData[i].write_stream_headers(&streamFiles[i]);
+
+	if (job->silenceThreshold >= 0)
+		job->channelPeaks.assign((size_t) numChannels, 0);
 
 	int retCode = RETURN_SUCCESS;
-	if (resample)
+	if (!channelData.empty())
+		retCode = write_channel_rate_audio_data(inFileProperties, streamFiles, channelData);
+	else if (resample)
 		retCode = write_resampled_audio_data(inFileProperties, streamFiles);
 	else
-		write_audio_data(inFileProperties, streamFiles);
+		retCode = write_audio_data(inFileProperties, streamFiles);
 
-	for (int i = 0; i < numChannels; i++)
-		fclose(streamFiles[i]);
+	// Whether a channel is silent is only known once all of it went by, so its PCM stream gets removed again afterwards
+	uint16_t silentFlags = (retCode == RETURN_SUCCESS ? find_silent_channels() : 0);
+
+	uint16_t channelFlags = (uint16_t) (((1ULL << numChannels) - 1ULL) & ~silentFlags);
+
+	if (retCode == RETURN_SUCCESS && job->encodeVadpcm && channelData.empty())
+		retCode = write_vadpcm_streams(streamFiles, filenames, channelFlags);
+	for (size_t i = 0; i < channelData.size() && retCode == RETURN_SUCCESS && job->encodeVadpcm; i++) {
+		if (!(channelFlags & (1 << i)))
+			continue;
+
+		retCode = channelData[i].write_vadpcm_streams(&streamFiles[i], vector<string>(1, filenames[i]), 0x0001);
+	}
+
+	for (int i = 0; i < numChannels; i++) {
+		output_close(&streamFiles[i]);
+
+		if (silentFlags & (1 << i)) {
+			if (!job->encodeVadpcm)
+				remove(filenames[i].c_str());
+			job->outputFiles.erase(find(job->outputFiles.begin(), job->outputFiles.end(), filenames[i]));
+		}
+	}
 
 	delete[] streamFiles;
 
@@ -955,16 +2328,26 @@ int AudioOutData::write_streams(VGMSTREAM *inFileProperties, string newFilename,
 		return retCode;
 	}
 
-	printf("...DONE!\n");
+	job_printf(job, "...DONE!\n");
+
+	if (silentFlags) {
+		job->instFlags &= (uint16_t) ~silentFlags;
+
+		job_printf(job, "Dropped silent stream(s):");
+		for (int i = 0; i < numChannels; i++)
+			if (silentFlags & (1 << i))
+				job_printf(job, " %s", filenames[i].c_str());
+		job_printf(job, "\n");
+	}
 
 	return RETURN_SUCCESS;
 }
 
-int generate_new_streams(VGMSTREAM *inFileProperties, string newFilename, string oldFilename, bool shouldGenerateFiles) {
+int generate_new_streams(ConversionJob *job, VGMSTREAM *inFileProperties, string newFilename, string oldFilename, bool shouldGenerateFiles) {
 	if (!inFileProperties)
 		return RETURN_INVALID_INPUT_FILE;
 
-	AudioOutData *audioData = new AudioOutData(inFileProperties);
+	AudioOutData *audioData = new AudioOutData(job, inFileProperties);
 
 	int ret = audioData->check_properties(inFileProperties, newFilename);
 	if (ret) {
@@ -0,0 +1,373 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+#include "vadpcm.hpp"
+#include "kernels.hpp"
+
+using namespace std;
+
+#define TRAINING_CHUNK_FRAMES 1024 // Fixed regardless of thread count, so every sum is added up in the same order
+#define TRAINING_ITERATIONS 10
+#define TRAINING_SPLIT_DELTA 0.01
+#define PREDICTOR_STABILITY_LIMIT 0.99
+
+// Order 2 autocorrelation statistics of one frame, enough to evaluate the squared prediction error of any predictor
+struct FrameStats {
+	double r0;  // sum(x[n]^2)
+	double p1;  // sum(x[n] * x[n-1])
+	double p2;  // sum(x[n] * x[n-2])
+	double r11; // sum(x[n-1]^2)
+	double r12; // sum(x[n-1] * x[n-2])
+	double r22; // sum(x[n-2]^2)
+};
+
+struct Predictor {
+	double a1; // Coefficient of x[n-1]
+	double a2; // Coefficient of x[n-2]
+};
+
+static void add_stats(FrameStats *sum, const FrameStats *stats) {
+	sum->r0 += stats->r0;
+	sum->p1 += stats->p1;
+	sum->p2 += stats->p2;
+	sum->r11 += stats->r11;
+	sum->r12 += stats->r12;
+	sum->r22 += stats->r22;
+}
+
+static double prediction_error(const FrameStats *stats, const Predictor *pred) {
+	return stats->r0 - 2.0 * (pred->a1 * stats->p1 + pred->a2 * stats->p2)
+	 + pred->a1 * pred->a1 * stats->r11 + 2.0 * pred->a1 * pred->a2 * stats->r12 + pred->a2 * pred->a2 * stats->r22;
+}
+
+// Least squares predictor for the given statistics, kept within the stable region of a 2nd order filter
+static Predictor solve_predictor(const FrameStats *stats) {
+	Predictor pred = {0.0, 0.0};
+	double eps = 1e-9 * (stats->r11 + stats->r22) + 1e-6;
+	double r11 = stats->r11 + eps;
+	double r22 = stats->r22 + eps;
+	double det = r11 * r22 - stats->r12 * stats->r12;
+
+	if (det > 1e-12 * r11 * r22) {
+		pred.a1 = (stats->p1 * r22 - stats->p2 * stats->r12) / det;
+		pred.a2 = (stats->p2 * r11 - stats->p1 * stats->r12) / det;
+	} else {
+		pred.a1 = stats->p1 / r11;
+	}
+
+	if (pred.a2 > PREDICTOR_STABILITY_LIMIT)
+		pred.a2 = PREDICTOR_STABILITY_LIMIT;
+	if (pred.a2 < -PREDICTOR_STABILITY_LIMIT)
+		pred.a2 = -PREDICTOR_STABILITY_LIMIT;
+
+	double a1Limit = (1.0 - pred.a2) * PREDICTOR_STABILITY_LIMIT;
+	if (pred.a1 > a1Limit)
+		pred.a1 = a1Limit;
+	if (pred.a1 < -a1Limit)
+		pred.a1 = -a1Limit;
+
+	return pred;
+}
+
+// Runs body(i) for every i in [0, count), spread over up to numThreads threads including the calling one
+static void parallel_for(uint32_t count, int numThreads, const function<void(uint32_t)> &body) {
+	atomic<uint32_t> next(0);
+	auto worker = [&]() {
+		for (uint32_t i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+			body(i);
+	};
+
+	if (numThreads > (int) count)
+		numThreads = (int) count;
+
+	vector<thread> threads;
+	for (int i = 1; i < numThreads; i++)
+		threads.emplace_back(worker);
+
+	worker();
+
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+static int16_t clamp_16(int64_t value) {
+	if (value > INT16_MAX)
+		return INT16_MAX;
+	if (value < INT16_MIN)
+		return INT16_MIN;
+	return (int16_t) value;
+}
+
+static void build_codebook(const vector<Predictor> &preds, VadpcmCodebook *codebook) {
+	codebook->numPredictors = (int) preds.size();
+
+	for (int p = 0; p < codebook->numPredictors; p++) {
+		double a1 = preds[p].a1;
+		double a2 = preds[p].a2;
+
+		// Impulse responses of the predictor to x[n-2] (row 0) and x[n-1] (row 1) over the next 8 samples
+		for (int j = 0; j < VADPCM_ORDER; j++) {
+			double prev2 = (j == 0 ? 1.0 : 0.0);
+			double prev1 = (j == 1 ? 1.0 : 0.0);
+
+			for (int k = 0; k < 8; k++) {
+				double cur = a1 * prev1 + a2 * prev2;
+				codebook->book[p][j][k] = clamp_16((int64_t) lround(cur * 2048.0));
+				prev2 = prev1;
+				prev1 = cur;
+			}
+		}
+
+		// Same expansion as the decoder: columns [0, order) apply to the previous samples, the rest to the residuals of this half frame
+		int32_t (*table)[VADPCM_ORDER + 8] = codebook->table[p];
+		for (int j = 0; j < VADPCM_ORDER; j++)
+			for (int k = 0; k < 8; k++)
+				table[k][j] = codebook->book[p][j][k];
+
+		for (int k = 1; k < 8; k++)
+			table[k][VADPCM_ORDER] = table[k - 1][VADPCM_ORDER - 1];
+		table[0][VADPCM_ORDER] = 2048;
+
+		for (int k = 1; k < 8; k++) {
+			int j = 0;
+			for (; j < k; j++)
+				table[j][k + VADPCM_ORDER] = 0;
+			for (; j < 8; j++)
+				table[j][k + VADPCM_ORDER] = table[j - k][VADPCM_ORDER];
+		}
+
+		codebook->coefs[p * 2] = (float) codebook->book[p][1][0] / 2048.0f;
+		codebook->coefs[p * 2 + 1] = (float) codebook->book[p][0][0] / 2048.0f;
+	}
+}
+
+/**
+ * Designs the predictors by clustering frames (generalized Lloyd algorithm): starting from the predictor that fits
+ * the whole stream best, predictors get split in two and refined until there are numPredictors of them.
+ * Frame statistics and assignments are computed in parallel, in fixed-size chunks so results don't depend on numThreads.
+ */
+void vadpcm_train_codebook(const sample_t *samples, uint32_t numSamples, int numPredictors, int numThreads, VadpcmCodebook *codebook) {
+	uint32_t numFrames = numSamples / VADPCM_FRAME_SAMPLES;
+	uint32_t numChunks = (numFrames + TRAINING_CHUNK_FRAMES - 1) / TRAINING_CHUNK_FRAMES;
+
+	if (numPredictors < 1)
+		numPredictors = 1;
+	if (numPredictors > VADPCM_PREDICTORS_MAX)
+		numPredictors = VADPCM_PREDICTORS_MAX;
+
+	vector<FrameStats> frameStats(numFrames);
+	vector<uint8_t> assignments(numFrames, 0);
+	vector<FrameStats> chunkSums((size_t) numChunks * numPredictors);
+
+	parallel_for(numChunks, numThreads, [&](uint32_t chunk) {
+		uint32_t end = min((chunk + 1) * TRAINING_CHUNK_FRAMES, numFrames);
+
+		for (uint32_t f = chunk * TRAINING_CHUNK_FRAMES; f < end; f++) {
+			FrameStats stats = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+			for (uint32_t n = f * VADPCM_FRAME_SAMPLES; n < (f + 1) * VADPCM_FRAME_SAMPLES; n++) {
+				double x0 = samples[n];
+				double x1 = (n >= 1 ? samples[n - 1] : 0);
+				double x2 = (n >= 2 ? samples[n - 2] : 0);
+
+				stats.r0 += x0 * x0;
+				stats.p1 += x0 * x1;
+				stats.p2 += x0 * x2;
+				stats.r11 += x1 * x1;
+				stats.r12 += x1 * x2;
+				stats.r22 += x2 * x2;
+			}
+
+			frameStats[f] = stats;
+		}
+	});
+
+	// Sums the statistics of every cluster, chunk by chunk and then in chunk order
+	auto sum_clusters = [&](int numClusters, vector<FrameStats> *sums) {
+		parallel_for(numChunks, numThreads, [&](uint32_t chunk) {
+			FrameStats *chunkSum = &chunkSums[(size_t) chunk * numPredictors];
+			memset(chunkSum, 0, sizeof(FrameStats) * numClusters);
+
+			uint32_t end = min((chunk + 1) * TRAINING_CHUNK_FRAMES, numFrames);
+			for (uint32_t f = chunk * TRAINING_CHUNK_FRAMES; f < end; f++)
+				add_stats(&chunkSum[assignments[f]], &frameStats[f]);
+		});
+
+		sums->assign(numClusters, FrameStats {0.0, 0.0, 0.0, 0.0, 0.0, 0.0});
+		for (uint32_t chunk = 0; chunk < numChunks; chunk++)
+			for (int c = 0; c < numClusters; c++)
+				add_stats(&(*sums)[c], &chunkSums[(size_t) chunk * numPredictors + c]);
+	};
+
+	vector<FrameStats> sums;
+	sum_clusters(1, &sums);
+
+	vector<Predictor> preds;
+	preds.push_back(solve_predictor(&sums[0]));
+
+	while ((int) preds.size() < numPredictors) {
+		int numSplits = min((int) preds.size(), numPredictors - (int) preds.size());
+		for (int i = 0; i < numSplits; i++) {
+			Predictor split = preds[i];
+			split.a1 *= 1.0 - TRAINING_SPLIT_DELTA;
+			split.a2 *= 1.0 - TRAINING_SPLIT_DELTA;
+			preds[i].a1 *= 1.0 + TRAINING_SPLIT_DELTA;
+			preds[i].a2 *= 1.0 + TRAINING_SPLIT_DELTA;
+			preds.push_back(split);
+		}
+
+		for (int iteration = 0; iteration < TRAINING_ITERATIONS; iteration++) {
+			parallel_for(numChunks, numThreads, [&](uint32_t chunk) {
+				uint32_t end = min((chunk + 1) * TRAINING_CHUNK_FRAMES, numFrames);
+
+				for (uint32_t f = chunk * TRAINING_CHUNK_FRAMES; f < end; f++) {
+					double best = prediction_error(&frameStats[f], &preds[0]);
+					assignments[f] = 0;
+
+					for (size_t p = 1; p < preds.size(); p++) {
+						double error = prediction_error(&frameStats[f], &preds[p]);
+						if (error < best) {
+							best = error;
+							assignments[f] = (uint8_t) p;
+						}
+					}
+				}
+			});
+
+			sum_clusters((int) preds.size(), &sums);
+
+			for (size_t p = 0; p < preds.size(); p++) {
+				if (sums[p].r11 > 0.0 || sums[p].r22 > 0.0)
+					preds[p] = solve_predictor(&sums[p]);
+			}
+		}
+	}
+
+	build_codebook(preds, codebook);
+}
+
+static inline int32_t floor_div_2048(int64_t value) {
+	if (value >= 0)
+		return (int32_t) (value / 2048);
+	return (int32_t) -((-value + 2047) / 2048);
+}
+
+/**
+ * Encodes one frame with a given predictor and scale, mirroring the decoder exactly so prediction always starts from what
+ * the decoder will actually have. Returns the squared error against the input.
+ */
+static int64_t encode_frame_with(const sample_t *samples, const int16_t *history, const int32_t (*table)[VADPCM_ORDER + 8],
+ int scale, int8_t *nibbles, int16_t *decoded) {
+	int64_t error = 0;
+	int32_t prev[VADPCM_ORDER] = {history[16 - 2], history[16 - 1]};
+	int32_t half = (1 << scale) >> 1;
+
+	for (int h = 0; h < 2; h++) {
+		int32_t residuals[8];
+
+		for (int i = 0; i < 8; i++) {
+			int64_t acc = 0;
+			for (int j = 0; j < VADPCM_ORDER; j++)
+				acc += (int64_t) table[i][j] * prev[j];
+			for (int m = 0; m < i; m++)
+				acc += (int64_t) table[i][VADPCM_ORDER + m] * residuals[m];
+
+			int32_t prediction = floor_div_2048(acc);
+			int32_t target = (int32_t) samples[h * 8 + i] - prediction;
+
+			int32_t q;
+			if (target >= 0)
+				q = (target + half) >> scale;
+			else
+				q = -((-target + half) >> scale);
+			if (q > 7)
+				q = 7;
+			if (q < -8)
+				q = -8;
+
+			residuals[i] = q * (1 << scale);
+			nibbles[h * 8 + i] = (int8_t) q;
+			decoded[h * 8 + i] = clamp_16((int64_t) prediction + residuals[i]);
+
+			int64_t diff = (int64_t) decoded[h * 8 + i] - samples[h * 8 + i];
+			error += diff * diff;
+		}
+
+		prev[0] = decoded[h * 8 + 6];
+		prev[1] = decoded[h * 8 + 7];
+	}
+
+	return error;
+}
+
+static void encode_frame(const sample_t *samples, int16_t *history, const VadpcmCodebook *codebook, uint8_t *output) {
+	float window[VADPCM_FRAME_SAMPLES + 2];
+	float errors[VADPCM_PREDICTORS_MAX];
+
+	window[0] = (float) history[16 - 2];
+	window[1] = (float) history[16 - 1];
+	for (int i = 0; i < VADPCM_FRAME_SAMPLES; i++)
+		window[i + 2] = (float) samples[i];
+
+	vadpcm_predictor_errors(window, codebook->coefs, codebook->numPredictors, errors);
+
+	int predictor = 0;
+	for (int p = 1; p < codebook->numPredictors; p++) {
+		if (errors[p] < errors[predictor])
+			predictor = p;
+	}
+
+	// Smallest scale that fits the open-loop residual, then refined by trying its neighbours in closed loop
+	float a1 = codebook->coefs[predictor * 2];
+	float a2 = codebook->coefs[predictor * 2 + 1];
+	float maxResidual = 0.0f;
+	for (int i = 0; i < VADPCM_FRAME_SAMPLES; i++) {
+		float residual = fabsf((window[i + 2] - a1 * window[i + 1]) - a2 * window[i]);
+		if (residual > maxResidual)
+			maxResidual = residual;
+	}
+
+	int initialScale = 0;
+	while (initialScale < VADPCM_SCALE_MAX && maxResidual > 7.0f * (float) (1 << initialScale))
+		initialScale++;
+
+	int8_t nibbles[VADPCM_FRAME_SAMPLES], bestNibbles[VADPCM_FRAME_SAMPLES];
+	int16_t decoded[VADPCM_FRAME_SAMPLES], bestDecoded[VADPCM_FRAME_SAMPLES];
+	int64_t bestError = INT64_MAX;
+	int bestScale = initialScale;
+
+	for (int scale = max(initialScale - 1, 0); scale <= min(initialScale + 1, VADPCM_SCALE_MAX); scale++) {
+		int64_t error = encode_frame_with(samples, history, codebook->table[predictor], scale, nibbles, decoded);
+		if (error < bestError) {
+			bestError = error;
+			bestScale = scale;
+			memcpy(bestNibbles, nibbles, sizeof(nibbles));
+			memcpy(bestDecoded, decoded, sizeof(decoded));
+		}
+	}
+
+	output[0] = (uint8_t) ((bestScale << 4) | (predictor & 0xF));
+	for (int i = 0; i < VADPCM_FRAME_SAMPLES; i += 2)
+		output[1 + i / 2] = (uint8_t) (((bestNibbles[i] & 0xF) << 4) | (bestNibbles[i + 1] & 0xF));
+
+	memcpy(history, bestDecoded, sizeof(bestDecoded));
+}
+
+// Frames are encoded in order, since every frame is predicted from the decoded output of the previous one
+void vadpcm_encode(const sample_t *samples, uint32_t numFrames, const VadpcmCodebook *codebook, uint8_t *output,
+ uint32_t loopStartFrame, int16_t *loopState) {
+	int16_t history[VADPCM_FRAME_SAMPLES];
+	memset(history, 0, sizeof(history));
+
+	for (uint32_t f = 0; f < numFrames; f++) {
+		if (loopState != NULL && f == loopStartFrame)
+			memcpy(loopState, history, sizeof(history));
+
+		encode_frame(&samples[(size_t) f * VADPCM_FRAME_SAMPLES], history, codebook, &output[(size_t) f * VADPCM_FRAME_BYTES]);
+	}
+}
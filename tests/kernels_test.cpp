@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+#include "kernels.hpp"
+#include "mix.hpp"
+#include "vadpcm.hpp"
+
+using namespace std;
+
+/**
+ * Checks every kernel dispatcher against a plain reference implementation. Run once per instruction set, with STRM64_KERNELS
+ * set to scalar, sse2 and avx2 (see CMakeLists.txt), so the vector implementations are held to the same results as the scalar one.
+ * Sizes cover the vector widths and the remainders left for the scalar fallback.
+ */
+
+static const uint32_t FRAME_COUNTS[] = {0, 1, 7, 8, 9, 15, 16, 17, 33, 100, 1023};
+static const int TAP_COUNTS[] = {0, 1, 7, 8, 15, 16, 17, 31, 32, 48, 96, 192, 200};
+
+static int gFailures = 0;
+
+// Deterministic, so a failure reproduces on every run
+static uint32_t next_random(uint32_t *state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+static sample_t random_sample(uint32_t *state) {
+	return (sample_t) (next_random(state) & 0xFFFF);
+}
+
+static void report_failure(const char *kernel, int channels, int length) {
+	printf("FAILED: %s with %d channel(s), length %d\n", kernel, channels, length);
+	gFailures++;
+}
+
+static void test_deinterleave_bswap(uint32_t *state) {
+	for (int channels = 1; channels <= 16; channels++) {
+		for (uint32_t frames : FRAME_COUNTS) {
+			vector<sample_t> input((size_t) channels * frames);
+			for (size_t i = 0; i < input.size(); i++)
+				input[i] = random_sample(state);
+
+			vector<vector<sample_t>> outputs(channels, vector<sample_t>(frames + 1, 0x5A5A));
+			sample_t *outputPtrs[16];
+			for (int c = 0; c < channels; c++)
+				outputPtrs[c] = outputs[c].data();
+
+			deinterleave_bswap_16(input.data(), outputPtrs, channels, frames);
+
+			bool matches = true;
+			for (int c = 0; c < channels; c++) {
+				for (uint32_t i = 0; i < frames; i++) {
+					uint16_t sample = (uint16_t) input[(size_t) i * channels + c];
+					matches &= (outputs[c][i] == (sample_t) (uint16_t) ((sample << 8) | (sample >> 8)));
+				}
+				matches &= (outputs[c][frames] == 0x5A5A); // Nothing written past the end
+			}
+
+			if (!matches)
+				report_failure("deinterleave_bswap_16", channels, (int) frames);
+		}
+	}
+}
+
+static void test_dot_products(uint32_t *state) {
+	const size_t offsets[] = {0, 1, 3};
+
+	for (int count = 1; count <= 16; count++) {
+		for (int length : TAP_COUNTS) {
+			for (size_t offset : offsets) {
+				vector<int16_t> coefs((size_t) length);
+				for (int i = 0; i < length; i++)
+					coefs[i] = random_sample(state);
+
+				vector<vector<sample_t>> samples(count, vector<sample_t>(offset + length));
+				sample_t *samplePtrs[16];
+				for (int k = 0; k < count; k++) {
+					for (size_t i = 0; i < samples[k].size(); i++)
+						samples[k][i] = random_sample(state);
+					samplePtrs[k] = samples[k].data();
+				}
+
+				int32_t sums[16];
+				dot_products_16(samplePtrs, offset, count, coefs.data(), length, sums);
+
+				// Full scale random coefficients do overflow, which every implementation has to wrap around the same way
+				bool matches = true;
+				for (int k = 0; k < count; k++) {
+					uint32_t sum = 0;
+					for (int i = 0; i < length; i++)
+						sum += (uint32_t) ((int32_t) samples[k][offset + i] * coefs[i]);
+					matches &= (sums[k] == (int32_t) sum);
+				}
+
+				if (!matches)
+					report_failure("dot_products_16", count, length);
+			}
+		}
+	}
+}
+
+static void test_mix_channels(uint32_t *state) {
+	for (int inputChannels = 1; inputChannels <= 16; inputChannels++) {
+		for (int outputChannels = 1; outputChannels <= 16; outputChannels++) {
+			for (uint32_t frames : FRAME_COUNTS) {
+				// Gains the vector kernels can take, then ones only the scalar kernel can, from the full --mix range
+				for (int range : {65534 / inputChannels, (int) (MIX_GAIN_MAX * (1 << MIX_GAIN_BITS))}) {
+					vector<int32_t> matrix((size_t) outputChannels * inputChannels);
+					for (size_t i = 0; i < matrix.size(); i++)
+						matrix[i] = (int32_t) (next_random(state) % (2 * (uint32_t) min(range, 32767) + 1)) - min(range, 32767);
+					if (range > 32767)
+						matrix[0] = range;
+
+					vector<sample_t> input((size_t) inputChannels * frames);
+					for (size_t i = 0; i < input.size(); i++)
+						input[i] = random_sample(state);
+
+					vector<sample_t> output((size_t) outputChannels * frames + 1, 0x5A5A);
+					mix_channels_16(input.data(), inputChannels, output.data(), outputChannels, matrix.data(), frames);
+
+					bool matches = (output.back() == 0x5A5A);
+					for (uint32_t i = 0; i < frames; i++) {
+						for (int o = 0; o < outputChannels; o++) {
+							int64_t sum = (int64_t) 1 << (MIX_GAIN_BITS - 1);
+							for (int c = 0; c < inputChannels; c++)
+								sum += (int64_t) matrix[(size_t) o * inputChannels + c] * input[(size_t) i * inputChannels + c];
+
+							sum = min(max(sum >> MIX_GAIN_BITS, (int64_t) INT16_MIN), (int64_t) INT16_MAX);
+							matches &= (output[(size_t) i * outputChannels + o] == (sample_t) sum);
+						}
+					}
+
+					if (!matches) {
+						printf("FAILED: mix_channels_16 from %d to %d channel(s), length %d\n", inputChannels, outputChannels, (int) frames);
+						gFailures++;
+					}
+				}
+			}
+		}
+	}
+}
+
+static void test_vadpcm_predictor_errors(uint32_t *state) {
+	for (int numPredictors = 0; numPredictors <= VADPCM_PREDICTORS_MAX; numPredictors++) {
+		for (int trial = 0; trial < 16; trial++) {
+			float samples[VADPCM_FRAME_SAMPLES + 2];
+			for (int i = 0; i < VADPCM_FRAME_SAMPLES + 2; i++)
+				samples[i] = (float) random_sample(state);
+
+			// Coefficient pairs from the range of stable order 2 predictors, as stored by the codebook with 11 fraction bits
+			float coefs[VADPCM_PREDICTORS_MAX * 2];
+			for (int i = 0; i < numPredictors * 2; i++)
+				coefs[i] = (float) ((int32_t) (next_random(state) % 8193) - 4096) / 2048.0f;
+
+			float errors[VADPCM_PREDICTORS_MAX + 1];
+			errors[numPredictors] = 1234.5f;
+			vadpcm_predictor_errors(samples, coefs, numPredictors, errors);
+
+			// Every implementation sums four interleaved lanes, then adds them up pairwise, so results are bit identical
+			bool matches = (errors[numPredictors] == 1234.5f);
+			for (int p = 0; p < numPredictors; p++) {
+				float lanes[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+				for (int i = 0; i < VADPCM_FRAME_SAMPLES; i++) {
+					float e = (samples[i + 2] - coefs[p * 2] * samples[i + 1]) - coefs[p * 2 + 1] * samples[i];
+					lanes[i & 3] = lanes[i & 3] + e * e;
+				}
+				matches &= (errors[p] == (lanes[0] + lanes[2]) + (lanes[1] + lanes[3]));
+			}
+
+			if (!matches) {
+				printf("FAILED: vadpcm_predictor_errors with %d predictor(s)\n", numPredictors);
+				gFailures++;
+			}
+		}
+	}
+}
+
+int main() {
+	uint32_t state = 12345;
+
+	printf("Testing %s kernels...\n", get_kernel_name());
+
+	test_deinterleave_bswap(&state);
+	test_dot_products(&state);
+	test_mix_channels(&state);
+	test_vadpcm_predictor_errors(&state);
+
+	if (gFailures > 0) {
+		printf("%d kernel test(s) FAILED!\n", gFailures);
+		return 1;
+	}
+
+	printf("...SUCCESS!\n");
+	return 0;
+}
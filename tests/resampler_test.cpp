@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+#include "resampler.hpp"
+
+using namespace std;
+
+/**
+ * Feeds every engine and quality preset the worst case input of a filter: full scale samples matching the signs of the taps
+ * that make up one output sample. Its output has to clip to full scale, rather than wrap around to the opposite extreme.
+ * The taps are found by resampling one impulse at a time, so this works with any engine without knowing its filter.
+ */
+
+#define TEST_INPUT_FRAMES 2048
+#define TEST_PROBE_RADIUS 400 // Input samples on either side of the output sample, more than the longest filter reaches
+
+struct RatePair {
+	int32_t inRate;
+	int32_t outRate;
+};
+
+static const RatePair RATE_PAIRS[] = {{44100, 22050}, {44100, 32000}, {32000, 48000}};
+
+static const char *const ENGINE_NAMES[] = {"builtin", "swr"};
+static const char *const QUALITY_NAMES[] = {"draft", "default", "high"};
+
+// Resamples a whole mono input in one call and returns output sample index, or 0 if there's none
+static int resample_at(ResamplerEngine engine, ResamplerQuality quality, const RatePair &rates, const vector<sample_t> &input, int index) {
+	Resampler *resampler = resampler_create(engine, quality, 1, rates.inRate, rates.outRate);
+	if (resampler == NULL)
+		return 0;
+
+	vector<sample_t> output((size_t) resampler_get_out_samples(resampler, (int) input.size()));
+	sample_t *outputPtr = output.data();
+	int produced = resampler_convert(resampler, &outputPtr, (int) output.size(), input.data(), (int) input.size());
+	resampler_free(&resampler);
+
+	return (index < produced ? output[index] : 0);
+}
+
+static bool test_full_scale_pattern(ResamplerEngine engine, ResamplerQuality quality, const RatePair &rates) {
+	int index = (int) ((int64_t) TEST_INPUT_FRAMES / 2 * rates.outRate / rates.inRate);
+	int center = (int) ((int64_t) index * rates.inRate / rates.outRate);
+
+	vector<sample_t> positive(TEST_INPUT_FRAMES, 0), negative(TEST_INPUT_FRAMES, 0);
+
+	for (int m = center - TEST_PROBE_RADIUS; m <= center + TEST_PROBE_RADIUS; m++) {
+		vector<sample_t> impulse(TEST_INPUT_FRAMES, 0);
+		impulse[m] = 32767;
+
+		int tap = resample_at(engine, quality, rates, impulse, index);
+		positive[m] = (tap > 0 ? 32767 : (tap < 0 ? -32768 : 0));
+		negative[m] = (tap > 0 ? -32768 : (tap < 0 ? 32767 : 0));
+	}
+
+	int high = resample_at(engine, quality, rates, positive, index);
+	int low = resample_at(engine, quality, rates, negative, index);
+	if (high >= 32000 && low <= -32000)
+		return true;
+
+	printf("FAILED: %s / %s at %d -> %d gave %d and %d instead of clipping to full scale\n", ENGINE_NAMES[engine], QUALITY_NAMES[quality],
+	 rates.inRate, rates.outRate, high, low);
+	return false;
+}
+
+int main() {
+	int failures = 0;
+
+	for (int engine = RESAMPLER_BUILTIN; engine <= RESAMPLER_SWR; engine++) {
+		if (!resampler_engine_available((ResamplerEngine) engine))
+			continue;
+
+		printf("Testing %s resampler...\n", ENGINE_NAMES[engine]);
+		for (int quality = RESAMPLE_QUALITY_DRAFT; quality <= RESAMPLE_QUALITY_HIGH; quality++) {
+			for (const RatePair &rates : RATE_PAIRS) {
+				if (!test_full_scale_pattern((ResamplerEngine) engine, (ResamplerQuality) quality, rates))
+					failures++;
+			}
+		}
+	}
+
+	if (failures > 0) {
+		printf("%d resampler test(s) FAILED!\n", failures);
+		return 1;
+	}
+
+	printf("...SUCCESS!\n");
+	return 0;
+}
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+#include "main.hpp"
+#include "job.hpp"
+#include "sequence.hpp"
+
+using namespace std;
+
+/**
+ * Writes sequences for stream layouts with and without dropped channels, and checks the instrument and pan of every channel header.
+ * A channel has to keep the side of its stream channel, however many channels before it got dropped by --prune-silence.
+ */
+
+#define PAN_LEFT 0x00
+#define PAN_CENTER 0x3F
+#define PAN_RIGHT 0x7F
+
+struct PanCase {
+	const char *name;
+	uint8_t streamChannels;
+	uint16_t instFlags;
+	bool forcedMono;
+	vector<uint8_t> pans; // Expected pan of every instrument set in instFlags, in order
+};
+
+static const PanCase PAN_CASES[] = {
+	{"stereo", 2, 0x0003, false, {PAN_LEFT, PAN_RIGHT}},
+	{"mono", 1, 0x0001, false, {PAN_CENTER}},
+	{"three channels", 3, 0x0007, false, {PAN_LEFT, PAN_RIGHT, PAN_CENTER}},
+	{"forced mono", 2, 0x0003, true, {PAN_CENTER, PAN_CENTER}},
+	{"4 channels, right of first pair dropped", 4, 0x000D, false, {PAN_LEFT, PAN_LEFT, PAN_RIGHT}},
+	{"4 channels, left of second pair dropped", 4, 0x000B, false, {PAN_LEFT, PAN_RIGHT, PAN_RIGHT}},
+	{"6 channels, middle pair dropped", 6, 0x0033, false, {PAN_LEFT, PAN_RIGHT, PAN_LEFT, PAN_RIGHT}},
+	{"5 channels, second pair dropped", 5, 0x0013, false, {PAN_LEFT, PAN_RIGHT, PAN_CENTER}},
+};
+
+// Instrument and pan of every channel header in a written sequence, in order
+static bool read_channel_pans(const char *filename, vector<pair<uint8_t, uint8_t>> *channels) {
+	FILE *seqFile = fopen(filename, "rb");
+	if (seqFile == NULL)
+		return false;
+
+	vector<uint8_t> data;
+	for (int c = fgetc(seqFile); c != EOF; c = fgetc(seqFile))
+		data.push_back((uint8_t) c);
+	fclose(seqFile);
+
+	// Pan, volume, pitch bend, effect, priority and instrument follow each other in every channel header
+	for (size_t i = 0; i + 10 < data.size(); i++) {
+		if (data[i] == CHN_PAN && data[i + 2] == CHN_VOLUME && data[i + 4] == CHN_PITCH_BEND && data[i + 6] == CHN_EFFECT &&
+		 data[i + 8] == CHN_PRIORITY_US_MAX && data[i + 9] == CHN_INSTRUMENT)
+			channels->push_back(make_pair(data[i + 10], data[i + 1]));
+	}
+
+	return true;
+}
+
+static bool test_pans(const PanCase &test) {
+	ConversionJob job;
+	job.streamChannels = test.streamChannels;
+	job.instFlags = test.instFlags;
+	job.forcedMono = test.forcedMono;
+
+	vector<pair<uint8_t, uint8_t>> channels;
+	bool written = (generate_new_sequence(&job, "sequence_test", test.instFlags) == RETURN_SUCCESS &&
+	 read_channel_pans("XX_sequence_test.m64", &channels));
+	remove("XX_sequence_test.m64");
+
+	bool matches = (written && channels.size() == test.pans.size());
+	for (size_t i = 0, instrument = 0; matches && i < channels.size(); i++, instrument++) {
+		while (!(test.instFlags & (1 << instrument)))
+			instrument++;
+		matches = (channels[i].first == instrument && channels[i].second == test.pans[i]);
+	}
+
+	if (!matches)
+		printf("FAILED: channel pans of %s\n", test.name);
+	return matches;
+}
+
+int main() {
+	int failures = 0;
+
+	printf("Testing sequence channel pans...\n");
+	for (const PanCase &test : PAN_CASES) {
+		if (!test_pans(test))
+			failures++;
+	}
+
+	if (failures > 0) {
+		printf("%d sequence test(s) FAILED!\n", failures);
+		return 1;
+	}
+
+	printf("...SUCCESS!\n");
+	return 0;
+}
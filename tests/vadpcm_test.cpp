@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "vadpcm.hpp"
+
+using namespace std;
+
+/**
+ * Encodes test signals and decodes them again the way the game does, straight from the codebook stored in the file,
+ * so the encoder's own copy of the decoder is checked too. Also checks the loop state against the decoder's history at
+ * the loop start, and that training doesn't depend on the thread count.
+ */
+
+#define TEST_FRAMES 512
+#define TEST_LOOP_FRAME 37
+
+struct SignalCase {
+	const char *name;
+	double minSnr; // dB of the decoded signal over the coding error
+};
+
+static const SignalCase SIGNAL_CASES[] = {
+	{"silence", INFINITY},
+	{"two sines", 45.0},
+	{"full scale square", 15.0},
+	{"noise", 18.0},
+};
+
+// Deterministic, so a failure reproduces on every run
+static uint32_t next_random(uint32_t *state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+static vector<sample_t> make_signal(int index) {
+	vector<sample_t> samples((size_t) TEST_FRAMES * VADPCM_FRAME_SAMPLES);
+	uint32_t state = 12345;
+
+	for (size_t i = 0; i < samples.size(); i++) {
+		switch (index) {
+		case 1:
+			samples[i] = (sample_t) lround(9000.0 * sin(i * 0.031) + 4000.0 * sin(i * 0.29));
+			break;
+		case 2:
+			samples[i] = ((i / 50) % 2 ? INT16_MAX : INT16_MIN);
+			break;
+		case 3:
+			samples[i] = (sample_t) ((int32_t) (next_random(&state) % 16001) - 8000);
+			break;
+		default:
+			samples[i] = 0;
+			break;
+		}
+	}
+
+	return samples;
+}
+
+// Decodes every frame like the N64's ADPCM microcode: each half frame is predicted from the last two samples of the
+// previous one through the two impulse responses stored in the book, with the residuals fed through the second one.
+static vector<sample_t> decode(const uint8_t *data, uint32_t numFrames, const VadpcmCodebook *codebook, int16_t *loopHistory) {
+	vector<sample_t> output((size_t) numFrames * VADPCM_FRAME_SAMPLES);
+	int16_t history[VADPCM_FRAME_SAMPLES];
+	memset(history, 0, sizeof(history));
+
+	for (uint32_t f = 0; f < numFrames; f++) {
+		if (f == TEST_LOOP_FRAME)
+			memcpy(loopHistory, history, sizeof(history));
+
+		const uint8_t *frame = &data[(size_t) f * VADPCM_FRAME_BYTES];
+		int scale = frame[0] >> 4;
+		int predictor = frame[0] & 0xF;
+		const int16_t (*book)[8] = codebook->book[predictor];
+
+		int32_t residuals[VADPCM_FRAME_SAMPLES];
+		for (int i = 0; i < VADPCM_FRAME_SAMPLES; i++) {
+			int nibble = (frame[1 + i / 2] >> (i % 2 ? 0 : 4)) & 0xF;
+			residuals[i] = (nibble >= 8 ? nibble - 16 : nibble) * (1 << scale);
+		}
+
+		int32_t prev2 = history[VADPCM_FRAME_SAMPLES - 2];
+		int32_t prev1 = history[VADPCM_FRAME_SAMPLES - 1];
+		for (int h = 0; h < 2; h++) {
+			const int32_t *halfResiduals = &residuals[h * 8];
+
+			for (int i = 0; i < 8; i++) {
+				int64_t acc = (int64_t) book[0][i] * prev2 + (int64_t) book[1][i] * prev1 + (int64_t) halfResiduals[i] * 2048;
+				for (int j = 0; j < i; j++)
+					acc += (int64_t) book[1][i - j - 1] * halfResiduals[j];
+
+				int64_t sample = (acc >= 0 ? acc / 2048 : -((-acc + 2047) / 2048));
+				history[h * 8 + i] = (int16_t) max((int64_t) INT16_MIN, min((int64_t) INT16_MAX, sample));
+			}
+
+			prev2 = history[h * 8 + 6];
+			prev1 = history[h * 8 + 7];
+		}
+
+		memcpy(&output[(size_t) f * VADPCM_FRAME_SAMPLES], history, sizeof(history));
+	}
+
+	return output;
+}
+
+static bool test_round_trip(const SignalCase &test, int index) {
+	vector<sample_t> samples = make_signal(index);
+	uint32_t numSamples = (uint32_t) samples.size();
+
+	VadpcmCodebook codebook, threadedCodebook;
+	vadpcm_train_codebook(samples.data(), numSamples, VADPCM_PREDICTORS_DEFAULT, 1, &codebook);
+	vadpcm_train_codebook(samples.data(), numSamples, VADPCM_PREDICTORS_DEFAULT, 4, &threadedCodebook);
+
+	bool matches = (codebook.numPredictors == threadedCodebook.numPredictors &&
+	 memcmp(codebook.book, threadedCodebook.book, sizeof(codebook.book[0]) * codebook.numPredictors) == 0);
+	if (!matches)
+		printf("FAILED: codebook of %s depends on the thread count\n", test.name);
+
+	vector<uint8_t> data((size_t) TEST_FRAMES * VADPCM_FRAME_BYTES);
+	int16_t loopState[VADPCM_LOOP_STATE_SIZE];
+	vadpcm_encode(samples.data(), TEST_FRAMES, &codebook, data.data(), TEST_LOOP_FRAME, loopState);
+
+	int16_t loopHistory[VADPCM_FRAME_SAMPLES];
+	vector<sample_t> decoded = decode(data.data(), TEST_FRAMES, &codebook, loopHistory);
+
+	if (memcmp(loopState, loopHistory, sizeof(loopState)) != 0) {
+		printf("FAILED: loop state of %s doesn't match the decoder\n", test.name);
+		matches = false;
+	}
+
+	double signal = 0.0, noise = 0.0;
+	for (uint32_t i = 0; i < numSamples; i++) {
+		double diff = (double) decoded[i] - samples[i];
+		signal += (double) samples[i] * samples[i];
+		noise += diff * diff;
+	}
+
+	double snr = (noise > 0.0 ? 10.0 * log10(signal / noise) : INFINITY);
+	if (!(snr >= test.minSnr)) {
+		printf("FAILED: %s decodes at %.1f dB SNR, expected at least %.1f dB\n", test.name, snr, test.minSnr);
+		matches = false;
+	}
+
+	return matches;
+}
+
+int main() {
+	int failures = 0;
+
+	printf("Testing VADPCM round trips...\n");
+	for (int i = 0; i < (int) (sizeof(SIGNAL_CASES) / sizeof(SIGNAL_CASES[0])); i++) {
+		if (!test_round_trip(SIGNAL_CASES[i], i))
+			failures++;
+	}
+
+	if (failures > 0) {
+		printf("%d VADPCM test(s) FAILED!\n", failures);
+		return 1;
+	}
+
+	printf("...SUCCESS!\n");
+	return 0;
+}